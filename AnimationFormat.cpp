@@ -0,0 +1,290 @@
+#include "stdafx_assets.h"
+
+#include "AnimationFormat.h"
+
+#include "Mesh.h"
+
+using namespace DirectX;
+
+namespace AnimationFormat
+{
+PackedQuaternion EncodeQuaternion(XMFLOAT4 q)
+{
+  float c[4] = {q.x, q.y, q.z, q.w};
+
+  size_t largest = 0;
+  for (size_t i = 1; i < 4; i++) {
+    if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+  }
+
+  // q and -q are the same rotation, keep the dropped component positive
+  float sign = c[largest] < 0.f ? -1.f : 1.f;
+
+  PackedQuaternion packed;
+  for (size_t i = 0, j = 0; i < 4; i++) {
+    if (i == largest) continue;
+
+    float v = std::clamp(c[i] * sign, -SMALLEST_THREE_RANGE, SMALLEST_THREE_RANGE);
+    packed.v[j++] = static_cast<uint16_t>(std::lround((v + SMALLEST_THREE_RANGE) / (2.f * SMALLEST_THREE_RANGE) * 32767.f));
+  }
+  packed.v[0] |= (largest & 1) << 15;
+  packed.v[1] |= (largest >> 1) << 15;
+
+  return packed;
+}
+
+PackedVector EncodeVector(XMFLOAT3 v, XMFLOAT3 min, XMFLOAT3 extent)
+{
+  auto unorm = [](float value, float min, float extent) {
+    if (extent <= 0.f) return uint16_t(0);
+    return static_cast<uint16_t>(std::lround(std::clamp((value - min) / extent, 0.f, 1.f) * 65535.f));
+  };
+
+  return {unorm(v.x, min.x, extent.x), unorm(v.y, min.y, extent.y), unorm(v.z, min.z, extent.z)};
+}
+
+static float Distance(FXMVECTOR a, FXMVECTOR b) { return XMVectorGetX(XMVector3Length(XMVectorSubtract(a, b))); }
+
+// Per channel packed keys of one track, then the same keys decoded, which is what interpolation will see
+template <typename Packed, typename Value>
+struct Channel {
+  std::vector<Packed> packed;
+  std::vector<Value> decoded;
+
+  // every key packs to the same value
+  bool Constant() const
+  {
+    return std::all_of(packed.begin(), packed.end(),
+                       [&](const Packed& p) { return memcmp(&p, &packed[0], sizeof(Packed)) == 0; });
+  }
+};
+
+Animation Compress(const Animation& clip, const Skin& skin, const Settings& settings, Report* report)
+{
+  assert(!clip.Compressed());
+
+  const size_t numBones = skin.NumBones();
+
+  // how far the joints hanging off each bone are, at the start of the clip.
+  // An error on the local transform of a bone moves all of them
+  std::vector<XMMATRIX> globals;
+  clip.BoneTransforms(clip.minTime, &skin, globals);
+
+  std::vector<float> reach(numBones, 0.f);
+  std::vector<uint32_t> depth(numBones, 1);   // bones from the root, itself included
+  std::vector<uint32_t> height(numBones, 1);  // bones down to the deepest leaf, itself included
+
+  for (size_t i = 0; i < numBones; i++) {
+    int parent = skin.parentIndices[i];
+    if (parent >= 0) depth[i] = depth[parent] + 1;
+
+    for (int a = parent; a >= 0; a = skin.parentIndices[a]) {
+      reach[a] = std::max(reach[a], Distance(globals[i].r[3], globals[a].r[3]));
+    }
+  }
+  // children come after their parents, walking backwards sees a bone once all its descendants are done
+  for (size_t i = numBones; i--;) {
+    int parent = skin.parentIndices[i];
+    if (parent >= 0) height[parent] = std::max(height[parent], height[i] + 1);
+  }
+  // vertices skinned to a leaf extend past it, about as far as the leaf is from its parent
+  for (size_t i = 0; i < numBones; i++) {
+    int parent = skin.parentIndices[i];
+    if (height[i] == 1 && parent >= 0) reach[i] = std::max(reach[i], Distance(globals[i].r[3], globals[parent].r[3]));
+  }
+
+  Animation compressed;
+  compressed.minTime = clip.minTime;
+  compressed.maxTime = clip.maxTime;
+  compressed.trackBones = clip.trackBones;
+
+  for (size_t t = 0; t < clip.tracks.size(); t++) {
+    const Animation::Track& track = clip.tracks[t];
+    const size_t numKeys = track.numKeys;
+
+    // errors of the bones along a chain add up at its end, each gets its share of the tolerance
+    int bone = skin.BoneIndex(clip.trackBones[t]);
+    float tolerance = bone < 0 ? settings.tolerance : settings.tolerance / (depth[bone] + height[bone] - 1);
+    float boneReach = bone < 0 ? 1.f : reach[bone];
+
+    std::span<const float> times(clip.times.data() + track.firstKey, numKeys);
+    std::span<const XMFLOAT3> scales(clip.scales.data() + track.firstKey, numKeys);
+    std::span<const XMFLOAT3> translations(clip.translations.data() + track.firstKey, numKeys);
+    std::span<const XMFLOAT4> rotations(clip.rotations.data() + track.firstKey, numKeys);
+
+    auto range = [](std::span<const XMFLOAT3> values, XMFLOAT3& min, XMFLOAT3& extent) {
+      XMVECTOR vmin = XMLoadFloat3(&values[0]);
+      XMVECTOR vmax = vmin;
+      for (const auto& v : values) {
+        vmin = XMVectorMin(vmin, XMLoadFloat3(&v));
+        vmax = XMVectorMax(vmax, XMLoadFloat3(&v));
+      }
+      XMStoreFloat3(&min, vmin);
+      XMStoreFloat3(&extent, XMVectorSubtract(vmax, vmin));
+    };
+
+    AnimationFormat::TrackChannels channels = {};
+    range(scales, channels.scaleMin, channels.scaleExtent);
+    range(translations, channels.translationMin, channels.translationExtent);
+
+    Channel<PackedQuaternion, XMFLOAT4> rotationKeys;
+    Channel<PackedVector, XMFLOAT3> translationKeys, scaleKeys;
+
+    for (size_t k = 0; k < numKeys; k++) {
+      rotationKeys.packed.push_back(EncodeQuaternion(rotations[k]));
+      rotationKeys.decoded.push_back(DecodeQuaternion(rotationKeys.packed.back()));
+
+      translationKeys.packed.push_back(
+          EncodeVector(translations[k], channels.translationMin, channels.translationExtent));
+      translationKeys.decoded.push_back(
+          DecodeVector(translationKeys.packed.back(), channels.translationMin, channels.translationExtent));
+
+      scaleKeys.packed.push_back(EncodeVector(scales[k], channels.scaleMin, channels.scaleExtent));
+      scaleKeys.decoded.push_back(DecodeVector(scaleKeys.packed.back(), channels.scaleMin, channels.scaleExtent));
+    }
+
+    // displacement of the joints below the bone when key k is rebuilt from keys a and b
+    auto error = [&](size_t a, size_t b, size_t k) {
+      float lerp = times[b] > times[a] ? (times[k] - times[a]) / (times[b] - times[a]) : 0.f;
+
+      XMVECTOR scale = XMVectorLerp(XMLoadFloat3(&scaleKeys.decoded[a]), XMLoadFloat3(&scaleKeys.decoded[b]), lerp);
+      XMVECTOR trans = XMVectorLerp(XMLoadFloat3(&translationKeys.decoded[a]),
+                                    XMLoadFloat3(&translationKeys.decoded[b]), lerp);
+      XMVECTOR rot = XMQuaternionSlerp(XMLoadFloat4(&rotationKeys.decoded[a]),
+                                       XMLoadFloat4(&rotationKeys.decoded[b]), lerp);
+
+      XMVECTOR expected = XMLoadFloat4(&rotations[k]);
+      if (XMVectorGetX(XMQuaternionDot(rot, expected)) < 0.f) expected = XMVectorNegate(expected);
+
+      // for unit quaternions, a point at distance d moves by at most 2 * d * |q - q'|
+      float rotationError = 2.f * XMVectorGetX(XMVector4Length(XMVectorSubtract(rot, expected)));
+      float scaleError = Distance(scale, XMLoadFloat3(&scales[k]));
+
+      return Distance(trans, XMLoadFloat3(&translations[k])) + (rotationError + scaleError) * boneReach;
+    };
+
+    // grow each interval until one of the keys it skips cannot be rebuilt, then keep the last key that could
+    std::vector<size_t> kept = {0};
+    for (size_t a = 0, b = 2; b < numKeys; b++) {
+      for (size_t k = a + 1; k < b; k++) {
+        if (error(a, b, k) > tolerance) {
+          a = b - 1;
+          kept.push_back(a);
+          break;
+        }
+      }
+    }
+    if (numKeys > 1) kept.push_back(numKeys - 1);
+
+    compressed.tracks.push_back(
+        {static_cast<uint32_t>(compressed.times.size()), static_cast<uint32_t>(kept.size())});
+    for (size_t k : kept) {
+      compressed.times.push_back(times[k]);
+    }
+
+    auto emit = [&](const auto& keys, auto& packed, uint32_t& first, uint32_t& stride) {
+      first = static_cast<uint32_t>(packed.size());
+      stride = keys.Constant() ? 0 : 1;
+
+      if (stride == 0) {
+        packed.push_back(keys.packed[0]);
+        return;
+      }
+      for (size_t k : kept) {
+        packed.push_back(keys.packed[k]);
+      }
+    };
+    emit(rotationKeys, compressed.packedRotations, channels.firstRotation, channels.rotationStride);
+    emit(translationKeys, compressed.packedTranslations, channels.firstTranslation, channels.translationStride);
+    emit(scaleKeys, compressed.packedScales, channels.firstScale, channels.scaleStride);
+
+    compressed.trackChannels.push_back(channels);
+  }
+
+  compressed.BuildBoneTracks();
+
+  if (report) {
+    std::vector<float> sampleTimes = clip.times;
+    std::sort(sampleTimes.begin(), sampleTimes.end());
+    sampleTimes.erase(std::unique(sampleTimes.begin(), sampleTimes.end()), sampleTimes.end());
+
+    *report = {
+        .rawKeys = clip.times.size(),
+        .keptKeys = compressed.times.size(),
+        .rawBytes = clip.SizeInBytes(),
+        .compressedBytes = compressed.SizeInBytes(),
+        .maxJointError = MaxJointError(clip, compressed, skin, sampleTimes),
+    };
+  }
+
+  return compressed;
+}
+
+bool Save(const std::filesystem::path& filename, const Animation& clip)
+{
+  assert(clip.Compressed());
+
+  Header header{
+      .magic = MAGIC,
+      .version = VERSION,
+      .numTracks = static_cast<uint32_t>(clip.tracks.size()),
+      .numKeys = static_cast<uint32_t>(clip.times.size()),
+      .numRotations = static_cast<uint32_t>(clip.packedRotations.size()),
+      .numTranslations = static_cast<uint32_t>(clip.packedTranslations.size()),
+      .numScales = static_cast<uint32_t>(clip.packedScales.size()),
+  };
+
+  std::vector<TrackInfo> trackInfos;
+  for (size_t i = 0; i < clip.tracks.size(); i++) {
+    trackInfos.push_back({clip.trackBones[i], clip.tracks[i].firstKey, clip.tracks[i].numKeys, clip.trackChannels[i]});
+  }
+
+  const std::filesystem::path tmpFilename = TemporaryPath(filename);
+  std::error_code ec;
+
+  {
+    std::ofstream out(tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    auto write = [&out](const auto& v) { out.write(reinterpret_cast<const char*>(v.data()), sizeof(v[0]) * v.size()); };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write(trackInfos);
+    write(clip.times);
+    write(clip.packedRotations);
+    write(clip.packedTranslations);
+    write(clip.packedScales);
+
+    if (!out) {
+      out.close();
+      std::filesystem::remove(tmpFilename, ec);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpFilename, filename, ec);
+  if (ec) {
+    std::filesystem::remove(tmpFilename, ec);
+    return false;
+  }
+
+  return true;
+}
+
+float MaxJointError(const Animation& a, const Animation& b, const Skin& skin, std::span<const float> times)
+{
+  std::vector<XMMATRIX> globalsA, globalsB;
+  float error = 0.f;
+
+  for (float time : times) {
+    a.BoneTransforms(time, &skin, globalsA);
+    b.BoneTransforms(time, &skin, globalsB);
+
+    for (size_t i = 0; i < skin.NumBones(); i++) {
+      error = std::max(error, Distance(globalsA[i].r[3], globalsB[i].r[3]));
+    }
+  }
+
+  return error;
+}
+}  // namespace AnimationFormat
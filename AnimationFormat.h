@@ -0,0 +1,124 @@
+#pragma once
+
+#include "MappedFile.h"
+
+struct Skin;
+struct Animation;
+
+// Compressed .anim layout, written by AnimationFormat::Save
+//
+//   Header | TrackInfo x numTracks | times | rotations | translations | scales
+//
+// Keys that interpolation can rebuild within tolerance are dropped, the remaining ones are quantized:
+// rotations as the three smallest components (6 bytes), translations and scales on 16 bits over the
+// range of their track. A channel that does not move in a track stores a single value.
+// Files that do not start with MAGIC are raw clips written by assets/gltf.py (Animation.pack).
+namespace AnimationFormat
+{
+inline constexpr uint32_t MAGIC = 0x4D494E41;  // "ANIM"
+inline constexpr uint32_t VERSION = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numTracks;
+  uint32_t numKeys;
+  uint32_t numRotations;
+  uint32_t numTranslations;
+  uint32_t numScales;
+  uint32_t _pad;
+};
+static_assert(sizeof(Header) == 32);
+
+// Where the keys of a track are, per channel. index = first + key * stride, stride is 0 for constant channels
+struct TrackChannels {
+  uint32_t firstRotation, rotationStride;
+  uint32_t firstTranslation, translationStride;
+  uint32_t firstScale, scaleStride;
+  DirectX::XMFLOAT3 translationMin, translationExtent;
+  DirectX::XMFLOAT3 scaleMin, scaleExtent;
+};
+static_assert(sizeof(TrackChannels) == 72);
+
+struct TrackInfo {
+  int32_t boneId;
+  uint32_t firstKey;
+  uint32_t numKeys;
+  TrackChannels channels;
+};
+static_assert(sizeof(TrackInfo) == 84);
+
+// Smallest three: the largest component is dropped and rebuilt from the unit length, the other three are
+// in [-1/sqrt(2), 1/sqrt(2)] and stored on 15 bits. The top bits of v[0] and v[1] hold the index of the dropped one
+struct PackedQuaternion {
+  uint16_t v[3];
+};
+static_assert(sizeof(PackedQuaternion) == 6);
+
+// unorm16 over the track range
+struct PackedVector {
+  uint16_t v[3];
+};
+static_assert(sizeof(PackedVector) == 6);
+
+inline constexpr float SMALLEST_THREE_RANGE = 0.70710678f;
+
+PackedQuaternion EncodeQuaternion(DirectX::XMFLOAT4 q);
+
+inline DirectX::XMFLOAT4 DecodeQuaternion(PackedQuaternion packed)
+{
+  constexpr float scale = 2.f * SMALLEST_THREE_RANGE / 32767.f;
+
+  float a = (packed.v[0] & 0x7fff) * scale - SMALLEST_THREE_RANGE;
+  float b = (packed.v[1] & 0x7fff) * scale - SMALLEST_THREE_RANGE;
+  float c = (packed.v[2] & 0x7fff) * scale - SMALLEST_THREE_RANGE;
+  float largest = std::sqrt(std::max(0.f, 1.f - a * a - b * b - c * c));
+
+  switch ((packed.v[0] >> 15) | (packed.v[1] >> 15) << 1) {
+    case 0:
+      return {largest, a, b, c};
+    case 1:
+      return {a, largest, b, c};
+    case 2:
+      return {a, b, largest, c};
+    default:
+      return {a, b, c, largest};
+  }
+}
+
+PackedVector EncodeVector(DirectX::XMFLOAT3 v, DirectX::XMFLOAT3 min, DirectX::XMFLOAT3 extent);
+
+inline DirectX::XMFLOAT3 DecodeVector(PackedVector packed, DirectX::XMFLOAT3 min, DirectX::XMFLOAT3 extent)
+{
+  constexpr float scale = 1.f / 65535.f;
+
+  return {min.x + packed.v[0] * scale * extent.x, min.y + packed.v[1] * scale * extent.y,
+          min.z + packed.v[2] * scale * extent.z};
+}
+
+inline bool IsCompressed(const MappedFile& file)
+{
+  return file.Size() >= sizeof(Header) && file.View<uint32_t>(0, 1)[0] == MAGIC;
+}
+
+struct Settings {
+  // largest joint displacement allowed when dropping keys, in model units. It is shared along each chain
+  // of bones, so a bone deep in a long chain gets a smaller part of it than one in a short chain.
+  // Quantization adds its own error on top, see Report::maxJointError
+  float tolerance = 1e-3f;
+};
+
+struct Report {
+  size_t rawKeys, keptKeys;
+  size_t rawBytes, compressedBytes;  // in memory, see Animation::SizeInBytes
+  float maxJointError;               // over the whole clip, sampled at every raw key time
+};
+
+// clip must be raw. Tracks of bones outside the skin are kept within tolerance as if they were roots
+Animation Compress(const Animation& clip, const Skin& skin, const Settings& settings, Report* report = nullptr);
+
+bool Save(const std::filesystem::path& filename, const Animation& clip);
+
+// largest distance between the joints posed by a and b, at the given times
+float MaxJointError(const Animation& a, const Animation& b, const Skin& skin, std::span<const float> times);
+}  // namespace AnimationFormat
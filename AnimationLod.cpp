@@ -0,0 +1,105 @@
+#include "stdafx_assets.h"
+
+#include "AnimationLod.h"
+
+#include "Lanes.h"
+
+using namespace DirectX;
+
+size_t AnimationLod::KeyHash::operator()(const Key& key) const
+{
+  size_t hash = std::hash<const void*>()(key.animation);
+  hash = hash * 31 + std::hash<const void*>()(key.skin);
+  hash = hash * 31 + std::hash<float>()(key.offset);
+  hash = hash * 31 + key.interval;
+
+  return hash;
+}
+
+void AnimationLod::Pose::Resolve(XMFLOAT4X4* boneMatrices) const
+{
+  if (m_Blend >= 1.f) {
+    std::copy(m_To.begin(), m_To.end(), boneMatrices);
+    return;
+  }
+
+  // blending the matrices themselves, the poses are close enough for the rotations not to shrink visibly
+  const float* from = &m_From[0].m[0][0];
+  const float* to = &m_To[0].m[0][0];
+  float* out = &boneMatrices[0].m[0][0];
+  const Lanes blend = Lanes::Set(m_Blend);
+
+  static_assert(16 % Lanes::WIDTH == 0);
+  for (size_t i = 0; i < m_To.size() * 16; i += Lanes::WIDTH) {
+    Lanes a = Lanes::Load(from + i);
+    Lanes b = Lanes::Load(to + i);
+    (a + (b - a) * blend).Store(out + i);
+  }
+}
+
+void AnimationLod::BeginFrame(float time)
+{
+  float frameTime = time - m_Time;
+  if (m_Frame > 0 && frameTime > 0.f) m_FrameTime += (frameTime - m_FrameTime) * 0.1f;
+
+  m_Frame++;
+  m_Time = time;
+  m_NumFound = 0;
+  m_NumEvaluated = 0;
+
+  std::erase_if(m_Poses, [this](const auto& pose) { return pose.second.m_LastSeen + 1 < m_Frame; });
+}
+
+uint32_t AnimationLod::Interval(float distance) const
+{
+  uint32_t interval = 1;
+  for (float threshold : m_Settings.distances) {
+    if (distance > threshold) interval *= 2;
+  }
+
+  return interval;
+}
+
+AnimationLod::Entry AnimationLod::Find(const AnimationInfo& info, const Skin* skin, float distance,
+                                       const PoseCache& cache)
+{
+  const uint32_t interval = Interval(distance);
+  if (interval == 1) return {nullptr, 0, false};
+
+  const float offset = cache.Offset(info);
+  auto [it, inserted] = m_Poses.try_emplace({info.animation.get(), skin, offset, interval});
+  Pose& pose = it->second;
+
+  if (inserted) {
+    // consecutive phases: of any group of poses on the same interval, one in interval updates each frame
+    pose.m_Phase = m_NextPhase++;
+    pose.m_From.resize(skin->header.numJoints);
+    pose.m_To.resize(skin->header.numJoints);
+  }
+  if (pose.m_LastSeen == m_Frame) return {&pose, pose.m_Index, false};
+
+  pose.m_LastSeen = m_Frame;
+  pose.m_Index = m_NumFound++;
+
+  // a new pose starts from one of this frame, without anything to blend from. An instance that changes
+  // interval moves to another pose
+  bool restart = pose.m_LastEvaluated == 0;
+  pose.m_Evaluate = restart || (m_Frame + pose.m_Phase) % interval == 0;
+
+  if (pose.m_Evaluate) {
+    bool blend = m_Settings.interpolate && !restart;
+
+    // the pose reached at the end of the last interval is where the next one starts from
+    if (blend) std::swap(pose.m_From, pose.m_To);
+
+    pose.m_LastEvaluated = m_Frame;
+    pose.m_EvaluationTime = info.ClipTime((blend ? m_Time + interval * m_FrameTime : m_Time) + offset);
+    pose.m_Blend = blend ? 0.f : 1.f;
+
+    m_NumEvaluated++;
+  } else if (pose.m_Blend < 1.f) {
+    pose.m_Blend = static_cast<float>(m_Frame - pose.m_LastEvaluated) / interval;
+  }
+
+  return {&pose, pose.m_Index, true};
+}
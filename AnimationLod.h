@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Mesh.h"
+#include "PoseCache.h"
+
+// Animation level of detail: instances far from the camera get a new pose every 2nd, 4th or 8th frame only.
+// Each instance gets its own phase, so the ones sharing an update interval take turns and every frame
+// evaluates about as many poses as the others. The frames in between either hold the last pose, or blend
+// towards the next one, evaluated one interval ahead since the clip time is known in advance.
+// Far poses are shared like the PoseCache ones: instances playing the same animation on the same skin at the same
+// bucketed offset, on the same interval, get one pose and phase between them.
+class AnimationLod
+{
+public:
+  struct Settings {
+    // an instance farther than distances[i] is posed every 2^(i + 1) frames
+    std::array<float, 3> distances = {20.f, 40.f, 80.f};
+    bool interpolate = true;
+  };
+
+  // The poses kept for one instance and skin between its updates
+  class Pose
+  {
+  public:
+    bool NeedsEvaluation() const { return m_Evaluate; }
+    float Time() const { return m_EvaluationTime; }  // clip time to evaluate at, ahead of the frame when blending
+
+    // where to evaluate to, skin->header.numJoints matrices laid out like Animation::BoneTransforms
+    DirectX::XMFLOAT4X4* Target() { return m_To.data(); }
+
+    // once evaluated: the pose to show this frame
+    void Resolve(DirectX::XMFLOAT4X4* boneMatrices) const;
+
+  private:
+    friend class AnimationLod;
+
+    std::vector<DirectX::XMFLOAT4X4> m_From, m_To;
+    uint64_t m_Phase = 0;
+    uint64_t m_LastSeen = 0;
+    uint64_t m_LastEvaluated = 0;  // 0 until the first evaluation
+    size_t m_Index = 0;            // of this frame
+    bool m_Evaluate = false;
+    float m_EvaluationTime = 0.f;
+    float m_Blend = 1.f;  // from m_From to m_To
+  };
+
+  AnimationLod() = default;
+  explicit AnimationLod(const Settings& settings) : m_Settings(settings) {}
+
+  Settings& GetSettings() { return m_Settings; }
+
+  // once per frame, before the first Find. Forgets the poses that were not found last frame
+  void BeginFrame(float time);
+
+  // frames between two poses at that distance from the camera
+  uint32_t Interval(float distance) const;
+
+  struct Entry {
+    Pose* pose;    // null when the instance is close enough to be posed every frame
+    size_t index;  // poses are numbered in the order they were first found since BeginFrame
+    bool first;    // no instance found this pose before this frame, the caller places it
+  };
+
+  // the offset of info is bucketed by cache, see PoseCache::Offset
+  Entry Find(const AnimationInfo& info, const Skin* skin, float distance, const PoseCache& cache);
+
+  size_t NumPoses() const { return m_Poses.size(); }
+  size_t NumEvaluated() const { return m_NumEvaluated; }  // this frame
+
+private:
+  struct Key {
+    const Animation* animation;
+    const Skin* skin;
+    float offset;
+    uint32_t interval;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  std::unordered_map<Key, Pose, KeyHash> m_Poses;
+  Settings m_Settings;
+  uint64_t m_Frame = 0;
+  uint64_t m_NextPhase = 0;
+  size_t m_NumFound = 0;
+  size_t m_NumEvaluated = 0;
+  float m_Time = 0.f;
+  float m_FrameTime = 1.f / 60.f;  // smoothed, to know when the next update of an instance will be
+};
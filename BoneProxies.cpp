@@ -0,0 +1,252 @@
+#include "stdafx_assets.h"
+
+#include "BoneProxies.h"
+
+using namespace DirectX;
+
+// power iterations for the main axis of the vertices of a joint, plenty for a 3x3 covariance
+static constexpr int AXIS_ITERATIONS = 32;
+
+static uint32_t DominantJoint(const XMUINT2& bwi)
+{
+  uint32_t best = 0;
+  for (uint32_t k = 1; k < 4; k++) {
+    if (((bwi.x >> (8 * k)) & 0xff) > ((bwi.x >> (8 * best)) & 0xff)) best = k;
+  }
+
+  return (bwi.y >> (8 * best)) & 0xff;
+}
+
+// sphere around the capsules, centered on their box
+static void Bounds(std::span<const BoneProxies::Capsule> capsules, XMFLOAT3& center, float& radius)
+{
+  if (capsules.empty()) {
+    radius = -1.f;
+    return;
+  }
+
+  XMVECTOR boxMin = XMVectorReplicate(std::numeric_limits<float>::infinity()), boxMax = -boxMin;
+  for (const auto& c : capsules) {
+    XMVECTOR r = XMVectorReplicate(c.radius);
+    XMVECTOR a = XMLoadFloat3(&c.a), b = XMLoadFloat3(&c.b);
+    boxMin = XMVectorMin(boxMin, XMVectorMin(a, b) - r);
+    boxMax = XMVectorMax(boxMax, XMVectorMax(a, b) + r);
+  }
+
+  XMVECTOR mid = (boxMin + boxMax) * 0.5f;
+  XMStoreFloat3(&center, mid);
+
+  radius = 0.f;
+  for (const auto& c : capsules) {
+    float a = XMVectorGetX(XMVector3Length(XMLoadFloat3(&c.a) - mid));
+    float b = XMVectorGetX(XMVector3Length(XMLoadFloat3(&c.b) - mid));
+    radius = std::max(radius, std::max(a, b) + c.radius);
+  }
+}
+
+// Segment along the main axis of the points, shortened by the radius at both ends where the points allow,
+// and the radius that then contains them all
+static BoneProxies::Capsule FitCapsule(std::span<const XMFLOAT3> points)
+{
+  XMVECTOR centroid = XMVectorZero();
+  for (const auto& p : points) {
+    centroid += XMLoadFloat3(&p);
+  }
+  centroid /= static_cast<float>(points.size());
+
+  float cov[3][3] = {};
+  for (const auto& p : points) {
+    XMFLOAT3 d;
+    XMStoreFloat3(&d, XMLoadFloat3(&p) - centroid);
+    const float v[3] = {d.x, d.y, d.z};
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) {
+        cov[r][c] += v[r] * v[c];
+      }
+    }
+  }
+
+  // from the axis of most variance, so that a single iteration is already close for long limbs
+  int start = cov[0][0] >= cov[1][1] ? (cov[0][0] >= cov[2][2] ? 0 : 2) : (cov[1][1] >= cov[2][2] ? 1 : 2);
+  float axis[3] = {};
+  axis[start] = 1.f;
+  for (int i = 0; i < AXIS_ITERATIONS; i++) {
+    float next[3];
+    for (int r = 0; r < 3; r++) {
+      next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2];
+    }
+
+    float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (length == 0.f) break;  // a single point, or all of them at the centroid
+
+    for (int r = 0; r < 3; r++) {
+      axis[r] = next[r] / length;
+    }
+  }
+  const XMVECTOR dir = XMVectorSet(axis[0], axis[1], axis[2], 0.f);
+
+  float tMin = std::numeric_limits<float>::infinity(), tMax = -tMin, radius = 0.f;
+  for (const auto& p : points) {
+    XMVECTOR d = XMLoadFloat3(&p) - centroid;
+    float t = XMVectorGetX(XMVector3Dot(d, dir));
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+    radius = std::max(radius, XMVectorGetX(XMVector3Length(d - dir * t)));
+  }
+
+  // the round ends cover what the radius reaches past the segment
+  float mid = (tMin + tMax) * 0.5f;
+  float t0 = std::min(tMin + radius, mid), t1 = std::max(tMax - radius, mid);
+
+  XMVECTOR a = centroid + dir * t0, b = centroid + dir * t1;
+  XMVECTOR ab = b - a;
+  float abab = XMVectorGetX(XMVector3Dot(ab, ab));
+
+  radius = 0.f;
+  for (const auto& p : points) {
+    XMVECTOR ap = XMLoadFloat3(&p) - a;
+    float t = abab > 0.f ? std::clamp(XMVectorGetX(XMVector3Dot(ap, ab)) / abab, 0.f, 1.f) : 0.f;
+    radius = std::max(radius, XMVectorGetX(XMVector3Length(ap - ab * t)));
+  }
+
+  BoneProxies::Capsule capsule;
+  XMStoreFloat3(&capsule.a, a);
+  XMStoreFloat3(&capsule.b, b);
+  capsule.radius = radius;
+
+  return capsule;
+}
+
+void BoneProxies::Fit(std::span<const XMFLOAT3> positions, std::span<const XMUINT2> blendWeightsAndIndices,
+                      size_t numJoints)
+{
+  assert(positions.size() == blendWeightsAndIndices.size());
+
+  // vertices grouped by joint. Those of a joint the skin does not have come from a broken asset, they are left out
+  std::vector<uint32_t> counts(numJoints + 1, 0);
+  for (const auto& bwi : blendWeightsAndIndices) {
+    uint32_t joint = DominantJoint(bwi);
+    if (joint < numJoints) counts[joint + 1]++;
+  }
+  std::partial_sum(counts.begin(), counts.end(), counts.begin());
+
+  std::vector<XMFLOAT3> grouped(counts.back());
+  std::vector<uint32_t> next(counts.begin(), counts.end() - 1);
+  for (size_t v = 0; v < positions.size(); v++) {
+    uint32_t joint = DominantJoint(blendWeightsAndIndices[v]);
+    if (joint < numJoints) grouped[next[joint]++] = positions[v];
+  }
+
+  m_Joints.clear();
+  m_Bind.clear();
+  for (uint32_t joint = 0; joint < numJoints; joint++) {
+    if (counts[joint] == counts[joint + 1]) continue;
+
+    m_Joints.push_back(joint);
+    m_Bind.push_back(FitCapsule(std::span(grouped).subspan(counts[joint], counts[joint + 1] - counts[joint])));
+  }
+
+  // the bind pose where the mesh is, until the first Update or Move
+  m_Posed = m_Bind;
+  m_World = m_Bind;
+  Bounds(m_World, m_Center, m_Radius);
+}
+
+// the capsule moved by a transform, its radius grown by the largest scale of it
+static BoneProxies::Capsule Transform(const BoneProxies::Capsule& capsule, FXMMATRIX m)
+{
+  float scale = std::sqrt(std::max({XMVectorGetX(XMVector3LengthSq(m.r[0])), XMVectorGetX(XMVector3LengthSq(m.r[1])),
+                                    XMVectorGetX(XMVector3LengthSq(m.r[2]))}));
+
+  BoneProxies::Capsule moved;
+  XMStoreFloat3(&moved.a, XMVector3Transform(XMLoadFloat3(&capsule.a), m));
+  XMStoreFloat3(&moved.b, XMVector3Transform(XMLoadFloat3(&capsule.b), m));
+  moved.radius = capsule.radius * scale;
+
+  return moved;
+}
+
+void BoneProxies::Update(std::span<const XMFLOAT4X4> boneMatrices, FXMMATRIX world)
+{
+  for (size_t i = 0; i < m_Bind.size(); i++) {
+    // transposed for the shaders
+    m_Posed[i] = Transform(m_Bind[i], XMMatrixTranspose(XMLoadFloat4x4(&boneMatrices[m_Joints[i]])));
+  }
+
+  Move(world);
+}
+
+void BoneProxies::Move(FXMMATRIX world)
+{
+  for (size_t i = 0; i < m_Posed.size(); i++) {
+    m_World[i] = Transform(m_Posed[i], world);
+  }
+
+  Bounds(m_World, m_Center, m_Radius);
+}
+
+// Distance along the ray to the capsule, negative when missed or when the origin is inside
+static float IntersectCapsule(FXMVECTOR origin, FXMVECTOR direction, const BoneProxies::Capsule& capsule)
+{
+  const XMVECTOR a = XMLoadFloat3(&capsule.a), b = XMLoadFloat3(&capsule.b);
+  const float rr = capsule.radius * capsule.radius;
+
+  XMVECTOR ba = b - a, oa = origin - a;
+  float baba = XMVectorGetX(XMVector3Dot(ba, ba));
+  float bard = XMVectorGetX(XMVector3Dot(ba, direction));
+  float baoa = XMVectorGetX(XMVector3Dot(ba, oa));
+  float rdoa = XMVectorGetX(XMVector3Dot(direction, oa));
+  float oaoa = XMVectorGetX(XMVector3Dot(oa, oa));
+
+  // the side, the infinite cylinder limited to the segment
+  float qa = baba - bard * bard;
+  float qb = baba * rdoa - baoa * bard;
+  float qc = baba * oaoa - baoa * baoa - rr * baba;
+  float h = qb * qb - qa * qc;
+  if (h < 0.f) return -1.f;
+
+  // where along the segment the side is hit, or the end the ray runs to when parallel to it
+  float y;
+  if (qa > 0.f) {
+    float t = (-qb - std::sqrt(h)) / qa;
+    y = baoa + t * bard;
+    if (y > 0.f && y < baba) return t;
+  } else {
+    y = bard > 0.f ? 0.f : baba;
+  }
+
+  // otherwise the sphere of the end on that side
+  XMVECTOR oc = y <= 0.f ? oa : origin - b;
+  float sb = XMVectorGetX(XMVector3Dot(direction, oc));
+  float sc = XMVectorGetX(XMVector3Dot(oc, oc)) - rr;
+  float sh = sb * sb - sc;
+  if (sh < 0.f) return -1.f;
+
+  return -sb - std::sqrt(sh);
+}
+
+int BoneProxies::Intersect(FXMVECTOR origin, FXMVECTOR direction, float& distance) const
+{
+  if (m_Radius < 0.f) return -1;
+
+  // the bounding sphere first, ahead of the origin or around it
+  XMVECTOR oc = origin - XMLoadFloat3(&m_Center);
+  float b = XMVectorGetX(XMVector3Dot(direction, oc));
+  float c = XMVectorGetX(XMVector3Dot(oc, oc)) - m_Radius * m_Radius;
+  if (c > 0.f && (b > 0.f || b * b < c)) return -1;
+
+  int hit = -1;
+  float best = std::numeric_limits<float>::infinity();
+
+  for (size_t i = 0; i < m_World.size(); i++) {
+    float t = IntersectCapsule(origin, direction, m_World[i]);
+    if (t >= 0.f && t < best) {
+      best = t;
+      hit = static_cast<int>(i);
+    }
+  }
+
+  if (hit >= 0) distance = best;
+
+  return hit;
+}
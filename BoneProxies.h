@@ -0,0 +1,45 @@
+#pragma once
+
+// Capsules standing in for a skinned mesh in collision queries, one per joint that moves vertices.
+// Each one is fitted once in the bind pose around the vertices weighing the most on its joint, then follows
+// that joint with the bone matrices of the frame. Moving them and testing a ray cost one step per joint,
+// whatever the number of triangles.
+// Fitting is done once when the collider takes the mesh, not offline by the exporter: it is a few passes over
+// the vertices, and the .mesh format needs no section for it
+class BoneProxies
+{
+public:
+  struct Capsule {
+    DirectX::XMFLOAT3 a;  // ends of the segment
+    DirectX::XMFLOAT3 b;
+    float radius;
+  };
+
+  // streams laid out like the Mesh3D ones, see Skinning::Buffers. The capsules start in the bind pose
+  void Fit(std::span<const DirectX::XMFLOAT3> positions, std::span<const DirectX::XMUINT2> blendWeightsAndIndices,
+           size_t numJoints);
+
+  // boneMatrices laid out like AnimationInfo::BoneTransforms gives them, world places the mesh
+  void Update(std::span<const DirectX::XMFLOAT4X4> boneMatrices, DirectX::FXMMATRIX world);
+  // the pose of the last Update somewhere else
+  void Move(DirectX::FXMMATRIX world);
+
+  // closest capsule hit by the ray of unit direction from outside of it, -1 when none.
+  // distance is only written on a hit
+  int Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float& distance) const;
+
+  size_t NumCapsules() const { return m_Joints.size(); }
+  uint32_t Joint(size_t capsule) const { return m_Joints[capsule]; }
+  std::span<const Capsule> BindCapsules() const { return m_Bind; }
+  std::span<const Capsule> WorldCapsules() const { return m_World; }
+
+private:
+  std::vector<uint32_t> m_Joints;  // per capsule
+  std::vector<Capsule> m_Bind;
+  std::vector<Capsule> m_Posed;  // by the bone matrices of the last Update, in the space of the mesh
+  std::vector<Capsule> m_World;
+
+  // sphere around the world capsules, for the rays that miss the whole mesh
+  DirectX::XMFLOAT3 m_Center = {0.f, 0.f, 0.f};
+  float m_Radius = -1.f;
+};
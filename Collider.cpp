@@ -1,99 +1,268 @@
-#include "stdafx.h"
+#include "stdafx_assets.h"
 
-#include "DirectXCollision.h"
 #include "Collider.h"
 
+#include "Jobs.h"
+#include "Lanes.h"
+
 using namespace DirectX;
 
+// rays walked down the hierarchy together, one bit each in a mask
+static constexpr size_t MAX_PACKET_SIZE = 32;
+
+// same as the one TriangleTests::Intersects compares the determinant with
+static constexpr float RAY_EPSILON = 1e-20f;
+
+// beyond this slope from the horizontal a surface is a wall, 0.25 being the y of the unit normal
+static constexpr float WALL_SLOPE = 0.25f;
+
+// models of at most this many blocks are scanned whole, without walking their hierarchy
+static constexpr size_t BRUTE_FORCE_BLOCKS = 4;
+
+// queries of FindBatch a worker takes at a time, neighbours along the curve
+static constexpr size_t BATCH_GRAIN = 64;
+
+static constexpr uint32_t LANE_BITS = (1u << Lanes::WIDTH) - 1;
+
+static_assert(SurfaceBlock::SIZE % Lanes::WIDTH == 0);
+
 Collider::Collider() {}
 
+Collider::~Collider() {}
+
+// must be called before the renderer releases the geometry, see Mesh3D::Retain. Only the model transform is read
+// again afterwards
 void Collider::AppendModel(Model3D* m)
 {
   ColliderNode node;
 
   node.model = m;
   node.CreateSurfacesFromModel();
-  m_ColliderNodes.push_back(node);
+  node.SetTransform(m->WorldMatrix());
+
+  for (auto& mesh : m->meshes) {
+    if (!mesh->Skinned()) continue;
+
+    BoneProxies proxies;
+    proxies.Fit(mesh->positions, mesh->blendWeightsAndIndices, mesh->skin->header.numJoints);
+    proxies.Move(mesh->LocalTransformMatrix() * m->WorldMatrix());
+    m_Proxies[m].push_back({mesh.get(), std::move(proxies)});
+  }
+
+  m->Clean();
+
+  m_ColliderNodes.push_back(std::move(node));
 }
 
 void Collider::RefreshDynamicModels()
 {
+  // before the surfaces, which clean the models
+  for (auto& [model, meshes] : m_Proxies) {
+    if (!model->dirty) continue;
+
+    for (auto& [mesh, proxies] : meshes) {
+      proxies.Move(mesh->LocalTransformMatrix() * model->WorldMatrix());
+    }
+  }
+
   for (auto& node : m_ColliderNodes) {
     if (!node.model->dirty) continue;
 
-    node.CreateSurfacesFromModel();
+    node.SetTransform(node.model->WorldMatrix());
+    node.model->Clean();
   }
 }
 
 void Collider::ColliderNode::CreateSurfacesFromModel()
 {
-  Clear();
-  model->Clean();
+  surfaces.clear();
+
+  for (auto& mesh : model->meshes) {
+    // collides through its bone proxies instead, its triangles are only in the bind pose here
+    if (mesh->Skinned()) continue;
 
-  for (auto &mesh : model->meshes) {
     for (auto& sub : mesh->subsets) {
       unsigned int offset = sub.start;
 
       for (unsigned int i = 0; i < sub.count; i += 3) {
         Surface surf;
-        XMVECTOR xmv1, xmv2, xmv3;
 
-        // copy positions
-        {
-          int i1 = mesh->indices[i + offset];
-          int i2 = mesh->indices[i + 1 + offset];
-          int i3 = mesh->indices[i + 2 + offset];
+        surf.v1 = mesh->positions[mesh->indices[i + offset]];
+        surf.v2 = mesh->positions[mesh->indices[i + 1 + offset]];
+        surf.v3 = mesh->positions[mesh->indices[i + 2 + offset]];
 
-          XMFLOAT3 p1 = mesh->positions[i1];
-          XMFLOAT3 p2 = mesh->positions[i2];
-          XMFLOAT3 p3 = mesh->positions[i3];
+        XMVECTOR xmv1 = XMLoadFloat3(&surf.v1);
+        XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&surf.v2) - xmv1, XMLoadFloat3(&surf.v3) - xmv1));
+        XMStoreFloat3(&surf.normal, normal);
+        XMStoreFloat(&surf.originOffset, -XMVector3Dot(normal, xmv1));
 
-          // here translate + offset
+        surf.minY = std::min({surf.v1.y, surf.v2.y, surf.v3.y});
+        surf.maxY = std::max({surf.v1.y, surf.v2.y, surf.v3.y});
 
-          xmv1 = XMVectorSet(p1.x, p1.y, p1.z, 1.0f);
-          xmv1 = XMVector4Transform(xmv1, model->WorldMatrix());
-          XMStoreFloat3(&surf.v1, xmv1);
+        surfaces.push_back(surf);
+      }
+    }
+  }
 
-          xmv2 = XMVectorSet(p2.x, p2.y, p2.z, 1.0f);
-          xmv2 = XMVector4Transform(xmv2, model->WorldMatrix());
-          XMStoreFloat3(&surf.v2, xmv2);
+  bvh.Build(surfaces, SurfaceBlock::SIZE);
+  SurfaceBlock::Build(surfaces, bvh, blocks);
+}
 
-          xmv3 = XMVectorSet(p3.x, p3.y, p3.z, 1.0f);
-          xmv3 = XMVector4Transform(xmv3, model->WorldMatrix());
-          XMStoreFloat3(&surf.v3, xmv3);
-        }
+void Collider::ColliderNode::SetTransform(FXMMATRIX transform)
+{
+  XMVECTOR determinant;
+  XMMATRIX inverse = XMMatrixInverse(&determinant, transform);
 
-        // compute face normal and origin offset
-        {
-          XMVECTOR u, v, normal;
-          u = xmv2 - xmv1;
-          v = xmv3 - xmv1;
-          normal = XMVector3Normalize(XMVector3Cross(u, v));
-          XMStoreFloat3(&surf.normal, normal);
+  XMStoreFloat4x4(&world, transform);
+  XMStoreFloat4x4(&invWorld, inverse);
 
-          XMStoreFloat(&surf.originOffset, -XMVector3Dot(normal, xmv1));
-        }
+  // the cross product of transformed edges is the cross product of the edges times det * inverse transposed
+  XMMATRIX cof = XMMatrixTranspose(inverse);
+  for (auto& row : cof.r) {
+    row = XMVectorMultiply(row, determinant);
+  }
+  XMStoreFloat3x3(&cofactors, cof);
+
+  const XMVECTOR infinity = XMVectorReplicate(std::numeric_limits<float>::infinity());
+  XMVECTOR boundsMin = infinity, boundsMax = -infinity;
+
+  if (!bvh.nodes.empty()) {
+    const SurfaceBvh::Node& root = bvh.nodes[0];
+    for (int corner = 0; corner < 8; corner++) {
+      XMVECTOR p = XMVectorSet(corner & 1 ? root.max.x : root.min.x, corner & 2 ? root.max.y : root.min.y,
+                               corner & 4 ? root.max.z : root.min.z, 1.f);
+      p = XMVector3Transform(p, transform);
+      boundsMin = XMVectorMin(boundsMin, p);
+      boundsMax = XMVectorMax(boundsMax, p);
+    }
+  }
 
-        surf.minY = std::min({surf.v1.y, surf.v2.y, surf.v3.y});
-        surf.maxY = std::max({surf.v1.y, surf.v2.y, surf.v3.y});
+  XMStoreFloat3(&worldMin, boundsMin);
+  XMStoreFloat3(&worldMax, boundsMax);
+}
+
+// nodes of indices[begin, end), depth first
+static void BuildNode(SurfaceBvh& bvh, std::span<const Surface> surfaces, std::span<const XMFLOAT3> centroids,
+                      uint32_t leafSize, uint32_t begin, uint32_t end)
+{
+  const uint32_t nodeIndex = static_cast<uint32_t>(bvh.nodes.size());
+  bvh.nodes.emplace_back();
+
+  const XMVECTOR infinity = XMVectorReplicate(std::numeric_limits<float>::infinity());
+  XMVECTOR boxMin = infinity, boxMax = -infinity;
+  XMVECTOR centroidMin = infinity, centroidMax = -infinity;
+
+  for (uint32_t i = begin; i < end; i++) {
+    const Surface& surf = surfaces[bvh.indices[i]];
+    for (const XMFLOAT3* v : {&surf.v1, &surf.v2, &surf.v3}) {
+      boxMin = XMVectorMin(boxMin, XMLoadFloat3(v));
+      boxMax = XMVectorMax(boxMax, XMLoadFloat3(v));
+    }
+
+    XMVECTOR centroid = XMLoadFloat3(&centroids[bvh.indices[i]]);
+    centroidMin = XMVectorMin(centroidMin, centroid);
+    centroidMax = XMVectorMax(centroidMax, centroid);
+  }
+
+  // heights and ray hits are computed with some rounding, they may land a few ulps out of the exact bounds
+  XMVECTOR magnitude = XMVectorMax(XMVectorAbs(boxMin), XMVectorAbs(boxMax));
+  float padding = 1e-4f * (1.f + std::max({XMVectorGetX(magnitude), XMVectorGetY(magnitude), XMVectorGetZ(magnitude)}));
+
+  SurfaceBvh::Node& node = bvh.nodes[nodeIndex];
+  XMStoreFloat3(&node.min, boxMin - XMVectorReplicate(padding));
+  XMStoreFloat3(&node.max, boxMax + XMVectorReplicate(padding));
 
-        if (surf.normal.y > 0.25)
-          floors.push_back(surf);
-        else if (surf.normal.y < -0.25)
-          ceilings.push_back(surf);
-        else
-          walls.push_back(surf);
+  if (end - begin <= leafSize) {
+    node.first = begin;
+    node.count = end - begin;
+    return;
+  }
+
+  XMFLOAT3 extent;
+  XMStoreFloat3(&extent, centroidMax - centroidMin);
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+  uint32_t mid = begin + (end - begin) / 2;
+  std::nth_element(bvh.indices.begin() + begin, bvh.indices.begin() + mid, bvh.indices.begin() + end,
+                   [&centroids, axis](uint32_t a, uint32_t b) {
+                     return (&centroids[a].x)[axis] < (&centroids[b].x)[axis];
+                   });
+
+  BuildNode(bvh, surfaces, centroids, leafSize, begin, mid);
+  bvh.nodes[nodeIndex].first = static_cast<uint32_t>(bvh.nodes.size());
+  bvh.nodes[nodeIndex].count = 0;
+  BuildNode(bvh, surfaces, centroids, leafSize, mid, end);
+}
+
+void SurfaceBvh::Build(std::span<const Surface> surfaces, uint32_t leafSize)
+{
+  assert(leafSize > 0);
+
+  nodes.clear();
+  indices.resize(surfaces.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+
+  if (surfaces.empty()) return;
+
+  std::vector<XMFLOAT3> centroids(surfaces.size());
+  for (size_t i = 0; i < surfaces.size(); i++) {
+    const Surface& surf = surfaces[i];
+    XMStoreFloat3(&centroids[i], (XMLoadFloat3(&surf.v1) + XMLoadFloat3(&surf.v2) + XMLoadFloat3(&surf.v3)) / 3.f);
+  }
+
+  // median splits, the depth is log2 of the leaf count
+  nodes.reserve(2 * DivRoundUp(surfaces.size(), leafSize));
+  BuildNode(*this, surfaces, centroids, leafSize, 0, static_cast<uint32_t>(surfaces.size()));
+  assert(surfaces.size() < (size_t(1) << (MAX_DEPTH / 2)));
+
+  // a leaf of at most leafSize surfaces fits a block of that many lanes, the rest of the block is UINT32_MAX
+  std::vector<uint32_t> aligned;
+  aligned.reserve(nodes.size() * leafSize);
+  for (Node& node : nodes) {
+    if (node.count == 0) continue;
+
+    uint32_t first = static_cast<uint32_t>(aligned.size());
+    aligned.insert(aligned.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+    aligned.resize(first + leafSize, UINT32_MAX);
+    node.first = first;
+  }
+  indices = std::move(aligned);
+}
+
+void SurfaceBlock::Build(std::span<const Surface> surfaces, const SurfaceBvh& bvh, std::vector<SurfaceBlock>& blocks)
+{
+  assert(bvh.indices.size() % SIZE == 0);
+
+  blocks.assign(bvh.indices.size() / SIZE, {});
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+    SurfaceBlock& block = blocks[b];
+
+    for (uint32_t lane = 0; lane < SIZE; lane++) {
+      uint32_t index = bvh.indices[b * SIZE + lane];
+      if (index == UINT32_MAX) continue;
+
+      const Surface& surf = surfaces[index];
+      XMVECTOR v1 = XMLoadFloat3(&surf.v1);
+      XMFLOAT3 normal;
+      XMStoreFloat3(&normal, XMVector3Cross(XMLoadFloat3(&surf.v2) - v1, XMLoadFloat3(&surf.v3) - v1));
+
+      for (int axis = 0; axis < 3; axis++) {
+        block.v1[axis][lane] = (&surf.v1.x)[axis];
+        block.v2[axis][lane] = (&surf.v2.x)[axis];
+        block.v3[axis][lane] = (&surf.v3.x)[axis];
+        block.normal[axis][lane] = (&normal.x)[axis];
       }
     }
   }
 }
 
-float Surface::HeightAt(float x, float z)
+float Surface::HeightAt(float x, float z) const
 {
   return -(x * normal.x + z * normal.z + originOffset) / normal.y;
 }
 
-bool Surface::WithinBound(float x, float z)
+bool Surface::WithinBound(float x, float z) const
 {
   if ((v1.z - z) * (v2.x - v1.x) - (v1.x - x) * (v2.z - v1.z) < 0) return false;
   if ((v2.z - z) * (v3.x - v2.x) - (v2.x - x) * (v3.z - v2.z) < 0) return false;
@@ -102,15 +271,542 @@ bool Surface::WithinBound(float x, float z)
   return true;
 }
 
-Surface* Collider::FindFloor(DirectX::XMFLOAT3 point, float offsetY,
-                             float& prevHeight)
+// what the surface was in the world space collider: transformed vertices, then the normal and bounds of those
+static Surface TransformSurface(const Surface& local, FXMMATRIX world)
+{
+  Surface surf;
+
+  XMVECTOR xmv1 = XMVector4Transform(XMVectorSet(local.v1.x, local.v1.y, local.v1.z, 1.0f), world);
+  XMVECTOR xmv2 = XMVector4Transform(XMVectorSet(local.v2.x, local.v2.y, local.v2.z, 1.0f), world);
+  XMVECTOR xmv3 = XMVector4Transform(XMVectorSet(local.v3.x, local.v3.y, local.v3.z, 1.0f), world);
+  XMStoreFloat3(&surf.v1, xmv1);
+  XMStoreFloat3(&surf.v2, xmv2);
+  XMStoreFloat3(&surf.v3, xmv3);
+
+  XMVECTOR normal = XMVector3Normalize(XMVector3Cross(xmv2 - xmv1, xmv3 - xmv1));
+  XMStoreFloat3(&surf.normal, normal);
+  XMStoreFloat(&surf.originOffset, -XMVector3Dot(normal, xmv1));
+
+  surf.minY = std::min({surf.v1.y, surf.v2.y, surf.v3.y});
+  surf.maxY = std::max({surf.v1.y, surf.v2.y, surf.v3.y});
+
+  return surf;
+}
+
+Surface Collider::ToWorld(const Surface* surface) const
+{
+  for (const auto& node : m_ColliderNodes) {
+    if (surface < node.surfaces.data() || surface >= node.surfaces.data() + node.surfaces.size()) continue;
+
+    return TransformSurface(*surface, XMLoadFloat4x4(&node.world));
+  }
+
+  assert(false && "surface of another collider");
+  return *surface;
+}
+
+size_t Collider::NumSurfaces() const
+{
+  size_t count = 0;
+  for (const auto& node : m_ColliderNodes) {
+    count += node.surfaces.size();
+  }
+
+  return count;
+}
+
+enum class SurfaceKind { Floor, Wall };
+
+// Rays from one origin in the space of a model, one per lane. Lanes past the rays have a negative best distance
+// and never hit a box. Distances are along the world directions, the model ones are not normalized
+struct RayPacket {
+  XMFLOAT3 origin;
+  float worldY;  // of the origin, for the heights walls are tested at
+  size_t numRays;
+  std::array<XMFLOAT3, MAX_PACKET_SIZE> directions;
+  alignas(32) float invDirection[3][MAX_PACKET_SIZE];
+  alignas(32) float bestDistance[MAX_PACKET_SIZE];
+  std::array<uint32_t, MAX_PACKET_SIZE> best;  // surface index, UINT32_MAX until a hit in this model
+};
+
+// Brings world rays in the space of a model, bestDistances are the closest hits found in the other models
+static void PreparePacket(RayPacket& packet, FXMMATRIX invWorld, XMVECTOR origin, std::span<const XMFLOAT3> directions,
+                          std::span<const float> bestDistances)
+{
+  assert(directions.size() <= MAX_PACKET_SIZE);
+
+  packet.numRays = directions.size();
+  packet.worldY = XMVectorGetY(origin);
+  XMStoreFloat3(&packet.origin, XMVector3Transform(origin, invWorld));
+
+  std::fill(std::begin(packet.bestDistance), std::end(packet.bestDistance), -1.f);
+  packet.best.fill(UINT32_MAX);
+
+  for (size_t r = 0; r < MAX_PACKET_SIZE; r++) {
+    if (r < packet.numRays) {
+      XMStoreFloat3(&packet.directions[r], XMVector3TransformNormal(XMLoadFloat3(&directions[r]), invWorld));
+      packet.bestDistance[r] = bestDistances[r];
+    } else {
+      packet.directions[r] = {1.f, 1.f, 1.f};
+    }
+
+    // no infinity times zero in the slabs of an axis the ray is parallel to
+    const float* d = &packet.directions[r].x;
+    for (int axis = 0; axis < 3; axis++) {
+      packet.invDirection[axis][r] = 1.f / (std::abs(d[axis]) < 1e-30f ? std::copysign(1e-30f, d[axis]) : d[axis]);
+    }
+  }
+}
+
+// rays of the mask that enter the box before their best distance so far, slab test on all lanes at once
+static uint32_t IntersectsBox(const SurfaceBvh::Node& node, const RayPacket& packet, uint32_t rays)
+{
+  uint32_t hits = 0;
+
+  for (uint32_t i = 0; i < MAX_PACKET_SIZE && (rays >> i) != 0; i += Lanes::WIDTH) {
+    Lanes tMin = Lanes::Set(0.f);
+    Lanes tMax = Lanes::Load(&packet.bestDistance[i]);
+
+    for (int axis = 0; axis < 3; axis++) {
+      float o = (&packet.origin.x)[axis];
+      Lanes inv = Lanes::Load(&packet.invDirection[axis][i]);
+      Lanes t1 = Lanes::Set((&node.min.x)[axis] - o) * inv;
+      Lanes t2 = Lanes::Set((&node.max.x)[axis] - o) * inv;
+
+      tMin = Max(tMin, Min(t1, t2));
+      tMax = Min(tMax, Max(t1, t2));
+    }
+
+    hits |= (tMin <= tMax).Mask() << i;
+  }
+
+  return hits & rays;
+}
+
+// Möller-Trumbore of one ray against the candidate lanes of a block, the tests of TriangleTests::Intersects:
+// two sided, no hit when the ray is within RAY_EPSILON of parallel. Returns a bit per lane hit, and their distances
+static uint32_t IntersectBlock(const SurfaceBlock& block, uint32_t candidates, const XMFLOAT3& origin,
+                               const XMFLOAT3& direction, float* distances)
+{
+  const Lanes zero = Lanes::Set(0.f);
+  const Lanes epsilon = Lanes::Set(RAY_EPSILON), negEpsilon = Lanes::Set(-RAY_EPSILON);
+  const Lanes dx = Lanes::Set(direction.x), dy = Lanes::Set(direction.y), dz = Lanes::Set(direction.z);
+  const Lanes ox = Lanes::Set(origin.x), oy = Lanes::Set(origin.y), oz = Lanes::Set(origin.z);
+
+  uint32_t hits = 0;
+
+  for (uint32_t i = 0; i < SurfaceBlock::SIZE; i += Lanes::WIDTH) {
+    if (((candidates >> i) & LANE_BITS) == 0) continue;
+
+    Lanes v1x = Lanes::Load(&block.v1[0][i]), v1y = Lanes::Load(&block.v1[1][i]), v1z = Lanes::Load(&block.v1[2][i]);
+    Lanes e1x = Lanes::Load(&block.v2[0][i]) - v1x, e1y = Lanes::Load(&block.v2[1][i]) - v1y;
+    Lanes e1z = Lanes::Load(&block.v2[2][i]) - v1z;
+    Lanes e2x = Lanes::Load(&block.v3[0][i]) - v1x, e2y = Lanes::Load(&block.v3[1][i]) - v1y;
+    Lanes e2z = Lanes::Load(&block.v3[2][i]) - v1z;
+
+    // p = direction x e2
+    Lanes px = dy * e2z - dz * e2y;
+    Lanes py = dz * e2x - dx * e2z;
+    Lanes pz = dx * e2y - dy * e2x;
+    Lanes det = e1x * px + e1y * py + e1z * pz;
+
+    Lanes sx = ox - v1x;
+    Lanes sy = oy - v1y;
+    Lanes sz = oz - v1z;
+    Lanes u = sx * px + sy * py + sz * pz;
+
+    // q = s x e1
+    Lanes qx = sy * e1z - sz * e1y;
+    Lanes qy = sz * e1x - sx * e1z;
+    Lanes qz = sx * e1y - sy * e1x;
+    Lanes v = dx * qx + dy * qy + dz * qz;
+    Lanes t = e2x * qx + e2y * qy + e2z * qz;
+    Lanes uv = u + v;
+
+    // u, v and t are not divided by det yet, so the comparisons flip with its sign
+    Lanes front = (det >= epsilon) & (u >= zero) & (u <= det) & (v >= zero) & (uv <= det) & (t >= zero);
+    Lanes back = (det <= negEpsilon) & (u <= zero) & (u >= det) & (v <= zero) & (uv >= det) & (t <= zero);
+
+    uint32_t mask = (front | back).Mask();
+    if (mask == 0) continue;
+
+    (t / det).Store(distances + i);
+    hits |= mask << i;
+  }
+
+  return hits & candidates;
+}
+
+// The floors of a block under a ray, WithinBound and HeightAt on every lane: the vertices are sheared so that
+// the ray runs along an axis, then the edge functions around it tell whether it is inside, edges included like
+// in WithinBound, and weight the vertices into the distance. Returns a bit per lane hit, and their distances
+static uint32_t IntersectBlockEdges(const SurfaceBlock& block, uint32_t candidates, const XMFLOAT3& origin,
+                                    const XMFLOAT3& direction, float* distances)
+{
+  // the axis the ray is the most along, straight down for a model that is not tilted
+  const float* d = &direction.x;
+  const float* o = &origin.x;
+  const int k = std::abs(d[0]) > std::abs(d[1]) ? (std::abs(d[0]) > std::abs(d[2]) ? 0 : 2)
+                                                : (std::abs(d[1]) > std::abs(d[2]) ? 1 : 2);
+  const int kx = (k + 1) % 3, ky = (k + 2) % 3;
+
+  const Lanes zero = Lanes::Set(0.f);
+  const Lanes shearX = Lanes::Set(d[kx] / d[k]), shearY = Lanes::Set(d[ky] / d[k]);
+  const Lanes scale = Lanes::Set(1.f / d[k]);
+  const Lanes ox = Lanes::Set(o[kx]), oy = Lanes::Set(o[ky]), oz = Lanes::Set(o[k]);
+
+  uint32_t hits = 0;
+
+  for (uint32_t i = 0; i < SurfaceBlock::SIZE; i += Lanes::WIDTH) {
+    if (((candidates >> i) & LANE_BITS) == 0) continue;
+
+    // vertex relative to the origin, in the sheared frame
+    auto shear = [&](const float (*v)[SurfaceBlock::SIZE], Lanes& x, Lanes& y, Lanes& z) {
+      z = Lanes::Load(&v[k][i]) - oz;
+      x = Lanes::Load(&v[kx][i]) - ox - shearX * z;
+      y = Lanes::Load(&v[ky][i]) - oy - shearY * z;
+    };
+    Lanes ax, ay, az, bx, by, bz, cx, cy, cz;
+    shear(block.v1, ax, ay, az);
+    shear(block.v2, bx, by, bz);
+    shear(block.v3, cx, cy, cz);
+
+    // twice the areas of the triangles the ray makes with each edge, the barycentrics times det
+    Lanes u = cx * by - cy * bx;
+    Lanes v = ax * cy - ay * cx;
+    Lanes w = bx * ay - by * ax;
+    Lanes det = u + v + w;
+    Lanes t = (u * az + v * bz + w * cz) * scale;
+
+    // either winding, none when degenerate or behind the origin
+    Lanes front = (det > zero) & (u >= zero) & (v >= zero) & (w >= zero) & (t >= zero);
+    Lanes back = (det < zero) & (u <= zero) & (v <= zero) & (w <= zero) & (t <= zero);
+
+    uint32_t mask = (front | back).Mask();
+    if (mask == 0) continue;
+
+    (t / det).Store(distances + i);
+    hits |= mask << i;
+  }
+
+  return hits & candidates;
+}
+
+// Lanes of the block holding surfaces of that kind, where the model currently is: the slope of the world
+// normal decides between floors, walls and ceilings, and walls only count at the height of the ray
+static uint32_t Classify(const SurfaceBlock& block, SurfaceKind kind, const XMFLOAT4X4& world,
+                         const XMFLOAT3X3& cofactors, float worldY)
+{
+  const Lanes zero = Lanes::Set(0.f);
+  const Lanes slope = Lanes::Set(1.f / (WALL_SLOPE * WALL_SLOPE));
+  const Lanes y = Lanes::Set(worldY);
+
+  uint32_t lanes = 0;
+
+  for (uint32_t i = 0; i < SurfaceBlock::SIZE; i += Lanes::WIDTH) {
+    Lanes nx = Lanes::Load(&block.normal[0][i]), ny = Lanes::Load(&block.normal[1][i]);
+    Lanes nz = Lanes::Load(&block.normal[2][i]);
+
+    // world normal, up to its length
+    Lanes wx = nx * Lanes::Set(cofactors.m[0][0]) + ny * Lanes::Set(cofactors.m[1][0]) + nz * Lanes::Set(cofactors.m[2][0]);
+    Lanes wy = nx * Lanes::Set(cofactors.m[0][1]) + ny * Lanes::Set(cofactors.m[1][1]) + nz * Lanes::Set(cofactors.m[2][1]);
+    Lanes wz = nx * Lanes::Set(cofactors.m[0][2]) + ny * Lanes::Set(cofactors.m[1][2]) + nz * Lanes::Set(cofactors.m[2][2]);
+
+    // |wy| / |w| > WALL_SLOPE: floor or ceiling. Degenerate triangles are walls, like in the plain scan
+    Lanes yy = wy * wy * slope;
+    Lanes ww = wx * wx + wy * wy + wz * wz;
+
+    if (kind == SurfaceKind::Floor) {
+      lanes |= ((yy > ww) & (wy > zero)).Mask() << i;
+      continue;
+    }
+
+    // world heights of the vertices
+    auto height = [&](const float (*v)[SurfaceBlock::SIZE]) {
+      return Lanes::Load(&v[0][i]) * Lanes::Set(world.m[0][1]) + Lanes::Load(&v[1][i]) * Lanes::Set(world.m[1][1]) +
+             Lanes::Load(&v[2][i]) * Lanes::Set(world.m[2][1]);
+    };
+    const Lanes ty = Lanes::Set(world.m[3][1]);
+    Lanes y1 = height(block.v1) + ty;
+    Lanes y2 = height(block.v2) + ty;
+    Lanes y3 = height(block.v3) + ty;
+    Lanes band = (Min(y1, Min(y2, y3)) <= y) & (y <= Max(y1, Max(y2, y3)));
+
+    // padding lanes are degenerate walls too, IntersectBlock never hits them
+    lanes |= (band & (yy <= ww)).Mask() << i;
+  }
+
+  return lanes;
+}
+
+// Closest surfaces of that kind along the rays of the packet, ties to the first surface like in the plain scan
+static void CastRays(const SurfaceBvh& bvh, std::span<const SurfaceBlock> blocks, SurfaceKind kind,
+                     const XMFLOAT4X4& world, const XMFLOAT3X3& cofactors, RayPacket& packet)
+{
+  if (bvh.nodes.empty()) return;
+
+  const uint32_t allRays = packet.numRays == MAX_PACKET_SIZE ? ~0u : (1u << packet.numRays) - 1;
+  const auto intersect = kind == SurfaceKind::Floor ? IntersectBlockEdges : IntersectBlock;
+
+  alignas(32) float distances[SurfaceBlock::SIZE];
+
+  auto testBlock = [&](uint32_t blockIndex, uint32_t rays) {
+    const SurfaceBlock& block = blocks[blockIndex];
+    uint32_t candidates = Classify(block, kind, world, cofactors, packet.worldY);
+    if (candidates == 0) return;
+
+    for (uint32_t r = rays; r != 0; r &= r - 1) {
+      uint32_t ray = std::countr_zero(r);
+      float& bestDistance = packet.bestDistance[ray];
+      uint32_t& best = packet.best[ray];
+
+      for (uint32_t hits = intersect(block, candidates, packet.origin, packet.directions[ray], distances); hits != 0;
+           hits &= hits - 1) {
+        uint32_t lane = std::countr_zero(hits);
+        uint32_t index = bvh.indices[blockIndex * SurfaceBlock::SIZE + lane];
+        float distance = distances[lane];
+
+        if (distance < bestDistance || (distance == bestDistance && best != UINT32_MAX && index < best)) {
+          bestDistance = distance;
+          best = index;
+        }
+      }
+    }
+  };
+
+  // a few blocks are faster to scan than to walk to
+  if (blocks.size() <= BRUTE_FORCE_BLOCKS) {
+    if (IntersectsBox(bvh.nodes[0], packet, allRays) == 0) return;
+
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+      testBlock(b, allRays);
+    }
+    return;
+  }
+
+  // node, and rays that reached it
+  std::pair<uint32_t, uint32_t> stack[SurfaceBvh::MAX_DEPTH];
+  size_t top = 0;
+  stack[top++] = {0, allRays};
+
+  while (top > 0) {
+    auto [nodeIndex, rays] = stack[--top];
+    const SurfaceBvh::Node& node = bvh.nodes[nodeIndex];
+
+    uint32_t hitRays = IntersectsBox(node, packet, rays);
+    if (hitRays == 0) continue;
+
+    if (node.count == 0) {
+      // the child nearer along the first ray first
+      uint32_t left = nodeIndex + 1, right = node.first;
+      const XMFLOAT3& dir = packet.directions[std::countr_zero(hitRays)];
+      auto along = [&](const SurfaceBvh::Node& child) {
+        return (child.min.x + child.max.x) * dir.x + (child.min.y + child.max.y) * dir.y +
+               (child.min.z + child.max.z) * dir.z;
+      };
+      bool leftFirst = along(bvh.nodes[left]) <= along(bvh.nodes[right]);
+      stack[top++] = {leftFirst ? right : left, hitRays};
+      stack[top++] = {leftFirst ? left : right, hitRays};
+      continue;
+    }
+
+    testBlock(node.first / SurfaceBlock::SIZE, hitRays);
+  }
+}
+
+// A floor is the first one hit going down from the point, in every model
+Surface* Collider::FindFloor(XMFLOAT3 point, float offsetY, float& prevHeight)
+{
+  Surface* floor = nullptr;
+  float y = point.y + offsetY;
+  float distance = std::numeric_limits<float>::infinity();
+
+  const XMVECTOR origin = XMVectorSet(point.x, y, point.z, 1.f);
+  const XMFLOAT3 down = {0.f, -1.f, 0.f};
+
+  // earlier models win ties, like in the linear scan
+  for (auto& node : m_ColliderNodes) {
+    if (point.x < node.worldMin.x || point.x > node.worldMax.x || point.z < node.worldMin.z ||
+        point.z > node.worldMax.z || y < node.worldMin.y || y - node.worldMax.y > distance) {
+      continue;
+    }
+
+    RayPacket packet;
+    PreparePacket(packet, XMLoadFloat4x4(&node.invWorld), origin, {&down, 1}, {&distance, 1});
+    CastRays(node.bvh, node.blocks, SurfaceKind::Floor, node.world, node.cofactors, packet);
+
+    if (packet.best[0] != UINT32_MAX) {
+      distance = packet.bestDistance[0];
+      floor = &node.surfaces[packet.best[0]];
+    }
+  }
+
+  prevHeight = floor ? y - distance : -std::numeric_limits<float>::infinity();
+
+  return floor;
+}
+
+Surface* Collider::FindWall(XMVECTOR origin, XMVECTOR direction, float offsetY, float& distance)
+{
+  XMFLOAT3 d;
+  XMStoreFloat3(&d, direction);
+
+  Surface* wall;
+  FindWalls(origin, {&d, 1}, offsetY, {&wall, 1}, {&distance, 1});
+
+  return wall;
+}
+
+void Collider::FindWalls(XMVECTOR point, std::span<const XMFLOAT3> directions, float offsetY, std::span<Surface*> walls,
+                         std::span<float> distances)
+{
+  assert(walls.size() >= directions.size() && distances.size() >= directions.size());
+
+  const XMVECTOR origin = XMVectorSetW(point + XMVectorSet(0.0f, offsetY, 0.0f, 0.0f), 1.f);
+  const float y = XMVectorGetY(origin);
+
+  for (size_t first = 0; first < directions.size(); first += MAX_PACKET_SIZE) {
+    size_t count = std::min(MAX_PACKET_SIZE, directions.size() - first);
+    auto packetDirections = directions.subspan(first, count);
+    auto packetWalls = walls.subspan(first, count);
+    auto packetDistances = distances.subspan(first, count);
+
+    std::fill(packetWalls.begin(), packetWalls.end(), nullptr);
+    std::fill(packetDistances.begin(), packetDistances.end(), std::numeric_limits<float>::infinity());
+
+    // earlier models win ties, like in the linear scan
+    for (auto& node : m_ColliderNodes) {
+      if (y < node.worldMin.y || y > node.worldMax.y) continue;
+
+      RayPacket packet;
+      PreparePacket(packet, XMLoadFloat4x4(&node.invWorld), origin, packetDirections, packetDistances);
+      CastRays(node.bvh, node.blocks, SurfaceKind::Wall, node.world, node.cofactors, packet);
+
+      for (size_t r = 0; r < count; r++) {
+        if (packet.best[r] == UINT32_MAX) continue;
+
+        packetDistances[r] = packet.bestDistance[r];
+        packetWalls[r] = &node.surfaces[packet.best[r]];
+      }
+    }
+  }
+}
+
+void Collider::UpdatePose(const Model3D* m, const Skin* skin, std::span<const XMFLOAT4X4> boneMatrices)
+{
+  auto it = m_Proxies.find(m);
+  if (it == m_Proxies.end()) return;
+
+  for (auto& [mesh, proxies] : it->second) {
+    if (mesh->skin.get() != skin) continue;
+
+    proxies.Update(boneMatrices, mesh->LocalTransformMatrix() * m->WorldMatrix());
+  }
+}
+
+bool Collider::FindProxy(XMVECTOR point, XMVECTOR direction, float offsetY, ProxyHit& hit) const
+{
+  const XMVECTOR origin = point + XMVectorSet(0.0f, offsetY, 0.0f, 0.0f);
+  hit.distance = std::numeric_limits<float>::infinity();
+  hit.model = nullptr;
+
+  for (const auto& [model, meshes] : m_Proxies) {
+    for (const auto& [mesh, proxies] : meshes) {
+      float distance;
+      int capsule = proxies.Intersect(origin, direction, distance);
+      if (capsule < 0 || distance >= hit.distance) continue;
+
+      hit = {model, mesh, proxies.Joint(capsule), distance};
+    }
+  }
+
+  return hit.model != nullptr;
+}
+
+size_t Collider::NumProxies() const
+{
+  size_t count = 0;
+  for (const auto& [model, meshes] : m_Proxies) {
+    for (const auto& [mesh, proxies] : meshes) {
+      count += proxies.NumCapsules();
+    }
+  }
+
+  return count;
+}
+
+// the bits of two 16 bit coordinates interleaved
+static uint32_t ZOrder(uint32_t x, uint32_t z)
+{
+  auto spread = [](uint32_t v) {
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+
+  return spread(x) | (spread(z) << 1);
+}
+
+void Collider::FindBatch(std::span<const ColliderQuery> queries, std::span<ColliderHit> hits)
+{
+  assert(hits.size() >= queries.size());
+  assert(queries.size() <= UINT32_MAX);
+
+  float minX = std::numeric_limits<float>::infinity(), maxX = -minX;
+  float minZ = minX, maxZ = -minX;
+  for (const auto& q : queries) {
+    minX = std::min(minX, q.point.x);
+    maxX = std::max(maxX, q.point.x);
+    minZ = std::min(minZ, q.point.z);
+    maxZ = std::max(maxZ, q.point.z);
+  }
+
+  // the same scale on both axes keeps the cells of the curve square
+  const float scale = 65535.f / std::max({maxX - minX, maxZ - minZ, 1e-6f});
+
+  m_BatchOrder.resize(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) {
+    uint32_t x = static_cast<uint32_t>((queries[i].point.x - minX) * scale);
+    uint32_t z = static_cast<uint32_t>((queries[i].point.z - minZ) * scale);
+    m_BatchOrder[i] = static_cast<uint64_t>(ZOrder(x, z)) << 32 | i;
+  }
+  std::sort(m_BatchOrder.begin(), m_BatchOrder.end());
+
+  // every query writes its own hit, the results do not depend on the schedule
+  Jobs::ParallelForChunks(queries.size(), BATCH_GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const uint32_t index = static_cast<uint32_t>(m_BatchOrder[i]);
+      const ColliderQuery& q = queries[index];
+      ColliderHit& hit = hits[index];
+
+      hit.floor = FindFloor(q.point, q.floorOffsetY, hit.floorHeight);
+
+      if (q.direction.x == 0.f && q.direction.y == 0.f && q.direction.z == 0.f) {
+        hit.wall = nullptr;
+        hit.wallDistance = std::numeric_limits<float>::infinity();
+      } else {
+        hit.wall = FindWall(XMLoadFloat3(&q.point), XMLoadFloat3(&q.direction), q.wallOffsetY, hit.wallDistance);
+      }
+    }
+  });
+}
+
+Surface* Collider::FindFloorLinear(DirectX::XMFLOAT3 point, float offsetY,
+                                   float& prevHeight)
 {
   Surface* floor = nullptr;
   prevHeight = -std::numeric_limits<float>::infinity();
   float y = point.y + offsetY;
 
   for (auto& node : m_ColliderNodes) {
-    for (auto& surf : node.floors) {
+    XMMATRIX world = XMLoadFloat4x4(&node.world);
+
+    for (auto& local : node.surfaces) {
+      Surface surf = TransformSurface(local, world);
+      if (!(surf.normal.y > WALL_SLOPE)) continue;
+
       // skip floors above point
       if (y < surf.minY) continue;
 
@@ -125,15 +821,15 @@ Surface* Collider::FindFloor(DirectX::XMFLOAT3 point, float offsetY,
       if (y < height) continue;
 
       prevHeight = height;
-      floor = &surf;
+      floor = &local;
     }
   }
 
   return floor;
 }
 
-Surface* Collider::FindWall(XMVECTOR origin, XMVECTOR direction, float offsetY,
-                            float& distance)
+Surface* Collider::FindWallLinear(XMVECTOR origin, XMVECTOR direction, float offsetY,
+                                  float& distance)
 {
   Surface* wall = nullptr;
   XMVECTOR offset = XMVectorSet(0.0f, offsetY, 0.0f, 0.0f);
@@ -143,7 +839,12 @@ Surface* Collider::FindWall(XMVECTOR origin, XMVECTOR direction, float offsetY,
   float hitDistance;
 
   for (auto& node : m_ColliderNodes) {
-    for (auto& surf : node.walls) {
+    XMMATRIX world = XMLoadFloat4x4(&node.world);
+
+    for (auto& local : node.surfaces) {
+      Surface surf = TransformSurface(local, world);
+      if (surf.normal.y > WALL_SLOPE || surf.normal.y < -WALL_SLOPE) continue;
+
       if (XMVectorGetY(origin) < surf.minY || XMVectorGetY(origin) > surf.maxY)
         continue;
 
@@ -157,7 +858,7 @@ Surface* Collider::FindWall(XMVECTOR origin, XMVECTOR direction, float offsetY,
 
       if (hitDistance < distance) {
         distance = hitDistance;
-        wall = &surf;
+        wall = &local;
       }
     }
   }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "BoneProxies.h"
 #include "Mesh.h"
 
+// A triangle of a collider model. In the space of the model, except for surfaces given by Collider::ToWorld
 struct Surface {
   DirectX::XMFLOAT3 v1;
   DirectX::XMFLOAT3 v2;
@@ -12,37 +14,138 @@ struct Surface {
   float maxY;
   float originOffset;
 
-  float HeightAt(float x, float z);
-  bool WithinBound(float x, float z);
+  float HeightAt(float x, float z) const;
+  bool WithinBound(float x, float z) const;
 };
 
+// Bounding volume hierarchy over the surfaces of a ColliderNode, median splits along the longest axis.
+// Boxes are padded a little so that rounding never culls a surface the plain scan would find
+struct SurfaceBvh {
+  struct Node {
+    DirectX::XMFLOAT3 min;
+    DirectX::XMFLOAT3 max;
+    uint32_t first;  // leaf: first entry of indices, inner node: right child, the left one comes next
+    uint32_t count;  // surfaces of a leaf, 0 for inner nodes
+  };
+
+  static constexpr size_t MAX_DEPTH = 64;
+
+  std::vector<Node> nodes;        // depth first, root first. Empty when there are no surfaces
+  std::vector<uint32_t> indices;  // into the surfaces, leaves own ranges of it starting at multiples of leafSize
+
+  void Build(std::span<const Surface> surfaces, uint32_t leafSize);
+};
+
+// The surfaces of one BVH leaf as a struct of arrays, for the ray tests of every lane at once.
+// Whether a surface is a floor, a wall or a ceiling depends on how its model is turned, so it is decided
+// per query from the normal. Lanes past the surfaces of the leaf are zero and never hit
+struct alignas(32) SurfaceBlock {
+  static constexpr uint32_t SIZE = 8;
+
+  float v1[3][SIZE];  // x, y and z rows
+  float v2[3][SIZE];
+  float v3[3][SIZE];
+  float normal[3][SIZE];  // (v2 - v1) x (v3 - v1), not normalized
+
+  static void Build(std::span<const Surface> surfaces, const SurfaceBvh& bvh, std::vector<SurfaceBlock>& blocks);
+};
+
+// One agent's queries of a frame for Collider::FindBatch, FindFloor and FindWall from the same point
+struct ColliderQuery {
+  DirectX::XMFLOAT3 point;
+  DirectX::XMFLOAT3 direction;  // of the wall probe, unit length. Zero for the floor only
+  float floorOffsetY;
+  float wallOffsetY;
+};
+
+struct ColliderHit {
+  Surface* floor;  // null when there is none, like in FindFloor and FindWall
+  float floorHeight;
+  Surface* wall;
+  float wallDistance;
+};
+
+// A bone proxy of an animated model hit by a ray, see Collider::FindProxy
+struct ProxyHit {
+  const Model3D* model;
+  const Mesh3D* mesh;
+  uint32_t joint;  // of the skin of the mesh
+  float distance;
+};
+
+// Floor and wall queries against the static and moving models of the scene.
+// Surfaces are kept in the space of their model and queries are brought into it, so moving a model only
+// changes its transform. Skinned meshes are not triangles here but bone proxies that follow their pose
 class Collider
 {
 public:
   Collider();
+  ~Collider();
+
+  Collider(const Collider&) = delete;
+  Collider& operator=(const Collider&) = delete;
+
+  // the surfaces of the static meshes of the model, and bone proxies fitted to its skinned ones
   void AppendModel(Model3D* m);
+
+  // highest floor below point.y + offsetY, and its height. Null when there is none
   Surface* FindFloor(DirectX::XMFLOAT3 point, float offsetY, float& prevHeight);
+  // closest wall hit by the ray from point + offsetY along direction (unit length), and its distance
   Surface* FindWall(DirectX::XMVECTOR point, DirectX::XMVECTOR direction,
                     float offsetY, float& distance);
+  // FindWall along several directions from the same point, the way a character probes around itself.
+  // The hierarchy is walked once for the whole packet. walls and distances get one entry per direction
+  void FindWalls(DirectX::XMVECTOR point, std::span<const DirectX::XMFLOAT3> directions, float offsetY,
+                 std::span<Surface*> walls, std::span<float> distances);
+
+  // FindFloor and FindWall for every query, spread over the job workers: hits[i] answers queries[i].
+  // Queries are sorted along a z-order curve first, so that neighbours walk the same parts of the hierarchies.
+  // The collider is only read meanwhile: no model may be appended or refreshed until it returns
+  void FindBatch(std::span<const ColliderQuery> queries, std::span<ColliderHit> hits);
+
+  // every surface moved to the world and tested in turn, the plain versions to compare against
+  Surface* FindFloorLinear(DirectX::XMFLOAT3 point, float offsetY, float& prevHeight);
+  Surface* FindWallLinear(DirectX::XMVECTOR point, DirectX::XMVECTOR direction, float offsetY, float& distance);
 
+  // a surface returned by a query, where its model currently puts it
+  Surface ToWorld(const Surface* surface) const;
+
+  // picks up the new transform of the models that moved, whatever their number of triangles
   void RefreshDynamicModels();
 
+  // moves the proxies of the meshes of the model skinned by skin, and picks up where the model is.
+  // boneMatrices are the ones of the frame, as given to the skinning
+  void UpdatePose(const Model3D* m, const Skin* skin, std::span<const DirectX::XMFLOAT4X4> boneMatrices);
+
+  // closest bone proxy hit by the ray from point + offsetY along direction (unit length), one test per
+  // joint of the models the ray gets close to. False when there is none
+  bool FindProxy(DirectX::XMVECTOR point, DirectX::XMVECTOR direction, float offsetY, ProxyHit& hit) const;
+
+  size_t NumSurfaces() const;
+  size_t NumProxies() const;
+
 private:
   struct ColliderNode {
-    std::list<Surface> floors;
-    std::list<Surface> walls;
-    std::list<Surface> ceilings;
+    std::vector<Surface> surfaces;  // model space, floors, walls and ceilings alike
+    SurfaceBvh bvh;
+    std::vector<SurfaceBlock> blocks;  // one per leaf of bvh, in the order of its indices
+
+    // where the model is
+    DirectX::XMFLOAT4X4 world;
+    DirectX::XMFLOAT4X4 invWorld;
+    DirectX::XMFLOAT3X3 cofactors;  // model space normals to world space ones, up to their length
+    DirectX::XMFLOAT3 worldMin;     // bounds of the surfaces
+    DirectX::XMFLOAT3 worldMax;
 
     Model3D* model = nullptr;
 
     void CreateSurfacesFromModel();
-    void Clear()
-    {
-      floors.clear();
-      walls.clear();
-      ceilings.clear();
-    }
+    void SetTransform(DirectX::FXMMATRIX transform);
   };
 
   std::list<ColliderNode> m_ColliderNodes;
+  std::vector<uint64_t> m_BatchOrder;  // z-order key and index of the queries of FindBatch, kept between frames
+
+  // per model with skinned meshes, the proxies of each of them
+  std::unordered_map<const Model3D*, std::vector<std::pair<const Mesh3D*, BoneProxies>>> m_Proxies;
 };
@@ -14,6 +14,13 @@ static std::vector<Model3D> knights;
 
 static Camera camera;
 
+// streaming priority, closest meshes first
+static float DistanceToCamera(const XMFLOAT3& center)
+{
+  XMFLOAT3 eye = camera.WorldPos();
+  return XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&center), XMLoadFloat3(&eye))));
+}
+
 void Game::Init()
 {
   Renderer::SetSceneCamera(&camera);
@@ -38,11 +45,11 @@ void Game::Init()
       .Rotate(-XM_PIDIV2, XM_PIDIV2, 0.0f);
   Renderer::AppendToScene(&brainstem);
 #elif defined(SPONZA)
-  sponza.Read("OPTIM_Sponza.mdl").Scale(5.f).Rotate(0.f, XM_PIDIV2, 0.f);
+  sponza.Scale(5.f).Rotate(0.f, XM_PIDIV2, 0.f).Stream("OPTIM_Sponza.mdl", DistanceToCamera, Renderer::AppendMesh);
   Renderer::AppendToScene(&sponza);
 #elif defined(BISTRO)
 
-  sponza.Read("Bistro.mdl").Rotate(XM_PIDIV2, 0.0f, 0.0f).Scale(0.05f);
+  sponza.Rotate(XM_PIDIV2, 0.0f, 0.0f).Scale(0.05f).Stream("Bistro.mdl", DistanceToCamera, Renderer::AppendMesh);
   Renderer::AppendToScene(&sponza);
 #else
   Model3D baseTree;
@@ -63,7 +70,7 @@ void Game::Init()
   yuka.Read("OPTIM_yuka.mdl").Scale(5.f).Translate(15.f, 0.f, 15.f);
   Renderer::AppendToScene(&yuka);
 
-  terrain.Read("OPTIM_ground.mdl");
+  terrain.Stream("OPTIM_ground.mdl", DistanceToCamera, Renderer::AppendMesh);
   Renderer::AppendToScene(&terrain);
 
   cube.Read("OPTIM_issou.mdl").Translate(0.f, 50.f, 0.f).Scale(5.f);
@@ -72,7 +79,7 @@ void Game::Init()
   gardenGnome.Read("OPTIM_garden_gnome_1k.mdl").Scale(5.0f);
   Renderer::AppendToScene(&gardenGnome);
 
-  sponza.Read("OPTIM_Sponza.mdl").Translate(-150.f, 5.f, -150.f).Scale(5.f);
+  sponza.Translate(-150.f, 5.f, -150.f).Scale(5.f).Stream("OPTIM_Sponza.mdl", DistanceToCamera, Renderer::AppendMesh);
   Renderer::AppendToScene(&sponza);
 
   brainstem.Read("OPTIM_BrainStem.mdl")
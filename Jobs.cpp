@@ -0,0 +1,163 @@
+#include "stdafx_assets.h"
+
+#include "Jobs.h"
+
+namespace Jobs
+{
+// Items of one ParallelFor call. It lives on the stack of the caller, which does not return before every
+// helper that picked it up is done with it
+struct Batch {
+  const std::function<void(size_t)>* fn;
+  size_t count;
+  std::atomic<size_t> next = 0;
+  std::atomic<size_t> remaining;
+  size_t numHelpers = 0;  // threads running it besides the caller, guarded by g_Mutex
+  std::mutex errorMutex;
+  std::exception_ptr error;
+};
+
+static std::vector<std::thread> g_Workers;
+static std::vector<Batch*> g_Queue;  // one entry per helper wanted, kept small so it never reallocates once warm
+static std::mutex g_Mutex;
+static std::condition_variable g_WakeUp;
+static std::condition_variable g_HelperDone;
+static bool g_Stop = false;
+
+static void Run(Batch& batch)
+{
+  for (size_t i; (i = batch.next.fetch_add(1)) < batch.count;) {
+    try {
+      (*batch.fn)(i);
+    } catch (...) {
+      std::lock_guard lock(batch.errorMutex);
+      if (!batch.error) batch.error = std::current_exception();
+    }
+
+    if (batch.remaining.fetch_sub(1) == 1) {
+      batch.remaining.notify_all();
+    }
+  }
+}
+
+// lock is held on entry and on return
+static void RunAsHelper(Batch& batch, std::unique_lock<std::mutex>& lock)
+{
+  batch.numHelpers++;
+  lock.unlock();
+
+  Run(batch);
+
+  lock.lock();
+  if (--batch.numHelpers == 0) g_HelperDone.notify_all();
+}
+
+static bool RunPendingJob()
+{
+  std::unique_lock lock(g_Mutex);
+  if (g_Queue.empty()) return false;
+
+  Batch* batch = g_Queue.front();
+  g_Queue.erase(g_Queue.begin());
+
+  RunAsHelper(*batch, lock);
+
+  return true;
+}
+
+static void WorkerLoop()
+{
+  std::unique_lock lock(g_Mutex);
+
+  for (;;) {
+    g_WakeUp.wait(lock, [] { return g_Stop || !g_Queue.empty(); });
+
+    if (g_Stop && g_Queue.empty()) return;
+
+    Batch* batch = g_Queue.front();
+    g_Queue.erase(g_Queue.begin());
+
+    RunAsHelper(*batch, lock);
+  }
+}
+
+void Init(size_t numWorkers)
+{
+  assert(g_Workers.empty());
+
+  g_Stop = false;
+  g_Queue.reserve(numWorkers * 4);
+  g_Workers.reserve(numWorkers);
+  for (size_t i = 0; i < numWorkers; i++) {
+    g_Workers.emplace_back(WorkerLoop);
+  }
+}
+
+void Shutdown()
+{
+  {
+    std::lock_guard lock(g_Mutex);
+    g_Stop = true;
+  }
+  g_WakeUp.notify_all();
+
+  for (auto& worker : g_Workers) {
+    worker.join();
+  }
+  g_Workers.clear();
+}
+
+size_t NumWorkers() { return g_Workers.size(); }
+
+void ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if (g_Workers.empty() || count <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  Batch batch{&fn, count};
+  batch.remaining = count;
+
+  size_t numHelpers = std::min(g_Workers.size(), count - 1);
+
+  {
+    std::lock_guard lock(g_Mutex);
+    g_Queue.insert(g_Queue.end(), numHelpers, &batch);
+  }
+  g_WakeUp.notify_all();
+
+  Run(batch);
+
+  // help with whatever is queued while the last items finish
+  for (size_t remaining; (remaining = batch.remaining.load()) > 0;) {
+    if (!RunPendingJob()) batch.remaining.wait(remaining);
+  }
+
+  // helpers that did not start have nothing left to do, the ones that did may still be leaving Run
+  {
+    std::unique_lock lock(g_Mutex);
+    std::erase(g_Queue, &batch);
+    g_HelperDone.wait(lock, [&batch] { return batch.numHelpers == 0; });
+  }
+
+  if (batch.error) std::rethrow_exception(batch.error);
+}
+
+void ParallelForChunks(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+  assert(grain > 0);
+
+  // a single capture, small enough for std::function to store in place
+  struct Chunks {
+    size_t count, grain;
+    const std::function<void(size_t, size_t)>& fn;
+  } chunks{count, grain, fn};
+
+  ParallelFor(DivRoundUp(count, grain), [&chunks](size_t chunk) {
+    size_t begin = chunk * chunks.grain;
+    chunks.fn(begin, std::min(begin + chunks.grain, chunks.count));
+  });
+}
+}  // namespace Jobs
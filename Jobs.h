@@ -0,0 +1,20 @@
+#pragma once
+
+// Worker pool shared by the loaders and the per-frame update.
+// Jobs::Init must be called before any other function; without workers everything runs on the calling thread.
+namespace Jobs
+{
+void Init(size_t numWorkers);
+void Shutdown();
+
+size_t NumWorkers();
+
+// Calls fn(i) for every i in [0, count) and returns once all of them are done.
+// The calling thread takes part in the work, so this can be nested from inside a job.
+// The first exception thrown by fn is rethrown here.
+void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+// Same, over chunks of up to grain consecutive items: fn(begin, end) for cheap items that would not pay for
+// a call each. Idle threads pick the next chunk, so uneven chunks still balance
+void ParallelForChunks(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+}  // namespace Jobs
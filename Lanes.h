@@ -0,0 +1,128 @@
+#pragma once
+
+#include <bit>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// One float per lane, for code that runs the same math on many items at once (instances, vertices).
+// The instruction set is picked at compile time, /arch:AVX2 (or -mavx2) gives 8 lanes.
+// Comparisons give masks, all bits set in the lanes where they hold, to combine with & and | and read with Mask
+#if defined(__AVX2__)
+struct Lanes {
+  static constexpr size_t WIDTH = 8;
+  static constexpr const char* NAME = "AVX2";
+
+  __m256 v;
+
+  static Lanes Load(const float* p) { return {_mm256_loadu_ps(p)}; }
+  static Lanes Set(float f) { return {_mm256_set1_ps(f)}; }
+  // lane i reads base[indices[i]]
+  static Lanes Gather(const float* base, const int32_t* indices)
+  {
+    return {_mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices)), 4)};
+  }
+  void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+  Lanes operator+(Lanes b) const { return {_mm256_add_ps(v, b.v)}; }
+  Lanes operator-(Lanes b) const { return {_mm256_sub_ps(v, b.v)}; }
+  Lanes operator*(Lanes b) const { return {_mm256_mul_ps(v, b.v)}; }
+  Lanes operator/(Lanes b) const { return {_mm256_div_ps(v, b.v)}; }
+
+  Lanes operator<(Lanes b) const { return {_mm256_cmp_ps(v, b.v, _CMP_LT_OQ)}; }
+  Lanes operator<=(Lanes b) const { return {_mm256_cmp_ps(v, b.v, _CMP_LE_OQ)}; }
+  Lanes operator>(Lanes b) const { return {_mm256_cmp_ps(v, b.v, _CMP_GT_OQ)}; }
+  Lanes operator>=(Lanes b) const { return {_mm256_cmp_ps(v, b.v, _CMP_GE_OQ)}; }
+  Lanes operator&(Lanes b) const { return {_mm256_and_ps(v, b.v)}; }
+  Lanes operator|(Lanes b) const { return {_mm256_or_ps(v, b.v)}; }
+
+  // bit i set when the sign bit of lane i is, as it is in the lanes where a comparison holds
+  uint32_t Mask() const { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+
+  friend Lanes Min(Lanes a, Lanes b) { return {_mm256_min_ps(a.v, b.v)}; }
+  friend Lanes Max(Lanes a, Lanes b) { return {_mm256_max_ps(a.v, b.v)}; }
+  friend Lanes Sqrt(Lanes a) { return {_mm256_sqrt_ps(a.v)}; }
+  friend Lanes Abs(Lanes a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v)}; }
+  // magnitude of a, sign of b
+  friend Lanes CopySign(Lanes a, Lanes b)
+  {
+    __m256 sign = _mm256_set1_ps(-0.f);
+    return {_mm256_or_ps(_mm256_andnot_ps(sign, a.v), _mm256_and_ps(sign, b.v))};
+  }
+};
+#elif defined(_M_X64) || defined(__SSE2__)
+struct Lanes {
+  static constexpr size_t WIDTH = 4;
+  static constexpr const char* NAME = "SSE2";
+
+  __m128 v;
+
+  static Lanes Load(const float* p) { return {_mm_loadu_ps(p)}; }
+  static Lanes Set(float f) { return {_mm_set1_ps(f)}; }
+  static Lanes Gather(const float* base, const int32_t* indices)
+  {
+    return {_mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]])};
+  }
+  void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+  Lanes operator+(Lanes b) const { return {_mm_add_ps(v, b.v)}; }
+  Lanes operator-(Lanes b) const { return {_mm_sub_ps(v, b.v)}; }
+  Lanes operator*(Lanes b) const { return {_mm_mul_ps(v, b.v)}; }
+  Lanes operator/(Lanes b) const { return {_mm_div_ps(v, b.v)}; }
+
+  Lanes operator<(Lanes b) const { return {_mm_cmplt_ps(v, b.v)}; }
+  Lanes operator<=(Lanes b) const { return {_mm_cmple_ps(v, b.v)}; }
+  Lanes operator>(Lanes b) const { return {_mm_cmpgt_ps(v, b.v)}; }
+  Lanes operator>=(Lanes b) const { return {_mm_cmpge_ps(v, b.v)}; }
+  Lanes operator&(Lanes b) const { return {_mm_and_ps(v, b.v)}; }
+  Lanes operator|(Lanes b) const { return {_mm_or_ps(v, b.v)}; }
+
+  uint32_t Mask() const { return static_cast<uint32_t>(_mm_movemask_ps(v)); }
+
+  friend Lanes Min(Lanes a, Lanes b) { return {_mm_min_ps(a.v, b.v)}; }
+  friend Lanes Max(Lanes a, Lanes b) { return {_mm_max_ps(a.v, b.v)}; }
+  friend Lanes Sqrt(Lanes a) { return {_mm_sqrt_ps(a.v)}; }
+  friend Lanes Abs(Lanes a) { return {_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)}; }
+  friend Lanes CopySign(Lanes a, Lanes b)
+  {
+    __m128 sign = _mm_set1_ps(-0.f);
+    return {_mm_or_ps(_mm_andnot_ps(sign, a.v), _mm_and_ps(sign, b.v))};
+  }
+};
+#else
+struct Lanes {
+  static constexpr size_t WIDTH = 1;
+  static constexpr const char* NAME = "scalar";
+
+  float v;
+
+  static Lanes Load(const float* p) { return {*p}; }
+  static Lanes Set(float f) { return {f}; }
+  static Lanes Gather(const float* base, const int32_t* indices) { return {base[indices[0]]}; }
+  void Store(float* p) const { *p = v; }
+
+  Lanes operator+(Lanes b) const { return {v + b.v}; }
+  Lanes operator-(Lanes b) const { return {v - b.v}; }
+  Lanes operator*(Lanes b) const { return {v * b.v}; }
+  Lanes operator/(Lanes b) const { return {v / b.v}; }
+
+  static Lanes FromBool(bool b) { return {std::bit_cast<float>(b ? ~0u : 0u)}; }
+  static uint32_t Bits(Lanes a) { return std::bit_cast<uint32_t>(a.v); }
+
+  Lanes operator<(Lanes b) const { return FromBool(v < b.v); }
+  Lanes operator<=(Lanes b) const { return FromBool(v <= b.v); }
+  Lanes operator>(Lanes b) const { return FromBool(v > b.v); }
+  Lanes operator>=(Lanes b) const { return FromBool(v >= b.v); }
+  Lanes operator&(Lanes b) const { return {std::bit_cast<float>(Bits(*this) & Bits(b))}; }
+  Lanes operator|(Lanes b) const { return {std::bit_cast<float>(Bits(*this) | Bits(b))}; }
+
+  uint32_t Mask() const { return Bits(*this) >> 31; }
+
+  friend Lanes Min(Lanes a, Lanes b) { return {std::min(a.v, b.v)}; }
+  friend Lanes Max(Lanes a, Lanes b) { return {std::max(a.v, b.v)}; }
+  friend Lanes Sqrt(Lanes a) { return {std::sqrt(a.v)}; }
+  friend Lanes Abs(Lanes a) { return {std::abs(a.v)}; }
+  friend Lanes CopySign(Lanes a, Lanes b) { return {std::copysign(a.v, b.v)}; }
+};
+#endif
@@ -1,6 +1,9 @@
 #include "InteropD3D12.h"
 #include "IssouRHI.h"
 #include "Win32Application.h"
+#include "Jobs.h"
+#include "Streaming.h"
+#include "Renderer.h"
 #include "stdafx.h"
 
 #include <shellapi.h>
@@ -12,13 +15,17 @@ static void PrintHelp()
       "-h, --Help   Print this information\n"
       "-l, --List   Print list of GPUs\n"
       "-g S, --GPU S   Select GPU with name containing S\n"
-      "-i N, --GPUIndex N   Select GPU index N\n");
+      "-i N, --GPUIndex N   Select GPU index N\n"
+      "-j N, --Jobs N   Use N worker threads (default: one per core, minus the main thread)\n"
+      "-p, --PackVertices   Upload static meshes with quantized vertex streams\n");
 }
 
 struct CommandLineParameters {
   bool m_Help = false;
   bool m_List = false;
   IssouRHI::GPUSelection m_GPUSelection;
+  int m_NumWorkers = -1;
+  bool m_PackVertices = false;
 
   bool Parse(int argc, char** argv)
   {
@@ -31,6 +38,10 @@ struct CommandLineParameters {
         m_GPUSelection.substring = argv[++i];
       } else if ((_stricmp(argv[i], "-i") == 0 || _stricmp(argv[i], "--GPUIndex") == 0) && i + 1 < argc) {
         m_GPUSelection.index = atoi(argv[++i]);
+      } else if ((_stricmp(argv[i], "-j") == 0 || _stricmp(argv[i], "--Jobs") == 0) && i + 1 < argc) {
+        m_NumWorkers = atoi(argv[++i]);
+      } else if (_stricmp(argv[i], "-p") == 0 || _stricmp(argv[i], "--PackVertices") == 0) {
+        m_PackVertices = true;
       } else {
         return false;
       }
@@ -67,8 +78,18 @@ int main(int argc, char** argv)
     return (int)ExitCode::GPUList;
   }
 
+  int numWorkers = g_CommandLineParameters.m_NumWorkers;
+  if (numWorkers < 0) numWorkers = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+  Jobs::Init(numWorkers);
+  Streaming::Init(std::max(numWorkers, 1));
+
+  Renderer::SetPackVertexStreams(g_CommandLineParameters.m_PackVertices);
+
   auto device = IssouRHI::Device::CreateDevice(IssouRHI::Backend::D3D12, g_CommandLineParameters.m_GPUSelection);
   auto result = Win32Application::Run(GetModuleHandle(NULL), SW_SHOW, std::move(device));
 
+  Streaming::Shutdown();
+  Jobs::Shutdown();
+
   return result;
 }
@@ -0,0 +1,74 @@
+#include "stdafx_assets.h"
+
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& filename)
+{
+  m_File = CreateFileW(filename.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_File == INVALID_HANDLE_VALUE) return;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0) return;
+
+  m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_Mapping) return;
+
+  m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_Data) m_Size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_Data) UnmapViewOfFile(m_Data);
+  if (m_Mapping) CloseHandle(m_Mapping);
+  if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& filename)
+{
+  m_Fd = open(filename.c_str(), O_RDONLY);
+  if (m_Fd < 0) return;
+
+  struct stat st;
+  if (fstat(m_Fd, &st) != 0 || st.st_size == 0) return;
+
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_Fd, 0);
+  if (data == MAP_FAILED) return;
+
+  // streams are read front to back exactly once
+  madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+  m_Data = static_cast<const uint8_t*>(data);
+  m_Size = static_cast<size_t>(st.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_Data) munmap(const_cast<uint8_t*>(m_Data), m_Size);
+  if (m_Fd >= 0) close(m_Fd);
+}
+#endif
+
+std::filesystem::path TemporaryPath(const std::filesystem::path& filename)
+{
+#ifdef _WIN32
+  unsigned long process = GetCurrentProcessId();
+#else
+  unsigned long process = static_cast<unsigned long>(getpid());
+#endif
+  size_t thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+  std::filesystem::path tmpFilename = filename;
+  tmpFilename += "." + std::to_string(process) + "." + std::to_string(thread) + ".tmp";
+
+  return tmpFilename;
+}
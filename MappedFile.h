@@ -0,0 +1,74 @@
+#pragma once
+
+// Read-only view of a whole file mapped in memory.
+// Spans handed out by View/Take stay valid as long as the MappedFile is alive.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::filesystem::path& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool IsOpen() const { return m_Data != nullptr; }
+
+  const uint8_t* Data() const { return m_Data; }
+
+  size_t Size() const { return m_Size; }
+
+  template <typename T>
+  std::span<const T> View(size_t offset, size_t count) const
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    assert(offset + count * sizeof(T) <= m_Size);
+    assert(reinterpret_cast<uintptr_t>(m_Data + offset) % alignof(T) == 0);
+
+    return {reinterpret_cast<const T*>(m_Data + offset), count};
+  }
+
+  // Sequential reader, for formats that must be parsed in order
+  struct Cursor {
+    const MappedFile* file;
+    size_t offset = 0;
+
+    template <typename T>
+    std::span<const T> Take(size_t count)
+    {
+      auto view = file->View<T>(offset, count);
+      offset += count * sizeof(T);
+
+      return view;
+    }
+
+    template <typename T>
+    T Read()
+    {
+      T value;
+      assert(offset + sizeof(T) <= file->Size());
+      memcpy(&value, file->Data() + offset, sizeof(T));
+      offset += sizeof(T);
+
+      return value;
+    }
+  };
+
+  Cursor Begin() const { return {this, 0}; }
+
+private:
+  const uint8_t* m_Data = nullptr;
+  size_t m_Size = 0;
+
+#ifdef _WIN32
+  HANDLE m_File = INVALID_HANDLE_VALUE;
+  HANDLE m_Mapping = nullptr;
+#else
+  int m_Fd = -1;
+#endif
+};
+
+// Where to write filename in full before renaming it over the destination, so readers never see a partial file.
+// Next to it and unique to the calling process and thread: loaders caching the same source at once each write
+// their own, and the last rename wins
+std::filesystem::path TemporaryPath(const std::filesystem::path& filename);
@@ -1,7 +1,8 @@
-#include "stdafx.h"
+#include "stdafx_assets.h"
 
 #include "Mesh.h"
-#include "Renderer.h"
+#include "Jobs.h"
+#include "Streaming.h"
 
 using namespace DirectX;
 
@@ -9,254 +10,532 @@ static XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
 
 void Skin::Read(std::filesystem::path filename)
 {
-  FILE* fp;
-  fopen_s(&fp, filename.string().c_str(), "rb");
-  assert(fp);
+  MappedFile file(filename);
+  assert(file.IsOpen());
 
-  fread(&header, sizeof(header), 1, fp);
+  auto cursor = file.Begin();
 
-  // bone hierarchy
-  std::vector<int> childBones(header.numBones);
-  std::vector<int> parentBones(header.numBones);
+  header = cursor.Read<decltype(header)>();
 
-  fread(childBones.data(), sizeof(int), header.numBones, fp);
-  fread(parentBones.data(), sizeof(int), header.numBones, fp);
+  // bone hierarchy, as (child, parent) id pairs in no particular order
+  auto childBones = cursor.Take<int>(header.numBones);
+  auto parentBones = cursor.Take<int>(header.numBones);
 
-  for (int i = 0; i < header.numBones; i++) {
-    auto parent = parentBones[i];
-    if (parent < 0) continue;
-    boneHierarchy[parent].push_back(childBones[i]);
+  // breadth first from the root, so parents are placed before their children
+  {
+    std::unordered_map<int, std::vector<int>> children;
+    for (UINT i = 0; i < header.numBones; i++) {
+      if (parentBones[i] >= 0) children[parentBones[i]].push_back(childBones[i]);
+    }
+
+    boneIds.reserve(header.numBones);
+    parentIndices.reserve(header.numBones);
+
+    boneIds.push_back(header.rootBone);
+    parentIndices.push_back(-1);
+
+    for (size_t i = 0; i < boneIds.size(); i++) {
+      boneIndices[boneIds[i]] = static_cast<int>(i);
+
+      if (auto it = children.find(boneIds[i]); it != children.end()) {
+        for (int child : it->second) {
+          boneIds.push_back(child);
+          parentIndices.push_back(static_cast<int>(i));
+        }
+      }
+    }
+
+    assert(boneIds.size() == header.numBones);
   }
 
+  XMFLOAT4X4 identity;
+  XMStoreFloat4x4(&identity, XMMatrixIdentity());
+  restTransforms.assign(boneIds.size(), identity);
+
   // joints + inverse bind matrices
-  jointIndices.resize(header.numJoints);
-  inverseBindMatrices.resize(header.numJoints);
+  auto joints = cursor.Take<int>(header.numJoints);
+  auto matrices = cursor.Take<XMFLOAT4X4>(header.numJoints);
 
-  fread(jointIndices.data(), sizeof(int), header.numJoints, fp);
-  fread(inverseBindMatrices.data(), sizeof(XMFLOAT4X4), header.numJoints, fp);
+  jointBones.resize(header.numJoints);
+  for (UINT i = 0; i < header.numJoints; i++) {
+    jointBones[i] = BoneIndex(joints[i]);
+    assert(jointBones[i] >= 0);
+  }
+  inverseBindMatrices.assign(matrices.begin(), matrices.end());
 }
 
 void Skin::ReadStaticTransforms(std::filesystem::path filename)
 {
-  FILE* fp;
-  fopen_s(&fp, filename.string().c_str(), "rb");
-  assert(fp);
+  MappedFile file(filename);
+  assert(file.IsOpen());
 
-  UINT numBones;
-  fread(&numBones, sizeof(numBones), 1, fp);
+  auto cursor = file.Begin();
 
-  std::vector<int> boneIds(numBones);
-  fread(boneIds.data(), sizeof(int), numBones, fp);
+  UINT numBones = cursor.Read<UINT>();
+  auto fileBoneIds = cursor.Take<int>(numBones);
 
-  for (auto i : boneIds) {
-    struct {
+  // the file has the bones of every skin of the model
+  for (auto id : fileBoneIds) {
+    struct Transform {
       XMFLOAT3 scale;
       XMFLOAT3 translation;
       XMFLOAT4 rotation;
-    } transform;
+    };
+
+    auto transform = cursor.Read<Transform>();
 
-    fread(&transform, sizeof(transform), 1, fp);
+    int bone = BoneIndex(id);
+    if (bone < 0) continue;
 
     XMVECTOR scale = XMLoadFloat3(&transform.scale);
     XMVECTOR trans = XMLoadFloat3(&transform.translation);
     XMVECTOR rot = XMLoadFloat4(&transform.rotation);
 
     auto issou = XMMatrixAffineTransformation(scale, zero, rot, trans);
-    XMStoreFloat4x4(&staticTransforms[i], issou);
+    XMStoreFloat4x4(&restTransforms[bone], issou);
   }
 }
 
 void Animation::Read(std::filesystem::path filename)
 {
-  FILE* fp;
-  fopen_s(&fp, filename.string().c_str(), "rb");
-  assert(fp);
+  MappedFile file(filename);
+  assert(file.IsOpen());
+
+  auto cursor = file.Begin();
 
-  UINT numAnimatedBones;
+  if (AnimationFormat::IsCompressed(file)) {
+    auto header = cursor.Read<AnimationFormat::Header>();
+    if (header.version > AnimationFormat::VERSION) {
+      throw std::runtime_error("Unsupported animation version");
+    }
+
+    auto trackInfos = cursor.Take<AnimationFormat::TrackInfo>(header.numTracks);
+
+    auto copy = [&cursor]<typename T>(std::vector<T>& dst, size_t count) {
+      auto view = cursor.Take<T>(count);
+      dst.assign(view.begin(), view.end());
+    };
+    copy(times, header.numKeys);
+    copy(packedRotations, header.numRotations);
+    copy(packedTranslations, header.numTranslations);
+    copy(packedScales, header.numScales);
+
+    for (const auto& info : trackInfos) {
+      assert(info.numKeys > 0);
+
+      tracks.push_back({info.firstKey, info.numKeys});
+      trackBones.push_back(info.boneId);
+      trackChannels.push_back(info.channels);
+
+      minTime = std::min(minTime, times[info.firstKey]);
+      maxTime = std::max(maxTime, times[info.firstKey + info.numKeys - 1]);
+    }
+
+    BuildBoneTracks();
+    return;
+  }
 
-  fread(&numAnimatedBones, sizeof(numAnimatedBones), 1, fp);
+  UINT numAnimatedBones = cursor.Read<UINT>();
+  tracks.reserve(numAnimatedBones);
+  trackBones.reserve(numAnimatedBones);
 
-  for (int i = 0; i < numAnimatedBones; i++) {
-    int info[2];  // boneId + numKeyframes
-    fread(info, sizeof(int), 2, fp);
+  for (UINT i = 0; i < numAnimatedBones; i++) {
+    auto info = cursor.Take<int>(2);  // boneId + numKeyframes
+    auto keyframes = cursor.Take<Keyframe>(info[1]);
 
-    bonesKeyframes[info[0]].resize(info[1]);
-    fread(bonesKeyframes[info[0]].data(), sizeof(Keyframe), info[1], fp);
+    assert(!keyframes.empty());
+    assert(std::is_sorted(keyframes.begin(), keyframes.end(),
+                          [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; }));
 
-    auto [minEl, maxEl] = std::minmax_element(bonesKeyframes[info[0]].begin(), bonesKeyframes[info[0]].end(),
-                                              [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+    tracks.push_back({static_cast<uint32_t>(times.size()), static_cast<uint32_t>(keyframes.size())});
+    trackBones.push_back(info[0]);
 
-    if (minEl->time < minTime) minTime = minEl->time;
-    if (maxEl->time > maxTime) maxTime = maxEl->time;
+    for (const auto& keyframe : keyframes) {
+      times.push_back(keyframe.time);
+      scales.push_back(keyframe.scale);
+      translations.push_back(keyframe.translation);
+      rotations.push_back(keyframe.rotation);
+    }
+
+    minTime = std::min(minTime, keyframes.front().time);
+    maxTime = std::max(maxTime, keyframes.back().time);
   }
+
+  BuildBoneTracks();
 }
 
-XMMATRIX Animation::Interpolate(float curTime, int boneId, Skin* skin)
+void Animation::BuildBoneTracks()
 {
-  auto it = bonesKeyframes.find(boneId);
-  if (it == std::end(bonesKeyframes)) {
-    return XMLoadFloat4x4(&skin->staticTransforms[boneId]);
+  int maxBoneId = trackBones.empty() ? -1 : *std::max_element(trackBones.begin(), trackBones.end());
+  boneTracks.assign(maxBoneId + 1, -1);
+  for (size_t i = 0; i < trackBones.size(); i++) {
+    boneTracks[trackBones[i]] = static_cast<int>(i);
   }
+}
 
-  auto keyframes = it->second;
+size_t Animation::SizeInBytes() const
+{
+  auto bytes = [](const auto& v) { return sizeof(v[0]) * v.size(); };
 
-  float startTime = keyframes.front().time;
-  float endTime = keyframes.back().time;
+  return bytes(times) + bytes(scales) + bytes(translations) + bytes(rotations) + bytes(trackChannels) +
+         bytes(packedRotations) + bytes(packedTranslations) + bytes(packedScales) + bytes(tracks) +
+         bytes(trackBones) + bytes(boneTracks);
+}
 
-  if (curTime <= startTime) {
-    XMVECTOR scale = XMLoadFloat3(&keyframes.front().scale);
-    XMVECTOR trans = XMLoadFloat3(&keyframes.front().translation);
-    XMVECTOR rot = XMLoadFloat4(&keyframes.front().rotation);
+Animation::Keyframe Animation::GetKey(size_t trackIndex, size_t key) const
+{
+  const Track& track = tracks[trackIndex];
+  assert(key < track.numKeys);
 
-    return XMMatrixAffineTransformation(scale, zero, rot, trans);
-  } else if (curTime >= endTime) {
-    XMVECTOR scale = XMLoadFloat3(&keyframes.back().scale);
-    XMVECTOR trans = XMLoadFloat3(&keyframes.back().translation);
-    XMVECTOR rot = XMLoadFloat4(&keyframes.back().rotation);
+  if (!Compressed()) {
+    size_t k = track.firstKey + key;
+    return {times[k], scales[k], translations[k], rotations[k]};
+  }
 
-    return XMMatrixAffineTransformation(scale, zero, rot, trans);
-  } else {
-    for (size_t i = 0; i < keyframes.size(); i++) {
-      if (curTime >= keyframes[i].time && curTime <= keyframes[i + 1].time) {
-        float lerp = (curTime - keyframes[i].time) / (keyframes[i + 1].time - keyframes[i].time);
+  const auto& c = trackChannels[trackIndex];
+
+  return {
+      times[track.firstKey + key],
+      AnimationFormat::DecodeVector(packedScales[c.firstScale + key * c.scaleStride], c.scaleMin, c.scaleExtent),
+      AnimationFormat::DecodeVector(packedTranslations[c.firstTranslation + key * c.translationStride],
+                                    c.translationMin, c.translationExtent),
+      AnimationFormat::DecodeQuaternion(packedRotations[c.firstRotation + key * c.rotationStride]),
+  };
+}
 
-        XMVECTOR s1 = XMLoadFloat3(&keyframes[i].scale);
-        XMVECTOR s2 = XMLoadFloat3(&keyframes[i + 1].scale);
+// a frame rarely skips more keys than that, past it the binary search is as cheap
+static constexpr uint32_t MAX_CURSOR_STEPS = 4;
 
-        XMVECTOR t1 = XMLoadFloat3(&keyframes[i].translation);
-        XMVECTOR t2 = XMLoadFloat3(&keyframes[i + 1].translation);
+size_t Animation::FindKey(const Track& track, float curTime, uint32_t* cursor) const
+{
+  const float* keys = times.data() + track.firstKey;
+  const uint32_t last = track.numKeys - 1;
 
-        XMVECTOR r1 = XMLoadFloat4(&keyframes[i].rotation);
-        XMVECTOR r2 = XMLoadFloat4(&keyframes[i + 1].rotation);
+  size_t key;
 
-        XMVECTOR scale = XMVectorLerp(s1, s2, lerp);
-        XMVECTOR trans = XMVectorLerp(t1, t2, lerp);
-        XMVECTOR rot = XMQuaternionSlerp(r1, r2, lerp);
+  if (curTime <= keys[0]) {
+    key = 0;
+  } else if (curTime >= keys[last]) {
+    key = last;
+  } else {
+    key = last;  // not found yet
 
-        return XMMatrixAffineTransformation(scale, zero, rot, trans);
+    if (cursor && *cursor < last && keys[*cursor] <= curTime) {
+      uint32_t k = *cursor;
+      for (uint32_t step = 0; step < MAX_CURSOR_STEPS && keys[k + 1] <= curTime; step++) {
+        k++;
       }
+      if (curTime < keys[k + 1]) key = k;
     }
+
+    // first key after curTime, there is at least one before it
+    if (key == last) key = std::upper_bound(keys, keys + last, curTime) - keys - 1;
   }
 
-  return XMMatrixIdentity();
+  if (cursor) *cursor = static_cast<uint32_t>(key);
+
+  return key;
 }
 
-std::vector<XMFLOAT4X4> Animation::BoneTransforms(float curTime,
-                                                  Skin* skin,
-                                                  std::unordered_map<int, XMMATRIX>& globalTransforms)
+XMMATRIX Animation::Interpolate(float curTime, size_t bone, const Skin* skin, uint32_t* cursors) const
 {
-  globalTransforms[skin->header.rootBone] = Interpolate(curTime, skin->header.rootBone, skin);
+  int trackIndex = TrackIndex(skin->boneIds[bone]);
+  if (trackIndex < 0) {
+    return XMLoadFloat4x4(&skin->restTransforms[bone]);
+  }
+
+  const Track& track = tracks[trackIndex];
+  size_t key = FindKey(track, curTime, cursors ? cursors + trackIndex : nullptr);
+  Keyframe prev = GetKey(trackIndex, key);
 
-  std::stack<int> stack;
-  stack.push(skin->header.rootBone);
+  // before the first key or after the last one
+  if (curTime <= prev.time || key + 1 == track.numKeys) {
+    return XMMatrixAffineTransformation(XMLoadFloat3(&prev.scale), zero, XMLoadFloat4(&prev.rotation),
+                                        XMLoadFloat3(&prev.translation));
+  }
 
-  while (!stack.empty()) {
-    int bone = stack.top();
-    stack.pop();
+  Keyframe next = GetKey(trackIndex, key + 1);
+  float lerp = (curTime - prev.time) / (next.time - prev.time);
 
-    auto parentGlobalTransform = globalTransforms[bone];
+  XMVECTOR scale = XMVectorLerp(XMLoadFloat3(&prev.scale), XMLoadFloat3(&next.scale), lerp);
+  XMVECTOR trans = XMVectorLerp(XMLoadFloat3(&prev.translation), XMLoadFloat3(&next.translation), lerp);
+  XMVECTOR rot = XMQuaternionSlerp(XMLoadFloat4(&prev.rotation), XMLoadFloat4(&next.rotation), lerp);
 
-    auto children = skin->boneHierarchy[bone];
-    for (auto child : children) {
-      auto localTransform = Interpolate(curTime, child, skin);
-      globalTransforms[child] = localTransform * parentGlobalTransform;
-      stack.push(child);
-    }
-  }
+  return XMMatrixAffineTransformation(scale, zero, rot, trans);
+}
 
-  std::vector<XMFLOAT4X4> boneTransforms(skin->header.numJoints);
+void Animation::BoneTransforms(float curTime,
+                               const Skin* skin,
+                               std::span<XMMATRIX> globalTransforms,
+                               std::span<XMFLOAT4X4> boneTransforms,
+                               std::span<uint32_t> cursors) const
+{
+  const size_t numBones = skin->NumBones();
+
+  assert(globalTransforms.size() >= numBones);
+  assert(boneTransforms.size() >= skin->header.numJoints);
+  assert(cursors.empty() || cursors.size() == tracks.size());
+
+  // parents come first, their global transform is always ready
+  for (size_t i = 0; i < numBones; i++) {
+    XMMATRIX localTransform = Interpolate(curTime, i, skin, cursors.empty() ? nullptr : cursors.data());
+    int parent = skin->parentIndices[i];
+
+    globalTransforms[i] = parent < 0 ? localTransform : localTransform * globalTransforms[parent];
+  }
 
   for (size_t i = 0; i < skin->header.numJoints; i++) {
-    auto joint = skin->jointIndices[i];
+    auto joint = skin->jointBones[i];
     XMMATRIX inverseBindMatrix = XMLoadFloat4x4(&skin->inverseBindMatrices[i]);
 
     XMMATRIX boneTransform = XMMatrixTranspose(inverseBindMatrix * globalTransforms[joint]);
     XMStoreFloat4x4(&boneTransforms[i], boneTransform);
   }
+}
+
+std::vector<XMFLOAT4X4> Animation::BoneTransforms(float curTime,
+                                                  const Skin* skin,
+                                                  std::vector<XMMATRIX>& globalTransforms,
+                                                  std::span<uint32_t> cursors) const
+{
+  globalTransforms.resize(skin->NumBones());
+
+  std::vector<XMFLOAT4X4> boneTransforms(skin->header.numJoints);
+  BoneTransforms(curTime, skin, globalTransforms, boneTransforms, cursors);
 
   return boneTransforms;
 }
 
 void Mesh3D::Read(std::filesystem::path filename, bool skinned)
 {
-  FILE* fp;
-  fopen_s(&fp, filename.string().c_str(), "rb");
-  assert(fp);
+  file = std::make_shared<MappedFile>(filename);
+  assert(file->IsOpen());
 
   name = filename;
 
-  fread(&header, sizeof(header), 1, fp);
+  MeshFormat::Transform transform;
+
+  if (MeshFormat::IsContainer(*file)) {
+    ReadContainer(transform);
+  } else {
+    ReadLegacy(skinned, transform);
+  }
+
+  XMVECTOR scale = XMLoadFloat3(&transform.scale);
+  XMVECTOR trans = XMLoadFloat3(&transform.translation);
+  XMVECTOR rot = XMLoadFloat4(&transform.rotation);
+
+  auto issou = XMMatrixAffineTransformation(scale, XMVectorZero(), rot, trans);
+  XMStoreFloat4x4(&localTransform, issou);
+  parentBone = transform.parentBone;
+
+  auto additionalDataStart = std::chrono::steady_clock::now();
+  const wchar_t* additionalDataSource = L"mesh file";
+
+  if (!HasAdditionalData()) {
+    if (ReadCache()) {
+      additionalDataSource = L"cache hit";
+    } else {
+      ComputeAdditionalData();
+      WriteCache();
+      additionalDataSource = L"cache miss";
+    }
+  }
+
+  std::chrono::duration<double, std::milli> additionalDataTime = std::chrono::steady_clock::now() - additionalDataStart;
+
+  // the caller holds one reference on every stream
+  auto bytes = ResidentBytes();
+  m_Resident = 0;
+  for (size_t i = 0; i < NUM_STREAMS; i++) {
+    m_References[i] = bytes[i] > 0 ? 1 : 0;
+    if (bytes[i] > 0) m_Resident |= 1u << i;
+  }
+
+  if (!verbose) return;
+
+  wprintf(
+      L"=== %ls ===\nnumVerts: %u\nnumIndices: %u\nnumMeshlets: %zu\nnumUniqueVertexIndices: %zu\nnumPrimitives: %zu\n"
+      L"additional data: %.2f ms (%ls)\n\n",
+      name.wstring().c_str(), header.numVerts, header.numIndices, meshlets.size(), uniqueVertexIndices.size(),
+      primitiveIndices.size(), additionalDataTime.count(), additionalDataSource);
+}
+
+void Mesh3D::ReadContainer(MeshFormat::Transform& transform)
+{
+  using MeshFormat::SectionType;
+
+  MeshFormat::Reader reader(*file);
+
+  header.numVerts = reader.GetHeader().numVerts;
+  header.numIndices = reader.GetHeader().numIndices;
+  header.numSubsets = reader.GetHeader().numSubsets;
+
+  indices = reader.Get<uint32_t>(SectionType::Indices);
+  positions = reader.Get<XMFLOAT3>(SectionType::Positions);
+  normals = reader.Get<XMFLOAT3>(SectionType::Normals);
+  uvs = reader.Get<XMFLOAT2>(SectionType::UVs);
+  blendWeightsAndIndices = reader.Get<XMUINT2>(SectionType::BlendWeightsAndIndices);
+
+  assert(indices.size() == header.numIndices);
+  assert(positions.size() == header.numVerts && normals.size() == header.numVerts && uvs.size() == header.numVerts);
+  assert(blendWeightsAndIndices.empty() || blendWeightsAndIndices.size() == header.numVerts);
 
-  indices.resize(header.numIndices);
-  fread(indices.data(), sizeof(uint32_t), header.numIndices, fp);
+  {
+    auto fileSubsets = reader.Get<MeshFormat::Subset>(SectionType::Subsets);
+    auto strings = reader.Get<char>(SectionType::Strings);
+    assert(fileSubsets.size() == header.numSubsets);
+
+    subsets.resize(header.numSubsets);
+    materialNames.resize(header.numSubsets);
+
+    for (size_t i = 0; i < header.numSubsets; i++) {
+      subsets[i].start = fileSubsets[i].start;
+      subsets[i].count = fileSubsets[i].count;
+
+      auto materialName = strings.subspan(fileSubsets[i].materialNameOffset, fileSubsets[i].materialNameLength);
+      materialNames[i] = std::filesystem::path(std::u8string(materialName.begin(), materialName.end())).wstring();
+    }
+  }
+
+  {
+    auto t = reader.Get<MeshFormat::Transform>(SectionType::Transform);
+    assert(t.size() == 1);
+    transform = t[0];
+  }
+
+  ReadAdditionalData(reader);
+}
+
+void Mesh3D::ReadAdditionalData(const MeshFormat::Reader& reader)
+{
+  using MeshFormat::SectionType;
+
+  auto fileTangents = reader.Get<XMFLOAT4>(SectionType::Tangents);
+  tangents.assign(fileTangents.begin(), fileTangents.end());
+
+  auto fileMeshlets = reader.Get<MeshletData>(SectionType::Meshlets);
+  meshlets.assign(fileMeshlets.begin(), fileMeshlets.end());
+
+  auto fileUniqueVertexIndices = reader.Get<uint8_t>(SectionType::MeshletVertexIndices);
+  uniqueVertexIndices.assign(fileUniqueVertexIndices.begin(), fileUniqueVertexIndices.end());
+
+  auto filePrimitiveIndices = reader.Get<MeshletTriangle>(SectionType::MeshletPrimitives);
+  primitiveIndices.assign(filePrimitiveIndices.begin(), filePrimitiveIndices.end());
+
+  if (auto bounds = reader.Get<BoundingSphere>(SectionType::Bounds); !bounds.empty()) {
+    boundingSphere = bounds[0];
+    hasBounds = true;
+  }
+}
+
+// headerless format, kept so existing assets can still be loaded (see assets/migrate_mesh.py)
+void Mesh3D::ReadLegacy(bool skinned, MeshFormat::Transform& transform)
+{
+  auto cursor = file->Begin();
+
+  header = cursor.Read<decltype(header)>();
+
+  indices = cursor.Take<uint32_t>(header.numIndices);
 
   {
+    // WCHAR[MAX_PATH] on the Windows machine that wrote the file
     struct TmpSubset {
       uint32_t start, count;
-      FILENAME materialName;
+      char16_t materialName[260];
     };
 
-    std::vector<TmpSubset> tmpSubsets;
+    auto tmpSubsets = cursor.Take<TmpSubset>(header.numSubsets);
     subsets.resize(header.numSubsets);
-    tmpSubsets.resize(header.numSubsets);
-    fread(tmpSubsets.data(), sizeof(TmpSubset), header.numSubsets, fp);
-
-    std::filesystem::path baseDir = name.parent_path();
+    materialNames.resize(header.numSubsets);
 
     for (size_t i = 0; i < header.numSubsets; i++) {
       subsets[i].start = tmpSubsets[i].start;
       subsets[i].count = tmpSubsets[i].count;
-      // FIXME: remove everything backend specific from this file. only read file into a struct that's it.
-      // create a Renderer::CreateMesh function that takes care of CreateMaterial, ComputeAdditionalData, etc
-      subsets[i].materialIndex = Renderer::CreateMaterial(baseDir, std::wstring(tmpSubsets[i].materialName));
+      materialNames[i] = std::filesystem::path(std::u16string(tmpSubsets[i].materialName)).wstring();
     }
   }
 
-  positions.resize(header.numVerts);
-  normals.resize(header.numVerts);
-  tangents.resize(header.numVerts);
-  uvs.resize(header.numVerts);
-
-  fread(positions.data(), sizeof(positions[0]), header.numVerts, fp);
-  fread(normals.data(), sizeof(normals[0]), header.numVerts, fp);
-  fread(uvs.data(), sizeof(uvs[0]), header.numVerts, fp);
+  positions = cursor.Take<XMFLOAT3>(header.numVerts);
+  normals = cursor.Take<XMFLOAT3>(header.numVerts);
+  uvs = cursor.Take<XMFLOAT2>(header.numVerts);
   if (skinned) {
-    blendWeightsAndIndices.resize(header.numVerts);
-    fread(blendWeightsAndIndices.data(), sizeof(blendWeightsAndIndices[0]), header.numVerts, fp);
+    blendWeightsAndIndices = cursor.Take<XMUINT2>(header.numVerts);
   }
 
-  fread(&parentBone, sizeof(int), 1, fp);
+  transform.parentBone = cursor.Read<int>();
+  transform.scale = cursor.Read<XMFLOAT3>();
+  transform.translation = cursor.Read<XMFLOAT3>();
+  transform.rotation = cursor.Read<XMFLOAT4>();
+}
 
-  struct {
-    XMFLOAT3 scale;
-    XMFLOAT3 translation;
-    XMFLOAT4 rotation;
-  } transform;
+MeshFormat::CacheKey Mesh3D::ComputeCacheKey() const
+{
+  return {
+      .sourceHash = MeshFormat::Hash({file->Data(), file->Size()}),
+      .builderVersion = BUILDER_VERSION,
+      .maxVerts = MESHLET_MAX_VERT,
+      .maxPrims = MESHLET_MAX_PRIM,
+  };
+}
 
-  fread(&transform, sizeof(transform), 1, fp);
-  XMVECTOR scale = XMLoadFloat3(&transform.scale);
-  XMVECTOR trans = XMLoadFloat3(&transform.translation);
-  XMVECTOR rot = XMLoadFloat4(&transform.rotation);
+std::filesystem::path Mesh3D::CachePath() const
+{
+  std::filesystem::path cachePath = name;
+  return cachePath.replace_extension(".meshcache");
+}
 
-  auto issou = XMMatrixAffineTransformation(scale, XMVectorZero(), rot, trans);
-  XMStoreFloat4x4(&localTransform, issou);
+bool Mesh3D::ReadCache()
+{
+  MappedFile cacheFile(CachePath());
+  if (!cacheFile.IsOpen() || !MeshFormat::IsContainer(cacheFile)) return false;
 
-  fclose(fp);
+  MeshFormat::Reader reader(cacheFile);
 
-  ComputeAdditionalData();
+  auto key = reader.Get<MeshFormat::CacheKey>(MeshFormat::SectionType::CacheKey);
+  if (key.size() != 1 || key[0] != ComputeCacheKey()) return false;
 
-  wprintf(
-      L"=== %s ===\nnumVerts: %d\nnumIndices: %d\nnumMeshlets: %d\nnumUniqueVertexIndices: %d\nnumPrimitives: %d\n\n",
-      name.wstring().c_str(), header.numVerts, header.numIndices, meshlets.size(), uniqueVertexIndices.size(),
-      primitiveIndices.size());
+  ReadAdditionalData(reader);
+
+  return HasAdditionalData();
+}
+
+void Mesh3D::WriteCache() const
+{
+  using MeshFormat::SectionType;
+
+  auto key = ComputeCacheKey();
+
+  MeshFormat::Writer writer;
+  writer.Add(SectionType::CacheKey, &key, 1);
+  writer.Add(SectionType::Tangents, tangents);
+  writer.Add(SectionType::Meshlets, meshlets);
+  writer.Add(SectionType::MeshletVertexIndices, uniqueVertexIndices);
+  writer.Add(SectionType::MeshletPrimitives, primitiveIndices);
+  writer.Add(SectionType::Bounds, &boundingSphere, 1);
+
+  if (!writer.Save(CachePath(), header.numVerts, header.numIndices, header.numSubsets, 0)) {
+    wprintf(L"Failed to write mesh cache %ls\n", CachePath().wstring().c_str());
+  }
+}
+
+bool Mesh3D::HasAdditionalData() const
+{
+  return hasBounds && tangents.size() == header.numVerts && !meshlets.empty() && !uniqueVertexIndices.empty() &&
+         !primitiveIndices.empty();
 }
 
-// TODO: cache all this
-// check if meshlet data file is older than mesh file. if so regenerate. if not, load from disk.
+// Results are cached next to the mesh, see ReadCache/WriteCache
 void Mesh3D::ComputeAdditionalData()
 {
+  meshlets.clear();
+  uniqueVertexIndices.clear();
+  primitiveIndices.clear();
+
   BoundingSphere::CreateFromPoints(boundingSphere, positions.size(), positions.data(), sizeof(positions[0]));
+  hasBounds = true;
 
+  tangents.resize(header.numVerts);
   ComputeTangentFrame(indices.data(), indices.size() / 3, positions.data(), normals.data(), uvs.data(), header.numVerts,
                       tangents.data());
 
@@ -296,7 +575,7 @@ void Mesh3D::ComputeAdditionalData()
       auto end = start + meshletSubsets[i].second;
 
       for (size_t j = start; j < end; j++) {
-        meshlets[j].materialIndex = subsets[i].materialIndex;
+        meshlets[j].materialIndex = i;  // the renderer maps it to the actual material
       }
     }
   }
@@ -317,7 +596,123 @@ void Mesh3D::ComputeAdditionalData()
   }
 }
 
-Model3D& Model3D::Read(std::filesystem::path filename)
+// streams that are views into the mapped file, until CopyMappedStreams
+static constexpr uint32_t MAPPED_STREAMS = Mesh3D::Indices | Mesh3D::Positions | Mesh3D::Normals | Mesh3D::UVs |
+                                           Mesh3D::BlendWeightsAndIndices;
+
+template <typename T>
+static void FreeStream(std::vector<T>& stream)
+{
+  std::vector<T>().swap(stream);
+}
+
+template <typename T>
+static void FreeStream(std::span<const T>& view, std::vector<T>& owned)
+{
+  view = {};
+  FreeStream(owned);
+}
+
+template <typename T>
+static void CopyStream(std::span<const T>& view, std::vector<T>& owned)
+{
+  if (view.empty()) return;
+
+  owned.assign(view.begin(), view.end());
+  view = owned;
+}
+
+void Mesh3D::Retain(uint32_t streams)
+{
+  assert(IsResident(streams));
+
+  for (size_t i = 0; i < NUM_STREAMS; i++) {
+    if (streams & (1u << i)) m_References[i]++;
+  }
+}
+
+void Mesh3D::Release(uint32_t streams)
+{
+  uint32_t freed = 0;
+
+  // streams the mesh does not have are ignored, so consumers can release everything they might have used
+  for (size_t i = 0; i < NUM_STREAMS; i++) {
+    uint32_t stream = 1u << i;
+    if (!(streams & m_Resident & stream)) continue;
+
+    assert(m_References[i] > 0);
+    if (--m_References[i] == 0) freed |= stream;
+  }
+
+  if (!freed) return;
+
+  m_Resident &= ~freed;
+
+  if (freed & Indices) FreeStream(indices, m_Owned.indices);
+  if (freed & Positions) FreeStream(positions, m_Owned.positions);
+  if (freed & Normals) FreeStream(normals, m_Owned.normals);
+  if (freed & Tangents) FreeStream(tangents);
+  if (freed & UVs) FreeStream(uvs, m_Owned.uvs);
+  if (freed & BlendWeightsAndIndices) FreeStream(blendWeightsAndIndices, m_Owned.blendWeightsAndIndices);
+  if (freed & Meshlets) FreeStream(meshlets);
+  if (freed & MeshletVertexIndices) FreeStream(uniqueVertexIndices);
+  if (freed & MeshletPrimitives) FreeStream(primitiveIndices);
+
+  if (file && (freed & MAPPED_STREAMS)) CopyMappedStreams();
+}
+
+// Moves the streams still viewing the file to owned memory and unmaps it.
+// Usually only a few streams are left by then, cheaper than keeping the whole file around
+void Mesh3D::CopyMappedStreams()
+{
+  CopyStream(indices, m_Owned.indices);
+  CopyStream(positions, m_Owned.positions);
+  CopyStream(normals, m_Owned.normals);
+  CopyStream(uvs, m_Owned.uvs);
+  CopyStream(blendWeightsAndIndices, m_Owned.blendWeightsAndIndices);
+
+  file.reset();
+}
+
+std::array<size_t, Mesh3D::NUM_STREAMS> Mesh3D::ResidentBytes() const
+{
+  return {
+      indices.size_bytes(),
+      positions.size_bytes(),
+      normals.size_bytes(),
+      sizeof(XMFLOAT4) * tangents.size(),
+      uvs.size_bytes(),
+      blendWeightsAndIndices.size_bytes(),
+      sizeof(MeshletData) * meshlets.size(),
+      uniqueVertexIndices.size(),
+      sizeof(MeshletTriangle) * primitiveIndices.size(),
+  };
+}
+
+const char* Mesh3D::StreamName(size_t i)
+{
+  static const char* names[NUM_STREAMS] = {
+      "indices", "positions", "normals", "tangents", "uvs", "bwi", "meshlets", "mlt verts", "mlt prims",
+  };
+
+  assert(i < NUM_STREAMS);
+  return names[i];
+}
+
+struct Model3D::Files {
+  struct SkinnedMesh {
+    std::filesystem::path mesh;
+    size_t skin;  // index in skins
+  };
+
+  std::vector<std::filesystem::path> meshes;
+  std::vector<SkinnedMesh> skinnedMeshes;
+  std::vector<std::filesystem::path> skins;  // unique, in order of first use
+  std::vector<std::pair<std::filesystem::path, std::string>> animations;
+  std::optional<std::filesystem::path> staticTransform;
+};
+
+Model3D::Files Model3D::ReadFiles(std::filesystem::path filename)
 {
   // TODO: add this as constexpr in stdafx.h or something and add an helper function
   std::filesystem::path basePath = "assets";
@@ -338,32 +733,172 @@ Model3D& Model3D::Read(std::filesystem::path filename)
   std::getline(file, line);
   size_t numAnimations = std::stoi(line.substr(line.find(":") + 1));
 
+  Files files;
+
   std::getline(file, line);
-  std::optional<std::filesystem::path> staticTransform;
   std::string transformFile = line.substr(line.find(":") + 2);
-  if (transformFile != "None") staticTransform = dir / transformFile;
+  if (transformFile != "None") files.staticTransform = dir / transformFile;
+
+  files.meshes.resize(numMesh);
+  files.skinnedMeshes.resize(numSkinnedMesh);
+  files.animations.resize(numAnimations);
 
   for (size_t i = 0; i < numMesh; ++i) {
     std::getline(file, line);
-    AddMesh(dir / line);
+    files.meshes[i] = dir / line;
   }
 
   for (size_t i = 0; i < numSkinnedMesh; ++i) {
     std::getline(file, line);
     auto sep = line.find(';');
-    std::string mesh = line.substr(0, sep);
-    std::string skin = line.substr(sep + 1);
+    std::filesystem::path skin = dir / line.substr(sep + 1);
+
+    auto it = std::find(files.skins.begin(), files.skins.end(), skin);
+    if (it == files.skins.end()) it = files.skins.insert(files.skins.end(), skin);
 
-    AddSkinnedMesh(dir / mesh, dir / skin, staticTransform);
+    files.skinnedMeshes[i] = {dir / line.substr(0, sep), static_cast<size_t>(it - files.skins.begin())};
   }
 
   for (size_t i = 0; i < numAnimations; ++i) {
     std::getline(file, line);
     auto sep = line.find(';');
-    std::string anim = line.substr(0, sep);
-    std::string name = line.substr(sep + 1);
+    files.animations[i] = {dir / line.substr(0, sep), line.substr(sep + 1)};
+  }
+
+  return files;
+}
+
+void Model3D::Load(const Files& files)
+{
+  const size_t numMesh = files.meshes.size();
+  const size_t numSkinnedMesh = files.skinnedMeshes.size();
+  const size_t numAnimations = files.animations.size();
+
+  // everything below only depends on its own file, so it can be read in any order.
+  // results land in fixed slots so the model is the same whatever the number of workers.
+  std::vector<std::shared_ptr<Mesh3D>> newMeshes(numMesh + numSkinnedMesh);
+  std::vector<std::shared_ptr<Skin>> newSkins(files.skins.size());
+  std::vector<std::shared_ptr<Animation>> newAnimations(numAnimations);
+
+  size_t skinsStart = newMeshes.size();
+  size_t animationsStart = skinsStart + newSkins.size();
+
+  Jobs::ParallelFor(animationsStart + newAnimations.size(), [&](size_t i) {
+    if (i < numMesh) {
+      newMeshes[i] = std::make_shared<Mesh3D>();
+      newMeshes[i]->Read(files.meshes[i]);
+    } else if (i < skinsStart) {
+      newMeshes[i] = std::make_shared<Mesh3D>();
+      newMeshes[i]->Read(files.skinnedMeshes[i - numMesh].mesh, true);
+    } else if (i < animationsStart) {
+      auto skin = std::make_shared<Skin>();
+      skin->Read(files.skins[i - skinsStart]);
+
+      if (files.staticTransform.has_value()) {
+        skin->ReadStaticTransforms(files.staticTransform.value());
+      }
+
+      newSkins[i - skinsStart] = skin;
+    } else {
+      newAnimations[i - animationsStart] = std::make_shared<Animation>();
+      newAnimations[i - animationsStart]->Read(files.animations[i - animationsStart].first);
+    }
+  });
+
+  for (size_t i = 0; i < files.skins.size(); i++) {
+    auto it = skins.find(files.skins[i].wstring());
+    if (it == std::end(skins)) {
+      skins[files.skins[i].wstring()] = newSkins[i];
+    } else {
+      newSkins[i] = it->second;
+    }
+  }
+
+  for (size_t i = 0; i < numSkinnedMesh; i++) {
+    newMeshes[numMesh + i]->skin = newSkins[files.skinnedMeshes[i].skin];
+  }
+
+  meshes.insert(meshes.end(), newMeshes.begin(), newMeshes.end());
+
+  for (size_t i = 0; i < numAnimations; i++) {
+    animations[files.animations[i].second] = newAnimations[i];
+  }
+}
+
+Model3D& Model3D::Read(std::filesystem::path filename)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  Load(ReadFiles(filename));
+
+  std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+  if (Mesh3D::verbose) {
+    wprintf(L"Model %ls: %.2f ms (%zu workers)\n", filename.wstring().c_str(), loadTime.count(), Jobs::NumWorkers());
+  }
+
+  return *this;
+}
+
+// Center of a mesh in the space of its model, read ahead of the mesh for its streaming priority: the bounds of the
+// file or of its cache, else the origin of the mesh. Only the pages of the header and of these sections are read
+static XMFLOAT3 PeekCenter(const std::filesystem::path& filename)
+{
+  using MeshFormat::SectionType;
+
+  XMFLOAT3 center = {0.f, 0.f, 0.f};
+
+  MappedFile file(filename);
+  if (!file.IsOpen() || !MeshFormat::IsContainer(file)) return center;
+
+  MeshFormat::Reader reader(file);
+
+  if (auto bounds = reader.Get<BoundingSphere>(SectionType::Bounds); !bounds.empty()) {
+    center = bounds[0].Center;
+  } else if (MappedFile cacheFile(std::filesystem::path(filename).replace_extension(".meshcache"));
+             cacheFile.IsOpen() && MeshFormat::IsContainer(cacheFile)) {
+    auto cacheBounds = MeshFormat::Reader(cacheFile).Get<BoundingSphere>(SectionType::Bounds);
+    if (!cacheBounds.empty()) center = cacheBounds[0].Center;
+  }
+
+  if (auto t = reader.Get<MeshFormat::Transform>(SectionType::Transform); t.size() == 1) {
+    XMMATRIX local = XMMatrixAffineTransformation(XMLoadFloat3(&t[0].scale), XMVectorZero(),
+                                                  XMLoadFloat4(&t[0].rotation), XMLoadFloat3(&t[0].translation));
+    XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&center), local));
+  }
+
+  return center;
+}
+
+Model3D& Model3D::Stream(std::filesystem::path filename, StreamingPriority priority, MeshLoadedCallback onMeshLoaded)
+{
+  Files files = ReadFiles(filename);
+
+  // animations must be there for SetCurrentAnimation, and skinned meshes are few. read them now
+  std::vector<std::filesystem::path> streamed;
+  std::swap(streamed, files.meshes);
+  Load(files);
+
+  for (auto& meshFile : streamed) {
+    auto mesh = std::make_shared<Mesh3D>();
+    XMFLOAT3 center = PeekCenter(meshFile);
+
+    // the model may move, or the camera, before the mesh gets its turn
+    auto update = [this, center, priority]() {
+      XMFLOAT3 world;
+      XMStoreFloat3(&world, XMVector3TransformCoord(XMLoadFloat3(&center), WorldMatrix()));
+      return priority(world);
+    };
+
+    Streaming::Submit({
+        .priority = update(),
+        .load = [mesh, meshFile]() { mesh->Read(meshFile); },
+        .complete = [this, mesh, onMeshLoaded]() {
+          meshes.push_back(mesh);
 
-    AddAnimation(dir / anim, name);
+          if (onMeshLoaded) onMeshLoaded(this, mesh);
+        },
+        .update = update,
+    });
   }
 
   return *this;
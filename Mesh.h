@@ -1,8 +1,8 @@
 #pragma once
 
 #include "shaders/Shared.h"
-
-typedef WCHAR FILENAME[MAX_PATH];
+#include "AnimationFormat.h"
+#include "MeshFormat.h"
 
 struct Skin {
   struct {
@@ -11,19 +11,34 @@ struct Skin {
     UINT numJoints;
   } header;
 
-  // parent -> children
-  std::unordered_map<int, std::vector<int>> boneHierarchy;
-  std::vector<int> jointIndices;
-  std::vector<DirectX::XMFLOAT4X4> inverseBindMatrices;
+  // Flattened hierarchy, parents always come before their children so a pose is evaluated in one pass.
+  // Bones are referred to by their index in these arrays, ids from the files are only used for lookups
+  std::vector<int> boneIds;
+  std::vector<int> parentIndices;                   // -1 for the root
+  std::vector<DirectX::XMFLOAT4X4> restTransforms;  // local, for bones without keyframes. Identity by default
 
-  std::unordered_map<int, DirectX::XMFLOAT4X4> staticTransforms;
+  std::vector<int> jointBones;  // per joint, bone index
+  std::vector<DirectX::XMFLOAT4X4> inverseBindMatrices;
 
   void Read(std::filesystem::path filename);
 
   void ReadStaticTransforms(std::filesystem::path filename);
+
+  size_t NumBones() const { return boneIds.size(); }
+
+  // -1 if the bone is not part of this skin
+  int BoneIndex(int boneId) const
+  {
+    auto it = boneIndices.find(boneId);
+    return it == boneIndices.end() ? -1 : it->second;
+  }
+
+private:
+  std::unordered_map<int, int> boneIndices;  // bone id -> index
 };
 
 struct Animation {
+  // as stored in .anim files
   struct Keyframe {
     float time;
     DirectX::XMFLOAT3 scale;
@@ -31,61 +46,171 @@ struct Animation {
     DirectX::XMFLOAT4 rotation;
   };
 
-  // bone id -> keyframes
-  std::unordered_map<int, std::vector<Keyframe>> bonesKeyframes;
+  // Keys of all tracks, one array per channel. A track is a range of keys sorted by time
+  struct Track {
+    uint32_t firstKey;
+    uint32_t numKeys;
+  };
+
+  std::vector<float> times;
+  std::vector<DirectX::XMFLOAT3> scales;
+  std::vector<DirectX::XMFLOAT3> translations;
+  std::vector<DirectX::XMFLOAT4> rotations;
+
+  // compressed clips keep their keys packed instead, see AnimationFormat. times are still one per key
+  std::vector<AnimationFormat::TrackChannels> trackChannels;  // per track
+  std::vector<AnimationFormat::PackedQuaternion> packedRotations;
+  std::vector<AnimationFormat::PackedVector> packedTranslations;
+  std::vector<AnimationFormat::PackedVector> packedScales;
 
-  float minTime;
-  float maxTime;
+  std::vector<Track> tracks;
+  std::vector<int> trackBones;    // per track, bone id
+  std::vector<int> boneTracks;    // bone id -> track, -1 when the bone is not animated
 
+  float minTime = std::numeric_limits<float>::max();
+  float maxTime = std::numeric_limits<float>::lowest();
+
+  // raw or compressed, see AnimationFormat::IsCompressed
   void Read(std::filesystem::path filename);
 
-  DirectX::XMMATRIX Interpolate(float curTime, int boneId, Skin* skin);
+  bool Compressed() const { return !trackChannels.empty(); }
+
+  // keys and lookup tables
+  size_t SizeInBytes() const;
+
+  // key relative to the track, decoded when the clip is compressed
+  Keyframe GetKey(size_t trackIndex, size_t key) const;
+
+  // fills the lookup tables once the keys are in
+  void BuildBoneTracks();
+
+  int TrackIndex(int boneId) const
+  {
+    return boneId >= 0 && static_cast<size_t>(boneId) < boneTracks.size() ? boneTracks[boneId] : -1;
+  }
+
+  // Index of the key that starts the interval containing curTime, relative to the track.
+  // cursor, when given, holds the result of the previous lookup: playback moving forward finds the interval
+  // in a few steps from there, and only loops or seeks fall back to a binary search. It is updated
+  size_t FindKey(const Track& track, float curTime, uint32_t* cursor = nullptr) const;
+
+  // local transform of a bone, given by its index in the skin. cursors is null or has one entry per track
+  DirectX::XMMATRIX Interpolate(float curTime, size_t bone, const Skin* skin, uint32_t* cursors = nullptr) const;
+
+  // globalTransforms is indexed like the skin bones (NumBones), boneTransforms like the joints (numJoints),
+  // cursors like the tracks (or empty to always search). Writes the outputs in place, nothing is allocated
+  void BoneTransforms(float curTime,
+                      const Skin* skin,
+                      std::span<DirectX::XMMATRIX> globalTransforms,
+                      std::span<DirectX::XMFLOAT4X4> boneTransforms,
+                      std::span<uint32_t> cursors = {}) const;
 
   std::vector<DirectX::XMFLOAT4X4> BoneTransforms(float curTime,
-                                                  Skin* skin,
-                                                  std::unordered_map<int, DirectX::XMMATRIX>& globalTransforms);
+                                                  const Skin* skin,
+                                                  std::vector<DirectX::XMMATRIX>& globalTransforms,
+                                                  std::span<uint32_t> cursors = {}) const;
 };
 
 struct AnimationInfo {
   std::shared_ptr<Animation> animation = nullptr;
-  std::unordered_map<int, DirectX::XMMATRIX> globalTransforms;
+  std::unordered_map<const Skin*, std::vector<DirectX::XMMATRIX>> globalTransforms;  // per skin, from the last update
+  std::unordered_map<const Skin*, std::vector<DirectX::XMFLOAT4X4>> boneTransforms;  // per skin, see PoseBatch
+  std::vector<uint32_t> cursors;  // per track, see Animation::FindKey
+  float timeOffset = 0.f;         // seconds, added to the time this instance is evaluated at
 
-  std::vector<DirectX::XMFLOAT4X4> BoneTransforms(float time, Skin* skin)
+  // the animation loops
+  float ClipTime(float time) const
   {
     float duration = animation->maxTime - animation->minTime;
-    float curTime = animation->minTime + fmod(time, duration);
+    return animation->minTime + std::fmod(time, duration);
+  }
+
+  // into a range owned by the caller, such as the bone matrices staged for upload. The cursors and global
+  // transforms are sized on the first evaluation of a skin only, later frames do not allocate
+  void BoneTransforms(float time, const Skin* skin, std::span<DirectX::XMFLOAT4X4> out)
+  {
+    if (cursors.size() != animation->tracks.size()) cursors.assign(animation->tracks.size(), 0);
+
+    auto& globals = globalTransforms[skin];
+    globals.resize(skin->NumBones());
+
+    animation->BoneTransforms(ClipTime(time + timeOffset), skin, globals, out, cursors);
+  }
 
-    return animation->BoneTransforms(curTime, skin, globalTransforms);
+  std::vector<DirectX::XMFLOAT4X4> BoneTransforms(float time, const Skin* skin)
+  {
+    std::vector<DirectX::XMFLOAT4X4> out(skin->header.numJoints);
+    BoneTransforms(time, skin, out);
+
+    return out;
+  }
+
+  // identity when no evaluated skin has that bone
+  DirectX::XMMATRIX GlobalTransform(int boneId) const
+  {
+    for (const auto& [skin, transforms] : globalTransforms) {
+      int bone = skin->BoneIndex(boneId);
+      if (bone >= 0 && static_cast<size_t>(bone) < transforms.size()) return transforms[bone];
+    }
+
+    return DirectX::XMMatrixIdentity();
   }
 };
 
 struct Subset {
-  uint32_t start, count, materialIndex;
+  uint32_t start, count;
 };
 
 struct Mesh3D {
+  // bump whenever ComputeAdditionalData output or MeshFormat::Hash changes, to invalidate .meshcache files
+  static constexpr uint32_t BUILDER_VERSION = 2;
+
+  // CPU-side geometry streams, as a bit mask. See Retain/Release
+  enum Streams : uint32_t {
+    Indices = 1 << 0,
+    Positions = 1 << 1,
+    Normals = 1 << 2,
+    Tangents = 1 << 3,
+    UVs = 1 << 4,
+    BlendWeightsAndIndices = 1 << 5,
+    Meshlets = 1 << 6,
+    MeshletVertexIndices = 1 << 7,
+    MeshletPrimitives = 1 << 8,
+  };
+  static constexpr size_t NUM_STREAMS = 9;
+  static constexpr uint32_t ALL_STREAMS = (1u << NUM_STREAMS) - 1;
+
+  // print per mesh and per model stats while reading
+  static inline bool verbose = true;
+
   struct {
     uint32_t numVerts;
     uint32_t numIndices;
     uint32_t numSubsets;
   } header;
 
-  std::vector<uint32_t> indices;
+  // the file stays mapped until every stream viewing it is released.
+  // streams read from disk are views into it, so they can be copied straight to the upload buffers
+  std::shared_ptr<MappedFile> file;
+
+  std::span<const uint32_t> indices;
   std::vector<Subset> subsets;
+  std::vector<std::wstring> materialNames;  // per subset, relative to the mesh directory
 
-  // TODO: upload packed data to GPU to save bandwidth
-  std::vector<DirectX::XMFLOAT3> positions;
-  std::vector<DirectX::XMFLOAT3> normals;
+  // see VertexPacking.h for the packed layout uploaded with Renderer::SetPackVertexStreams
+  std::span<const DirectX::XMFLOAT3> positions;
+  std::span<const DirectX::XMFLOAT3> normals;
   std::vector<DirectX::XMFLOAT4> tangents;  // W = bitangent sign
-  std::vector<DirectX::XMFLOAT2> uvs;
-  std::vector<DirectX::XMUINT2> blendWeightsAndIndices;
+  std::span<const DirectX::XMFLOAT2> uvs;
+  std::span<const DirectX::XMUINT2> blendWeightsAndIndices;
 
   // mesh shader specific
-  std::vector<MeshletData> meshlets;
+  std::vector<MeshletData> meshlets;  // materialIndex is the subset index
   std::vector<uint8_t> uniqueVertexIndices;  // underlying indices are uint32, but stored in uint8_t array
   std::vector<DirectX::MeshletTriangle> primitiveIndices;
 
   DirectX::BoundingSphere boundingSphere;
+  bool hasBounds = false;
 
   std::filesystem::path name;
   std::shared_ptr<Skin> skin = nullptr;  // in case of skinned mesh
@@ -93,10 +218,14 @@ struct Mesh3D {
   int parentBone = -1;
   DirectX::XMFLOAT4X4 localTransform;
 
+  // only touches this mesh, safe to call from several threads at once
   void Read(std::filesystem::path filename, bool skinned = false);
 
   void ComputeAdditionalData();
 
+  // bounds, tangents and meshlets were all found in the mesh file
+  bool HasAdditionalData() const;
+
   bool Skinned() const { return skin != nullptr; }
 
   size_t IndicesBufferSize() const { return sizeof(indices[0]) * header.numIndices; }
@@ -134,6 +263,43 @@ struct Mesh3D {
   }
 
   DirectX::XMMATRIX LocalTransformMatrix() const { return DirectX::XMLoadFloat4x4(&localTransform); }
+
+  // Residency of the CPU-side streams, main thread only.
+  // Read hands one reference on every stream to the caller, usually the renderer which releases it once uploaded.
+  // Other consumers (e.g. the collider) retain what they read beforehand. A stream is freed when its last
+  // reference is released, and the file is unmapped once no stream views it anymore.
+  void Retain(uint32_t streams);
+  void Release(uint32_t streams);
+  bool IsResident(uint32_t streams) const { return (m_Resident & streams) == streams; }
+
+  // bytes currently held per stream, indexed like the Streams bits
+  std::array<size_t, NUM_STREAMS> ResidentBytes() const;
+  static const char* StreamName(size_t i);
+
+private:
+  void ReadAdditionalData(const MeshFormat::Reader& reader);
+
+  MeshFormat::CacheKey ComputeCacheKey() const;
+  std::filesystem::path CachePath() const;
+  bool ReadCache();
+  void WriteCache() const;
+
+  void ReadContainer(MeshFormat::Transform& transform);
+  void ReadLegacy(bool skinned, MeshFormat::Transform& transform);
+
+  void CopyMappedStreams();
+
+  uint32_t m_Resident = 0;
+  std::array<uint32_t, NUM_STREAMS> m_References{};
+
+  // mapped streams that outlived the mapping
+  struct {
+    std::vector<uint32_t> indices;
+    std::vector<DirectX::XMFLOAT3> positions;
+    std::vector<DirectX::XMFLOAT3> normals;
+    std::vector<DirectX::XMFLOAT2> uvs;
+    std::vector<DirectX::XMUINT2> blendWeightsAndIndices;
+  } m_Owned;
 };
 
 struct Model3D {
@@ -151,6 +317,17 @@ struct Model3D {
 
   Model3D& Read(std::filesystem::path filename);
 
+  // called on the main thread once a streamed mesh was added to the model
+  using MeshLoadedCallback = std::function<void(Model3D*, std::shared_ptr<Mesh3D>)>;
+
+  // streaming priority of a mesh from its center in world space, lower is loaded first
+  using StreamingPriority = std::function<float(const DirectX::XMFLOAT3& center)>;
+
+  // Like Read, but static meshes are loaded in the background (see Streaming.h) and handed to onMeshLoaded
+  // as they finish. Each mesh is prioritized from where its bounds are, and again on Streaming::UpdatePriorities
+  // while it waits. The model must outlive the streaming, and instances spawned before then miss meshes
+  Model3D& Stream(std::filesystem::path filename, StreamingPriority priority, MeshLoadedCallback onMeshLoaded = nullptr);
+
   Model3D SpawnInstance() const
   {
     Model3D instance;
@@ -178,7 +355,7 @@ struct Model3D {
     auto mesh = std::make_shared<Mesh3D>();
     mesh->Read(meshFilename, true);
 
-    if (auto it = skins.find(skinFilename); it != std::end(skins)) {
+    if (auto it = skins.find(skinFilename.wstring()); it != std::end(skins)) {
       mesh->skin = it->second;
     } else {
       auto skin = std::make_shared<Skin>();
@@ -189,7 +366,7 @@ struct Model3D {
       }
 
       mesh->skin = skin;
-      skins[skinFilename] = skin;
+      skins[skinFilename.wstring()] = skin;
     }
 
     meshes.push_back(mesh);
@@ -212,6 +389,8 @@ struct Model3D {
     currentAnimation.animation = animations[name];
     assert(currentAnimation.animation);
 
+    currentAnimation.cursors.assign(currentAnimation.animation->tracks.size(), 0);
+
     return *this;
   }
 
@@ -244,4 +423,10 @@ struct Model3D {
   }
 
   void Clean() { dirty = false; }
+
+private:
+  struct Files;
+
+  static Files ReadFiles(std::filesystem::path filename);
+  void Load(const Files& files);
 };
@@ -0,0 +1,85 @@
+#include "stdafx_assets.h"
+
+#include "MeshFormat.h"
+
+namespace MeshFormat
+{
+static size_t SectionAlignment(SectionType type)
+{
+  switch (type) {
+    case SectionType::Indices:
+    case SectionType::Positions:
+    case SectionType::Normals:
+    case SectionType::Tangents:
+    case SectionType::UVs:
+    case SectionType::BlendWeightsAndIndices:
+      return STREAM_ALIGNMENT;
+    default:
+      return SECTION_ALIGNMENT;
+  }
+}
+
+bool Writer::Save(const std::filesystem::path& filename, uint32_t numVerts, uint32_t numIndices, uint32_t numSubsets,
+                  uint32_t flags) const
+{
+  Header header{
+      .magic = MAGIC,
+      .version = VERSION,
+      .numVerts = numVerts,
+      .numIndices = numIndices,
+      .numSubsets = numSubsets,
+      .numSections = static_cast<uint32_t>(m_Sections.size()),
+      .flags = flags,
+  };
+
+  std::vector<Section> table(m_Sections.size());
+  size_t offset = sizeof(Header) + sizeof(Section) * table.size();
+
+  for (size_t i = 0; i < m_Sections.size(); i++) {
+    offset = AlignUp(offset, SectionAlignment(m_Sections[i].type));
+
+    table[i] = {
+        .type = m_Sections[i].type,
+        .elementSize = m_Sections[i].elementSize,
+        .offset = offset,
+        .size = m_Sections[i].bytes.size(),
+    };
+
+    offset += m_Sections[i].bytes.size();
+  }
+
+  const std::filesystem::path tmpFilename = TemporaryPath(filename);
+  std::error_code ec;
+
+  {
+    std::ofstream out(tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), sizeof(Section) * table.size());
+
+    static constexpr char padding[STREAM_ALIGNMENT] = {};
+    size_t written = sizeof(Header) + sizeof(Section) * table.size();
+
+    for (size_t i = 0; i < m_Sections.size(); i++) {
+      out.write(padding, table[i].offset - written);
+      out.write(reinterpret_cast<const char*>(m_Sections[i].bytes.data()), m_Sections[i].bytes.size());
+      written = table[i].offset + table[i].size;
+    }
+
+    if (!out) {
+      out.close();
+      std::filesystem::remove(tmpFilename, ec);
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpFilename, filename, ec);
+  if (ec) {
+    std::filesystem::remove(tmpFilename, ec);
+    return false;
+  }
+
+  return true;
+}
+}  // namespace MeshFormat
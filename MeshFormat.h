@@ -0,0 +1,210 @@
+#pragma once
+
+#include <bit>
+
+#include "MappedFile.h"
+
+// .mesh container layout, written by assets/gltf.py (Mesh.pack)
+//
+//   Header | Section x numSections | section data...
+//
+// Sections may appear in any order and are looked up through the table.
+// Each one starts on a SECTION_ALIGNMENT boundary, and index/vertex streams on a STREAM_ALIGNMENT
+// boundary so they can be copied as-is into the MeshStore buffers.
+// Files that do not start with MAGIC are legacy meshes, see Mesh3D::ReadLegacy.
+namespace MeshFormat
+{
+inline constexpr uint32_t MAGIC = 0x4853454D;  // "MESH"
+inline constexpr uint32_t VERSION = 1;
+
+inline constexpr size_t SECTION_ALIGNMENT = 16;
+inline constexpr size_t STREAM_ALIGNMENT = 256;
+
+enum class SectionType : uint32_t {
+  Indices = 1,             // uint32_t
+  Positions,               // XMFLOAT3
+  Normals,                 // XMFLOAT3
+  Tangents,                // XMFLOAT4
+  UVs,                     // XMFLOAT2
+  BlendWeightsAndIndices,  // XMUINT2
+  Subsets,                 // Subset
+  Strings,                 // utf-8, referenced by Subset::materialName*
+  Meshlets,                // MeshletData, cull data included. materialIndex holds the subset index
+  MeshletVertexIndices,    // uint8_t
+  MeshletPrimitives,       // MeshletTriangle
+  Bounds,                  // BoundingSphere
+  Transform,               // Transform
+  CacheKey,                // CacheKey, only in .meshcache files
+};
+
+enum Flags : uint32_t {
+  Skinned = 1 << 0,
+};
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numVerts;
+  uint32_t numIndices;
+  uint32_t numSubsets;
+  uint32_t numSections;
+  uint32_t flags;
+  uint32_t _pad;
+};
+static_assert(sizeof(Header) == 32);
+
+struct Section {
+  SectionType type;
+  uint32_t elementSize;
+  uint64_t offset;  // from the start of the file
+  uint64_t size;    // in bytes
+};
+static_assert(sizeof(Section) == 24);
+
+struct Subset {
+  uint32_t start, count;
+  uint32_t materialNameOffset, materialNameLength;
+};
+static_assert(sizeof(Subset) == 16);
+
+struct Transform {
+  int32_t parentBone;
+  DirectX::XMFLOAT3 scale;
+  DirectX::XMFLOAT3 translation;
+  DirectX::XMFLOAT4 rotation;
+};
+static_assert(sizeof(Transform) == 44);
+
+// identifies the source a .meshcache file was built from
+struct CacheKey {
+  uint64_t sourceHash;
+  uint32_t builderVersion;
+  uint32_t maxVerts;
+  uint32_t maxPrims;
+  uint32_t _pad;
+
+  bool operator==(const CacheKey&) const = default;
+};
+static_assert(sizeof(CacheKey) == 24);
+
+// One 64-bit word at a time, mixed like the MurmurHash3 body and finalizer: every input bit reaches every
+// output bit, so flips in several words cannot cancel out the way a plain xor and multiply lets them
+inline uint64_t Hash(std::span<const uint8_t> bytes, uint64_t hash = 0xcbf29ce484222325ull)
+{
+  constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+  constexpr uint64_t c2 = 0x4cf5ad432745937full;
+
+  auto mixWord = [](uint64_t word) { return std::rotl(word * c1, 31) * c2; };
+
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes.data() + i, sizeof(word));
+    hash ^= mixWord(word);
+    hash = std::rotl(hash, 27) * 5 + 0x52dce729;
+  }
+  if (i < bytes.size()) {
+    uint64_t tail = 0;
+    memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    hash ^= mixWord(tail);
+  }
+
+  hash ^= bytes.size();
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+inline bool IsContainer(const MappedFile& file)
+{
+  return file.Size() >= sizeof(Header) && file.View<uint32_t>(0, 1)[0] == MAGIC;
+}
+
+// Random access to the sections of a mapped container
+class Reader
+{
+public:
+  explicit Reader(const MappedFile& file) : m_File(file)
+  {
+    assert(IsContainer(file));
+
+    m_Header = file.View<Header>(0, 1)[0];
+    m_Sections = file.View<Section>(sizeof(Header), m_Header.numSections);
+
+    if (m_Header.version > VERSION) {
+      throw std::runtime_error("Unsupported mesh version");
+    }
+  }
+
+  const Header& GetHeader() const { return m_Header; }
+
+  bool Has(SectionType type) const { return Find(type) != nullptr; }
+
+  // empty span when the section is missing
+  template <typename T>
+  std::span<const T> Get(SectionType type) const
+  {
+    const Section* section = Find(type);
+    if (!section) return {};
+
+    assert(section->elementSize == sizeof(T));
+    assert(section->size % sizeof(T) == 0);
+
+    return m_File.View<T>(section->offset, section->size / sizeof(T));
+  }
+
+private:
+  const Section* Find(SectionType type) const
+  {
+    for (const auto& section : m_Sections) {
+      if (section.type == type) return &section;
+    }
+
+    return nullptr;
+  }
+
+  const MappedFile& m_File;
+  Header m_Header;
+  std::span<const Section> m_Sections;
+};
+
+// Lays out sections and writes a container to disk.
+// Data passed to Add must stay alive until Save returns.
+class Writer
+{
+public:
+  template <typename T>
+  void Add(SectionType type, const T* data, size_t count)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    m_Sections.push_back({
+        .type = type,
+        .elementSize = sizeof(T),
+        .bytes = std::as_bytes(std::span(data, count)),
+    });
+  }
+
+  template <typename T>
+  void Add(SectionType type, const std::vector<T>& data)
+  {
+    Add(type, data.data(), data.size());
+  }
+
+  bool Save(const std::filesystem::path& filename, uint32_t numVerts, uint32_t numIndices, uint32_t numSubsets,
+            uint32_t flags) const;
+
+private:
+  struct PendingSection {
+    SectionType type;
+    uint32_t elementSize;
+    std::span<const std::byte> bytes;
+  };
+
+  std::vector<PendingSection> m_Sections;
+};
+}  // namespace MeshFormat
@@ -0,0 +1,348 @@
+#include "stdafx_assets.h"
+
+#include "PoseBatch.h"
+
+#include "Jobs.h"
+#include "Lanes.h"
+
+using namespace DirectX;
+
+namespace PoseBatch
+{
+// one instance per lane
+static constexpr size_t WIDTH = Lanes::WIDTH;
+
+// Affine matrix, one per lane: rows 0 to 2 are the rotation and scale, row 3 the translation.
+// The last column is always (0, 0, 0, 1) and is not stored
+struct Affine {
+  Lanes m[4][3];
+};
+
+// keys of one bone for every lane, laid out to be loaded straight into Lanes
+struct Keys {
+  float scale[2][3][WIDTH];
+  float translation[2][3][WIDTH];
+  float rotation[2][4][WIDTH];
+  float lerp[WIDTH];
+  float rest[WIDTH];               // 1 for lanes without a track, 0 otherwise
+  float restTransform[4][3][WIDTH];  // zero for lanes with a track
+  bool anyRest, allRest;
+};
+
+size_t Width() { return WIDTH; }
+
+const char* InstructionSet() { return Lanes::NAME; }
+
+Instance Prepare(AnimationInfo& info, float time, const Skin* skin, std::span<XMFLOAT4X4> out)
+{
+  const Animation& animation = *info.animation;
+
+  if (info.cursors.size() != animation.tracks.size()) info.cursors.assign(animation.tracks.size(), 0);
+
+  auto& globalTransforms = info.globalTransforms[skin];
+  globalTransforms.resize(skin->NumBones());
+
+  if (out.empty()) {
+    auto& boneTransforms = info.boneTransforms[skin];
+    boneTransforms.resize(skin->header.numJoints);
+    out = boneTransforms;
+  }
+  assert(out.size() >= skin->header.numJoints);
+
+  return {&animation, info.ClipTime(time + info.timeOffset), info.cursors.data(), out.data(), globalTransforms.data()};
+}
+
+// same key selection as Animation::Interpolate
+static void GatherLane(Keys& keys, size_t lane, const Instance& instance, const Skin& skin, size_t bone)
+{
+  const Animation& animation = *instance.animation;
+  int trackIndex = animation.TrackIndex(skin.boneIds[bone]);
+
+  if (trackIndex < 0) {
+    const XMFLOAT4X4& rest = skin.restTransforms[bone];
+
+    for (size_t k = 0; k < 2; k++) {
+      for (size_t c = 0; c < 3; c++) {
+        keys.scale[k][c][lane] = 1.f;
+        keys.translation[k][c][lane] = 0.f;
+      }
+      for (size_t c = 0; c < 4; c++) {
+        keys.rotation[k][c][lane] = c == 3 ? 1.f : 0.f;
+      }
+    }
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 3; c++) {
+        keys.restTransform[r][c][lane] = rest.m[r][c];
+      }
+    }
+    keys.lerp[lane] = 0.f;
+    keys.rest[lane] = 1.f;
+    keys.anyRest = true;
+
+    return;
+  }
+
+  const Animation::Track& track = animation.tracks[trackIndex];
+  float curTime = instance.time;
+
+  size_t key = animation.FindKey(track, curTime, instance.cursors ? instance.cursors + trackIndex : nullptr);
+  Animation::Keyframe frames[2];
+  frames[0] = animation.GetKey(trackIndex, key);
+  float lerp = 0.f;
+
+  // before the first key or after the last one
+  if (curTime <= frames[0].time || key + 1 == track.numKeys) {
+    frames[1] = frames[0];
+  } else {
+    frames[1] = animation.GetKey(trackIndex, key + 1);
+    lerp = (curTime - frames[0].time) / (frames[1].time - frames[0].time);
+  }
+
+  for (size_t k = 0; k < 2; k++) {
+    const XMFLOAT3& s = frames[k].scale;
+    const XMFLOAT3& t = frames[k].translation;
+    const XMFLOAT4& q = frames[k].rotation;
+
+    keys.scale[k][0][lane] = s.x;
+    keys.scale[k][1][lane] = s.y;
+    keys.scale[k][2][lane] = s.z;
+    keys.translation[k][0][lane] = t.x;
+    keys.translation[k][1][lane] = t.y;
+    keys.translation[k][2][lane] = t.z;
+    keys.rotation[k][0][lane] = q.x;
+    keys.rotation[k][1][lane] = q.y;
+    keys.rotation[k][2][lane] = q.z;
+    keys.rotation[k][3][lane] = q.w;
+  }
+  for (size_t r = 0; r < 4; r++) {
+    for (size_t c = 0; c < 3; c++) {
+      keys.restTransform[r][c][lane] = 0.f;
+    }
+  }
+  keys.lerp[lane] = lerp;
+  keys.rest[lane] = 0.f;
+  keys.allRest = false;
+}
+
+// Normalized lerp with the interpolation factor adjusted so the angle moves at almost constant speed,
+// from "Approximating slerp" (Arseny Kapoulkine). Stays within about 1e-3 of the slerp result even for
+// keys half a turn apart, much closer for keys sampled at animation rates, and needs no trigonometry.
+static void Nlerp(const Lanes (&a)[4], const Lanes (&b)[4], Lanes t, Lanes (&out)[4])
+{
+  Lanes cosAngle = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+  Lanes d = Abs(cosAngle);
+
+  Lanes A = Lanes::Set(1.0904f) +
+            d * (Lanes::Set(-3.2452f) + d * (Lanes::Set(3.55645f) - d * Lanes::Set(1.43519f)));
+  Lanes B = Lanes::Set(0.848013f) + d * (Lanes::Set(-1.06021f) + d * Lanes::Set(0.215638f));
+
+  Lanes half = Lanes::Set(0.5f);
+  Lanes k = A * (t - half) * (t - half) + B;
+  Lanes ot = t + t * (t - half) * (t - Lanes::Set(1.f)) * k;
+
+  // shortest path, like XMQuaternionSlerp
+  Lanes wa = Lanes::Set(1.f) - ot;
+  Lanes wb = CopySign(ot, cosAngle);
+
+  Lanes q[4];
+  for (size_t c = 0; c < 4; c++) {
+    q[c] = a[c] * wa + b[c] * wb;
+  }
+
+  Lanes invLength = Lanes::Set(1.f) / Sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  for (size_t c = 0; c < 4; c++) {
+    out[c] = q[c] * invLength;
+  }
+}
+
+// scale, then rotation, then translation, like XMMatrixAffineTransformation without origin
+static Affine LocalTransform(const Keys& keys)
+{
+  Affine local;
+
+  if (keys.allRest) {
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 3; c++) {
+        local.m[r][c] = Lanes::Load(keys.restTransform[r][c]);
+      }
+    }
+    return local;
+  }
+
+  Lanes t = Lanes::Load(keys.lerp);
+  Lanes s[3], tr[3], qa[4], qb[4], q[4];
+
+  for (size_t c = 0; c < 3; c++) {
+    Lanes s0 = Lanes::Load(keys.scale[0][c]);
+    Lanes t0 = Lanes::Load(keys.translation[0][c]);
+    s[c] = s0 + (Lanes::Load(keys.scale[1][c]) - s0) * t;
+    tr[c] = t0 + (Lanes::Load(keys.translation[1][c]) - t0) * t;
+  }
+  for (size_t c = 0; c < 4; c++) {
+    qa[c] = Lanes::Load(keys.rotation[0][c]);
+    qb[c] = Lanes::Load(keys.rotation[1][c]);
+  }
+  Nlerp(qa, qb, t, q);
+
+  Lanes one = Lanes::Set(1.f);
+  Lanes two = Lanes::Set(2.f);
+  Lanes x2 = q[0] * two, y2 = q[1] * two, z2 = q[2] * two;
+  Lanes xx = q[0] * x2, yy = q[1] * y2, zz = q[2] * z2;
+  Lanes xy = q[0] * y2, xz = q[0] * z2, yz = q[1] * z2;
+  Lanes xw = q[3] * x2, yw = q[3] * y2, zw = q[3] * z2;
+
+  // XMMatrixRotationQuaternion, each row scaled
+  local.m[0][0] = (one - yy - zz) * s[0];
+  local.m[0][1] = (xy + zw) * s[0];
+  local.m[0][2] = (xz - yw) * s[0];
+  local.m[1][0] = (xy - zw) * s[1];
+  local.m[1][1] = (one - xx - zz) * s[1];
+  local.m[1][2] = (yz + xw) * s[1];
+  local.m[2][0] = (xz + yw) * s[2];
+  local.m[2][1] = (yz - xw) * s[2];
+  local.m[2][2] = (one - xx - yy) * s[2];
+  local.m[3][0] = tr[0];
+  local.m[3][1] = tr[1];
+  local.m[3][2] = tr[2];
+
+  // lanes without a track have an identity transform from the keys, swap in the rest pose
+  if (keys.anyRest) {
+    Lanes keep = one - Lanes::Load(keys.rest);
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 3; c++) {
+        local.m[r][c] = local.m[r][c] * keep + Lanes::Load(keys.restTransform[r][c]);
+      }
+    }
+  }
+
+  return local;
+}
+
+// a * b, both affine
+static Affine Multiply(const Affine& a, const Affine& b)
+{
+  Affine result;
+
+  for (size_t r = 0; r < 4; r++) {
+    for (size_t c = 0; c < 3; c++) {
+      result.m[r][c] = a.m[r][0] * b.m[0][c] + a.m[r][1] * b.m[1][c] + a.m[r][2] * b.m[2][c];
+    }
+  }
+  for (size_t c = 0; c < 3; c++) {
+    result.m[3][c] = result.m[3][c] + b.m[3][c];
+  }
+
+  return result;
+}
+
+// globals is scratch for the NumBones global transforms
+static void EvaluateGroup(const Skin& skin, std::span<const Instance> group, std::span<Affine> globals)
+{
+  const size_t numBones = skin.NumBones();
+
+  // lanes past the end of the group replay the first instance, without touching its cursors
+  std::array<Instance, WIDTH> lanes;
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    lanes[lane] = lane < group.size() ? group[lane] : Instance{group[0].animation, group[0].time, nullptr};
+  }
+
+  Keys keys;
+
+  // parents come first, their global transform is always ready
+  for (size_t bone = 0; bone < numBones; bone++) {
+    keys.anyRest = false;
+    keys.allRest = true;
+    for (size_t lane = 0; lane < WIDTH; lane++) {
+      GatherLane(keys, lane, lanes[lane], skin, bone);
+    }
+
+    Affine local = LocalTransform(keys);
+    int parent = skin.parentIndices[bone];
+
+    globals[bone] = parent < 0 ? local : Multiply(local, globals[parent]);
+  }
+
+  alignas(32) float values[4][3][WIDTH];
+
+  bool keepGlobals = std::any_of(group.begin(), group.end(), [](const Instance& i) { return i.globalTransforms; });
+
+  for (size_t bone = 0; keepGlobals && bone < numBones; bone++) {
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 3; c++) {
+        globals[bone].m[r][c].Store(values[r][c]);
+      }
+    }
+
+    for (size_t lane = 0; lane < group.size(); lane++) {
+      if (!group[lane].globalTransforms) continue;
+
+      auto v = [&](size_t r, size_t c) { return values[r][c][lane]; };
+      group[lane].globalTransforms[bone] = XMMATRIX(
+          XMVectorSet(v(0, 0), v(0, 1), v(0, 2), 0.f), XMVectorSet(v(1, 0), v(1, 1), v(1, 2), 0.f),
+          XMVectorSet(v(2, 0), v(2, 1), v(2, 2), 0.f), XMVectorSet(v(3, 0), v(3, 1), v(3, 2), 1.f));
+    }
+  }
+
+  // transpose(inverseBindMatrix * global). The inverse bind matrix is shared by all lanes
+  for (size_t joint = 0; joint < skin.header.numJoints; joint++) {
+    const Affine& global = globals[skin.jointBones[joint]];
+    const XMFLOAT4X4& inverseBind = skin.inverseBindMatrices[joint];
+
+    for (size_t r = 0; r < 4; r++) {
+      Lanes i0 = Lanes::Set(inverseBind.m[r][0]);
+      Lanes i1 = Lanes::Set(inverseBind.m[r][1]);
+      Lanes i2 = Lanes::Set(inverseBind.m[r][2]);
+      Lanes i3 = Lanes::Set(inverseBind.m[r][3]);
+
+      for (size_t c = 0; c < 3; c++) {
+        Lanes value = i0 * global.m[0][c] + i1 * global.m[1][c] + i2 * global.m[2][c] + i3 * global.m[3][c];
+        value.Store(values[r][c]);
+      }
+    }
+
+    for (size_t lane = 0; lane < group.size(); lane++) {
+      XMFLOAT4X4& out = group[lane].boneTransforms[joint];
+
+      for (size_t r = 0; r < 4; r++) {
+        for (size_t c = 0; c < 3; c++) {
+          out.m[c][r] = values[r][c][lane];
+        }
+        out.m[3][r] = inverseBind.m[r][3];
+      }
+    }
+  }
+}
+
+void Evaluate(const Skin& skin, std::span<const Instance> instances)
+{
+  // groups share nothing but the skin and the clips, a few of them per job keep the scheduling cost low.
+  // One job per thread at most, each with its own part of the scratch of the caller: it is sized by the first
+  // calls, whichever threads end up running the jobs
+  constexpr size_t GROUPS_PER_JOB = 4;
+
+  const size_t numGroups = DivRoundUp(instances.size(), WIDTH);
+  const size_t numJobs = std::min(DivRoundUp(numGroups, GROUPS_PER_JOB), Jobs::NumWorkers() + 1);
+  const size_t numBones = skin.NumBones();
+
+  thread_local std::vector<Affine> scratch;
+  if (scratch.size() < numJobs * numBones) scratch.resize(numJobs * numBones);
+
+  // a single capture, small enough for std::function to store in place
+  struct Work {
+    const Skin& skin;
+    std::span<const Instance> instances;
+    Affine* scratch;  // the one of this thread, jobs run on others
+    size_t numGroups, numJobs, numBones;
+  } work{skin, instances, scratch.data(), numGroups, numJobs, numBones};
+
+  Jobs::ParallelFor(numJobs, [&work](size_t job) {
+    std::span<Affine> globals(work.scratch + job * work.numBones, work.numBones);
+
+    for (size_t group = work.numGroups * job / work.numJobs; group < work.numGroups * (job + 1) / work.numJobs;
+         group++) {
+      size_t first = group * WIDTH;
+      EvaluateGroup(work.skin, work.instances.subspan(first, std::min(WIDTH, work.instances.size() - first)), globals);
+    }
+  });
+}
+}  // namespace PoseBatch
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Pose evaluation of many instances of one skin at once, for crowds.
+// Each SIMD lane is one instance: bones are walked once in parent order for the whole group,
+// keys are looked up per lane, then interpolation, TRS composition and matrix products run on all lanes.
+// Rotations use a corrected nlerp instead of a slerp, see PoseBatch.cpp for the error bound.
+namespace PoseBatch
+{
+struct Instance {
+  const Animation* animation;
+  float time;                             // clip time, see AnimationInfo::ClipTime
+  uint32_t* cursors;                      // per track, or null to always search
+  DirectX::XMFLOAT4X4* boneTransforms;    // numJoints, same layout as Animation::BoneTransforms
+  DirectX::XMMATRIX* globalTransforms;    // numBones, or null when not needed
+};
+
+// instances evaluated together, 8 with AVX2, 4 with SSE
+size_t Width();
+
+const char* InstructionSet();
+
+// sizes the cursors and outputs of info for skin, results end up in info.boneTransforms[skin], or in out
+// when given (numJoints matrices owned by the caller). Only the first call for an info and skin allocates
+Instance Prepare(AnimationInfo& info, float time, const Skin* skin, std::span<DirectX::XMFLOAT4X4> out = {});
+
+// instances may play different animations, each output is written once.
+// Groups of instances are spread over the job workers
+void Evaluate(const Skin& skin, std::span<const Instance> instances);
+}  // namespace PoseBatch
@@ -0,0 +1,47 @@
+#include "stdafx_assets.h"
+
+#include "PoseCache.h"
+
+size_t PoseCache::Hash(const Key& key)
+{
+  size_t hash = std::hash<const void*>()(key.animation);
+  hash = hash * 31 + std::hash<const void*>()(key.skin);
+  hash = hash * 31 + std::hash<float>()(key.clipTime);
+
+  return hash;
+}
+
+void PoseCache::Grow()
+{
+  std::vector<Slot> slots(std::max<size_t>(m_Slots.size() * 2, 64));
+  std::swap(slots, m_Slots);
+
+  const size_t mask = m_Slots.size() - 1;
+  for (const Slot& slot : slots) {
+    if (slot.generation != m_Generation) continue;
+
+    size_t i = Hash(slot.key) & mask;
+    while (m_Slots[i].generation == m_Generation) i = (i + 1) & mask;
+    m_Slots[i] = slot;
+  }
+}
+
+PoseCache::Entry PoseCache::Find(const AnimationInfo& info, float time, const Skin* skin)
+{
+  float clipTime = info.ClipTime(time + Offset(info));
+
+  if ((m_NumPoses + 1) * 2 > m_Slots.size()) Grow();
+
+  const Key key{info.animation.get(), skin, clipTime};
+  const size_t mask = m_Slots.size() - 1;
+
+  // linear probing, up to the first slot not used this frame
+  size_t i = Hash(key) & mask;
+  for (; m_Slots[i].generation == m_Generation; i = (i + 1) & mask) {
+    if (m_Slots[i].key == key) return {m_Slots[i].index, false, clipTime};
+  }
+
+  m_Slots[i] = {key, m_NumPoses, m_Generation};
+
+  return {m_NumPoses++, true, clipTime};
+}
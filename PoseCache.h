@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Poses requested during one frame, so that instances playing the same animation on the same skin at the
+// same clip time share a single evaluation (and a single range of bone matrices).
+// Time offsets (AnimationInfo::timeOffset) are rounded to a bucket first, which lets a crowd that is out of
+// phase share a handful of poses instead of needing one each.
+// The table is open addressed and cleared by bumping a generation, so once it has grown to the size of
+// the scene, frames do not allocate.
+class PoseCache
+{
+public:
+  struct Entry {
+    size_t index;    // poses are numbered in the order they were first requested since Clear
+    bool first;      // no instance asked for this pose before, the caller evaluates it
+    float clipTime;  // time to evaluate the pose at, for every instance sharing it
+  };
+
+  // bucket in seconds, 0 only shares instances with equal offsets
+  explicit PoseCache(float bucket = 0.f) : m_Bucket(bucket) {}
+
+  float Bucket() const { return m_Bucket; }
+
+  // the time offset of info rounded to the bucket, instances with the same one share their poses
+  float Offset(const AnimationInfo& info) const
+  {
+    return m_Bucket > 0.f ? std::round(info.timeOffset / m_Bucket) * m_Bucket : info.timeOffset;
+  }
+
+  // once per frame, before the first Find
+  void Clear()
+  {
+    m_Generation++;
+    m_NumPoses = 0;
+  }
+
+  Entry Find(const AnimationInfo& info, float time, const Skin* skin);
+
+  size_t NumPoses() const { return m_NumPoses; }
+
+private:
+  struct Key {
+    const Animation* animation;
+    const Skin* skin;
+    float clipTime;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct Slot {
+    Key key;
+    size_t index;
+    uint64_t generation = 0;  // the slot is empty unless this is m_Generation
+  };
+
+  static size_t Hash(const Key& key);
+
+  // keeps the table at most half full
+  void Grow();
+
+  std::vector<Slot> m_Slots;  // power of two
+  uint64_t m_Generation = 1;
+  size_t m_NumPoses = 0;
+  float m_Bucket;
+};
@@ -7,8 +7,15 @@
 
 #include "shaders/Shared.h"
 
+#include "AnimationLod.h"
 #include "Camera.h"
+#include "Jobs.h"
 #include "Mesh.h"
+#include "PoseBatch.h"
+#include "PoseCache.h"
+#include "Stats.h"
+#include "Streaming.h"
+#include "VertexPacking.h"
 
 #include "InteropD3D12.h"
 
@@ -19,6 +26,8 @@ namespace Renderer
 // ========== Constants
 
 static constexpr size_t MESH_INSTANCE_COUNT = 10'000;
+// while meshes stream in, those that arrived are added to the acceleration structures every this many frames
+static constexpr UINT ACCELERATION_STRUCTURES_BUILD_INTERVAL = 8;
 
 // ========== Enums
 
@@ -60,6 +69,8 @@ struct MeshInstance {
   UINT rtInstanceOffset;
   UINT64 blasBufferAddress = 0;
 
+  std::vector<UINT> materialIndices;  // per subset
+
   std::weak_ptr<SkinnedMeshInstance> skinnedMeshInstance;
   std::shared_ptr<Mesh3D> mesh = nullptr;
 };
@@ -88,8 +99,8 @@ struct SkinnedMeshInstance {
         .firstSkinnedPosition = meshInstance->data.firstPosition,
         .firstNormal = offsets.baseNormalsBuffer,
         .firstSkinnedNormal = meshInstance->data.firstNormal,
-        .firstTangent = meshInstance->data.firstTangent,
-        .firstSkinnedTangent = offsets.baseTangentsBuffer,
+        .firstTangent = offsets.baseTangentsBuffer,
+        .firstSkinnedTangent = meshInstance->data.firstTangent,
         .firstBWI = offsets.blendWeightsAndIndicesBuffer,
         .firstBoneMatrix = offsets.boneMatricesBuffer,
         .numVertices = numVertices,
@@ -102,6 +113,9 @@ struct Scene {
     Model3D* model;
     std::vector<std::shared_ptr<MeshInstance>> meshInstances;
     std::vector<std::shared_ptr<SkinnedMeshInstance>> skinnedMeshInstances;  // should be per Skin, not per Model...
+    std::unordered_map<const Skin*, UINT> boneMatrices;  // first reserved bone matrix per skin, shared by its meshes
+
+    void Add(std::shared_ptr<MeshInstance> mi);
   };
 
   std::vector<SceneNode> nodes;
@@ -112,7 +126,7 @@ struct Scene {
   std::unordered_map<std::wstring, std::vector<std::shared_ptr<MeshInstance>>> meshInstanceMap;
   UINT numMeshInstances = 0;
   std::vector<std::shared_ptr<SkinnedMeshInstance>> skinnedMeshInstances;
-  UINT numBoneMatrices = 0;
+  UINT numBoneMatrices = 0;  // reserved, one range per node and skin
 
   // RayTracing specific
   // the following contains only first mesh instance of each mesh
@@ -122,6 +136,8 @@ struct Scene {
   std::vector<std::shared_ptr<IssouRHI::AccelerationStructure>> blasBuffers;
   std::shared_ptr<IssouRHI::AccelerationStructure> tlasBuffer;
   std::vector<IssouRHI::TopLevelInstanceDesc> rtInstanceDescriptors;
+  bool accelerationStructuresDirty = false;  // meshes were streamed in since the last build
+  UINT framesSinceBuild = ACCELERATION_STRUCTURES_BUILD_INTERVAL;  // the first build is not held back
 
   Camera* camera;
 };
@@ -146,6 +162,11 @@ struct FrameContext {
   std::shared_ptr<IssouRHI::Buffer> frameConstantBuffer;
   std::shared_ptr<IssouRHI::Buffer> timestampReadBackBuffer;
 
+  // Replaced while this frame was recorded, and the instance descriptors its TLAS build reads. Earlier frames
+  // may still trace the old TLAS: they are all done once this context comes around again
+  std::shared_ptr<IssouRHI::AccelerationStructure> retiredTlasBuffer;
+  std::shared_ptr<IssouRHI::Buffer> rtInstanceDescBuffer;
+
   void UpdateFrameConstants()
   {
     frameConstantBuffer->Write(IssouRHI::FullBufferRange, &frameConstants);
@@ -155,6 +176,8 @@ struct FrameContext {
   {
     frameConstantBuffer.reset();
     timestampReadBackBuffer.reset();
+    retiredTlasBuffer.reset();
+    rtInstanceDescBuffer.reset();
   }
 };
 
@@ -221,6 +244,15 @@ struct MeshStore {
     return offset;
   }
 
+  UINT WritePackedVertices(const void* data, size_t size)
+  {
+    UINT offset = m_CurrentOffsets.packedVerticesBuffer;
+    m_VertexPacked->Write({offset, size}, data);
+    m_CurrentOffsets.packedVerticesBuffer += static_cast<UINT>(size);
+
+    return offset;
+  }
+
   UINT WriteBWI(const void* data, size_t size)
   {
     UINT offset = m_CurrentOffsets.bwiBuffer;
@@ -313,6 +345,8 @@ struct MeshStore {
         .vertexNormalsBufferId = m_VertexNormals->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(XMFLOAT3)}),
         .vertexTangentsBufferId = m_VertexTangents->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(XMFLOAT4)}),
         .vertexUVsBufferId = m_VertexUVs->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(XMFLOAT2)}),
+        // never read without packing, no instance points into it then
+        .vertexPackedBufferId = m_VertexPacked ? m_VertexPacked->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(PackedVertex)}) : UINT_MAX,
 
         .meshletsBufferId = m_Meshlets->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(MeshletData)}),
         .meshletVertIndicesBufferId = m_MeshletUniqueIndices->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(UINT)}),
@@ -339,7 +373,7 @@ struct MeshStore {
     return m_Instances[frameIndex]->DescriptorIndex({IssouRHI::BufferAccess::Read, IssouRHI::FullBufferRange, sizeof(MeshInstance::data)});
   }
 
-  void Init(IssouRHI::Device* device)
+  void Init(IssouRHI::Device* device, bool packVertices)
   {
     // TODO: compute worst case scenario from the scene.
     // wait, everyone has more than 8GB VRAM in 2026, right? right?
@@ -391,6 +425,16 @@ struct MeshStore {
       m_VertexUVs = device->CreateBuffer(desc);
     }
 
+    // Packed vertices buffer
+    if (packVertices) {
+      IssouRHI::BufferDesc desc{
+          .label = "Packed vertices Store",
+          .size = numVertices * sizeof(PackedVertex),
+          .usage = IssouRHI::BufferUsage::MapWrite,
+      };
+      m_VertexPacked = device->CreateBuffer(desc);
+    }
+
     // Blend weights/indices buffer
     {
       IssouRHI::BufferDesc desc{
@@ -476,6 +520,7 @@ struct MeshStore {
   std::shared_ptr<IssouRHI::Buffer> m_VertexNormals;
   std::shared_ptr<IssouRHI::Buffer> m_VertexTangents;
   std::shared_ptr<IssouRHI::Buffer> m_VertexUVs;
+  std::shared_ptr<IssouRHI::Buffer> m_VertexPacked;
   std::shared_ptr<IssouRHI::Buffer> m_VertexBlendWeightsAndIndices;
 
   std::shared_ptr<IssouRHI::Buffer> m_VertexIndices;  // needed for BLAS
@@ -495,6 +540,7 @@ struct MeshStore {
     UINT normalsBuffer = 0;
     UINT tangentsBuffer = 0;
     UINT uvsBuffer = 0;
+    UINT packedVerticesBuffer = 0;
     UINT bwiBuffer = 0;
 
     UINT indexBuffer = 0;
@@ -511,11 +557,21 @@ struct MeshStore {
 
     UINT boneMatricesBuffer = 0;
   } m_CurrentOffsets;
+
+  // over the packed meshes
+  struct {
+    size_t numVertices = 0;
+    size_t floatBytes = 0;  // what the float streams would have taken
+    size_t uploadedBytes = 0;  // float positions, kept for the BLAS, and packed vertices
+    VertexPacking::Error maxError;
+  } m_PackingStats;
 };
 
 // ========== Static functions declarations
 
 static void InitFrameResources();
+static void BuildAccelerationStructures(FrameContext* ctx);
+static void ReleaseUploadedGeometry();
 static std::shared_ptr<MeshInstance> LoadMesh3D(std::shared_ptr<Mesh3D> mesh);
 static UINT CreateTexture(std::filesystem::path filename);
 
@@ -525,6 +581,7 @@ static UINT g_Width;
 static UINT g_Height;
 static float g_AspectRatio;
 static bool g_EnableRTShadows = true;
+static bool g_PackVertexStreams = false;
 static float g_SunTime = 0.5f;
 
 static std::wstring g_Title;
@@ -584,6 +641,16 @@ static std::unordered_map<std::wstring, std::shared_ptr<Material>> g_MaterialMap
 static std::unordered_map<std::wstring, std::shared_ptr<IssouRHI::Texture>> g_Textures;
 static Scene g_Scene;
 
+// offsets are shared by instances less than a key apart, at the 30 Hz most clips are sampled at
+static PoseCache g_PoseCache(1.f / 30.f);
+static AnimationLod g_AnimationLod;
+
+// mesh objects loaded since the last ReleaseUploadedGeometry, with their CPU-side bytes per stream at that point
+static std::vector<std::pair<std::shared_ptr<Mesh3D>, std::array<size_t, Mesh3D::NUM_STREAMS>>> g_UploadedMeshes;
+// every mesh object the renderer took the streams reference of. GPU geometry is shared by name, but two models
+// reading the same file each get their own Mesh3D, and each one holds its own streams
+static std::unordered_set<const Mesh3D*> g_TrackedMeshes;
+
 // ========== Public functions
 
 void InitWindow(UINT width, UINT height, std::wstring name)
@@ -610,32 +677,125 @@ void Init(std::unique_ptr<IssouRHI::Device> device)
   InitFrameResources();
 }
 
+void SetPackVertexStreams(bool enable)
+{
+  g_PackVertexStreams = enable;
+}
+
+// Submeshes of a model usually share one skin: they are posed once and read the same bone matrices
+void Scene::SceneNode::Add(std::shared_ptr<MeshInstance> mi)
+{
+  meshInstances.push_back(mi);
+
+  auto smi = mi->skinnedMeshInstance.lock();
+  if (!smi) return;
+
+  auto [it, inserted] = boneMatrices.try_emplace(smi->meshInstance->mesh->skin.get(), 0);
+  if (inserted) {
+    it->second = g_MeshStore.ReserveBoneMatrices(smi->BoneMatricesBufferSize()) / sizeof(XMFLOAT4X4);
+    g_Scene.numBoneMatrices += smi->numBoneMatrices;
+  }
+  smi->offsets.boneMatricesBuffer = it->second;
+
+  skinnedMeshInstances.push_back(smi);
+}
+
 void LoadAssets()
 {
   for (auto& node : g_Scene.nodes) {
     for (auto& mesh : node.model->meshes) {
-      auto mi = LoadMesh3D(mesh);
+      node.Add(LoadMesh3D(mesh));
+    }
+  }
+
+  printf("Bone matrices: %u reserved for %zu skinned meshes\n", g_Scene.numBoneMatrices,
+         g_Scene.skinnedMeshInstances.size());
+
+  if (const auto& stats = g_MeshStore.m_PackingStats; stats.numVertices > 0) {
+    printf("Packed vertices: %zu, %.2f MiB instead of %.2f MiB (%.2f MiB saved)\n", stats.numVertices,
+           ToMiB(stats.uploadedBytes), ToMiB(stats.floatBytes), ToMiB(stats.floatBytes - stats.uploadedBytes));
+    printf("Packed vertices max error: position %f, normal %.3f deg, tangent %.3f deg, uv %f\n",
+           stats.maxError.position, stats.maxError.normal, stats.maxError.tangent, stats.maxError.uv);
+  }
+
+  // every instance is created, later ones of these meshes only need the meshlets which stay resident
+  ReleaseUploadedGeometry();
+
+  // built by the first frame
+  g_Scene.accelerationStructuresDirty = true;
+}
+
+void AppendMesh(Model3D* model, std::shared_ptr<Mesh3D> mesh)
+{
+  auto node = std::find_if(g_Scene.nodes.begin(), g_Scene.nodes.end(), [model](auto& n) { return n.model == model; });
+  if (node == g_Scene.nodes.end()) return;  // the model is not part of the scene
+
+  node->Add(LoadMesh3D(mesh));
+
+  ReleaseUploadedGeometry();
+
+  g_Scene.accelerationStructuresDirty = true;
+}
 
-      node.meshInstances.push_back(mi);
-      if (auto smi = mi->skinnedMeshInstance.lock()) {
-        node.skinnedMeshInstances.push_back(smi);
+// Drops the renderer's reference on the CPU-side streams of the mesh objects loaded since the last call.
+// The BLAS is built from the MeshStore buffers, so only consumers like the collider keep streams alive after this.
+// Meshlets stay: each instance gets its own copy of them, patched with its instance and material indices,
+// so later instances of the mesh (e.g. from AppendMesh) are built from them. They are a fraction of the vertex data
+static void ReleaseUploadedGeometry()
+{
+  if (g_UploadedMeshes.empty()) return;
+
+  std::array<size_t, Mesh3D::NUM_STREAMS> totalBefore{};
+  std::array<size_t, Mesh3D::NUM_STREAMS> totalAfter{};
+
+  for (auto& [mesh, before] : g_UploadedMeshes) {
+    mesh->Release(Mesh3D::ALL_STREAMS & ~Mesh3D::Meshlets);
+    auto after = mesh->ResidentBytes();
+
+    std::string line;
+    for (size_t i = 0; i < Mesh3D::NUM_STREAMS; i++) {
+      totalBefore[i] += before[i];
+      totalAfter[i] += after[i];
+
+      if (before[i] > 0) {
+        line += std::format(" {} {:.1f}->{:.1f}", Mesh3D::StreamName(i), before[i] / 1024.0, after[i] / 1024.0);
       }
     }
+
+    if (Mesh3D::verbose) {
+      printf("%s CPU geometry (KiB):%s\n", mesh->name.string().c_str(), line.c_str());
+    }
   }
 
-  // RayTracing acceleration structures setup
+  size_t before = 0, after = 0;
+  printf("CPU geometry of %zu meshes (MiB):", g_UploadedMeshes.size());
+  for (size_t i = 0; i < Mesh3D::NUM_STREAMS; i++) {
+    printf(" %s %.2f->%.2f", Mesh3D::StreamName(i), ToMiB(totalBefore[i]), ToMiB(totalAfter[i]));
+    before += totalBefore[i];
+    after += totalAfter[i];
+  }
+  printf(", total %.2f->%.2f\n", ToMiB(before), ToMiB(after));
+
+  g_UploadedMeshes.clear();
+}
+
+// Builds the BLAS of meshes that do not have one yet, and rebuilds the TLAS, submitted ahead of the frame of ctx
+// on the same queue. Nothing waits: the old TLAS and the upload buffer are kept by ctx until it is reused
+static void BuildAccelerationStructures(FrameContext* ctx)
+{
   auto queue = g_Device->GetQueue();
   auto encoder = queue->CreateCommandEncoder();
 
   // BLAS creation
   {
     const size_t numMeshes = g_Scene.uniqueMeshInstances.size();
+    const size_t numBuilt = g_Scene.blasBuffers.size();
 
     std::vector<IssouRHI::AccelerationStructureDesc> bottomLevelInputs(numMeshes);
 
     g_Scene.blasBuffers.resize(numMeshes);
 
-    for (size_t i = 0; i < numMeshes; i++) {
+    for (size_t i = numBuilt; i < numMeshes; i++) {
       auto& mi = g_Scene.uniqueMeshInstances[i];
       auto& mesh = mi->mesh;
 
@@ -676,6 +836,7 @@ void LoadAssets()
 
   // Fill rtInstanceBuffer
   {
+    g_Scene.rtInstanceDescriptors.clear();
     g_Scene.rtInstanceDescriptors.reserve(g_Scene.numMeshInstances);
 
     for (auto& node : g_Scene.nodes) {
@@ -685,6 +846,11 @@ void LoadAssets()
       for (auto& mi : node.meshInstances) {
         if (mi->mesh->Skinned()) continue;
 
+        // instance of a mesh whose BLAS was built before this instance streamed in
+        if (mi->blasBufferAddress == 0) {
+          mi->blasBufferAddress = g_Scene.meshInstanceMap[mi->mesh->name][0]->blasBufferAddress;
+        }
+
         XMMATRIX world = mi->mesh->LocalTransformMatrix() * modelMat;
 
         IssouRHI::TopLevelInstanceDesc desc{};
@@ -701,8 +867,21 @@ void LoadAssets()
     }
   }
 
+  g_Scene.accelerationStructuresDirty = false;
+  g_Scene.framesSinceBuild = 0;
+
+  // earlier frames in flight may still trace it
+  ctx->retiredTlasBuffer = std::move(g_Scene.tlasBuffer);
+
+  // nothing streamed in yet
+  if (g_Scene.rtInstanceDescriptors.empty()) {
+    IssouRHI::CommandBuffer* cb[] = {encoder->Finish()};
+    queue->Submit(cb);
+    return;
+  }
+
   // RT instance descriptors buffer
-  std::shared_ptr<IssouRHI::Buffer> rtInstanceDescBuffer;
+  auto& rtInstanceDescBuffer = ctx->rtInstanceDescBuffer;
   {
     IssouRHI::BufferDesc desc{
         .label = "RT Instance Desc Buffer",
@@ -741,7 +920,6 @@ void LoadAssets()
 
   IssouRHI::CommandBuffer* cb[] = {encoder->Finish()};
   queue->Submit(cb);
-  queue->WaitForAll();
 }
 
 static void Update(FrameContext* ctx, float time)
@@ -754,10 +932,15 @@ static void Update(FrameContext* ctx, float time)
     ctx->frameConstants.TwoOverScreenSize = {2.0f / static_cast<float>(g_Width), 2.0f / static_cast<float>(g_Height)};
   }
 
+  UINT numUploadedBoneMatrices = 0;
+
   // Per object constant buffer
   {
-    std::vector<MeshInstanceData> tmpInstances(g_Scene.numMeshInstances);
-    std::vector<XMFLOAT4X4> tmpBoneMatrices(g_Scene.numBoneMatrices);
+    // staging kept from frame to frame like everything below: once the scene is loaded, updates do not allocate
+    static std::vector<MeshInstanceData> tmpInstances;
+    static std::vector<XMFLOAT4X4> tmpBoneMatrices;
+    tmpInstances.resize(g_Scene.numMeshInstances);
+    tmpBoneMatrices.resize(g_Scene.numBoneMatrices);
 
     const XMMATRIX projection = XMMatrixPerspectiveFovRH(45.f * (XM_PI / 180.f), g_AspectRatio, 0.1f, 1000.f);
 
@@ -780,28 +963,147 @@ static void Update(FrameContext* ctx, float time)
       XMStoreFloat4(&ctx->frameConstants.FrustumPlanes[i], planes[i]);
     }
 
+    // Poses of every skinned mesh instance. Instances in sync share one evaluation and one range of bone matrices,
+    // the skinning pass is pointed at it. Instances sharing a skin are evaluated together
+    g_PoseCache.Clear();
+    g_AnimationLod.BeginFrame(time);
+    static std::vector<UINT> poseOffsets;                                  // per cached pose, in tmpBoneMatrices
+    static std::vector<std::pair<AnimationInfo*, const Skin*>> poseOwners;  // per cached pose
+    static std::unordered_map<const Skin*, UINT> restPoseOffsets;          // per skin of models without animation
+    static std::vector<std::pair<AnimationInfo*, size_t>> sharedPoses;     // instance, cached pose
+    static std::unordered_map<const Skin*, std::vector<PoseBatch::Instance>> poseBatches;
+    static std::vector<std::pair<AnimationLod::Pose*, UINT>> lodPoseOffsets;  // per LOD pose, far instances
+    static std::vector<std::pair<AnimationInfo*, const Skin*>> lodPoseOwners;  // per LOD pose
+    static std::vector<std::pair<AnimationInfo*, size_t>> sharedLodPoses;      // instance, LOD pose
+    UINT numUsedBoneMatrices = 0;
+
+    // clearing keeps the capacity, and the map nodes of skins seen before
+    poseOffsets.clear();
+    poseOwners.clear();
+    sharedPoses.clear();
+    lodPoseOffsets.clear();
+    lodPoseOwners.clear();
+    sharedLodPoses.clear();
+    for (auto& [skin, offset] : restPoseOffsets) offset = UINT_MAX;
+    for (auto& [skin, instances] : poseBatches) instances.clear();
+
+    const XMVECTOR cameraPos = XMLoadFloat3(&ctx->frameConstants.CameraWS);
+
     for (auto& node : g_Scene.nodes) {
       auto model = node.model;
+      float distance = XMVectorGetX(XMVector3Length(model->WorldMatrix().r[3] - cameraPos));
+      bool hasParentedMeshes =
+          std::any_of(node.meshInstances.begin(), node.meshInstances.end(), [](auto& mi) { return mi->mesh->parentBone > -1; });
+      for (auto& smi : node.skinnedMeshInstances) {
+        const Skin* skin = smi->meshInstance->mesh->skin.get();
+        assert(skin && smi->numBoneMatrices == skin->header.numJoints);
+
+        if (!model->HasCurrentAnimation()) {
+          UINT& offset = restPoseOffsets.try_emplace(skin, UINT_MAX).first->second;
+          if (offset == UINT_MAX) {
+            offset = numUsedBoneMatrices;
+            numUsedBoneMatrices += smi->numBoneMatrices;
+
+            // the bind pose: inverse bind times global bind transform is identity for every joint.
+            // written every frame, the range held another pose last frame
+            XMFLOAT4X4 identity;
+            XMStoreFloat4x4(&identity, XMMatrixIdentity());
+            std::fill_n(tmpBoneMatrices.data() + offset, smi->numBoneMatrices, identity);
+          }
 
-      if (model->HasCurrentAnimation()) {
-        for (auto& [k, skin] : model->skins) {
-          std::vector<XMFLOAT4X4> matrices = model->currentAnimation.BoneTransforms(time, skin.get());
+          smi->offsets.boneMatricesBuffer = offset;
+          continue;
+        }
 
-          for (auto& smi : node.skinnedMeshInstances) {
-            // TODO: should reuse bone matrice buffer for meshes of same model which share skin
-            // TODO: should also update the collision data...
-            std::copy(matrices.begin(), matrices.end(), tmpBoneMatrices.begin() + smi->offsets.boneMatricesBuffer);
+        auto& info = model->currentAnimation;
+
+        // far instances in sync share a LOD pose, evaluated straight into it when due, copied or blended to the
+        // bone matrices below
+        if (auto lodPose = g_AnimationLod.Find(info, skin, distance, g_PoseCache); lodPose.pose) {
+          if (lodPose.first) {
+            if (lodPose.pose->NeedsEvaluation()) {
+              auto instance = PoseBatch::Prepare(info, time, skin, {lodPose.pose->Target(), smi->numBoneMatrices});
+              instance.time = lodPose.pose->Time();
+              poseBatches[skin].push_back(instance);
+            }
+
+            lodPoseOffsets.push_back({lodPose.pose, numUsedBoneMatrices});
+            lodPoseOwners.push_back({&info, skin});
+            numUsedBoneMatrices += smi->numBoneMatrices;
+          } else if (hasParentedMeshes && lodPoseOwners[lodPose.index].first != &info) {
+            sharedLodPoses.push_back({&info, lodPose.index});
           }
+
+          smi->offsets.boneMatricesBuffer = lodPoseOffsets[lodPose.index].second;
+          continue;
         }
-      }  // else identity matrices ?
 
-      XMMATRIX modelMat = model->WorldMatrix();
+        auto pose = g_PoseCache.Find(info, time, skin);
+
+        if (pose.first) {
+          auto instance =
+              PoseBatch::Prepare(info, time, skin, {tmpBoneMatrices.data() + numUsedBoneMatrices, smi->numBoneMatrices});
+          instance.time = pose.clipTime;
+          poseBatches[skin].push_back(instance);
+
+          poseOffsets.push_back(numUsedBoneMatrices);
+          poseOwners.push_back({&info, skin});
+          numUsedBoneMatrices += smi->numBoneMatrices;
+        } else if (hasParentedMeshes && poseOwners[pose.index].first != &info) {
+          sharedPoses.push_back({&info, pose.index});
+        }
+
+        smi->offsets.boneMatricesBuffer = poseOffsets[pose.index];
+      }
+    }
+    assert(numUsedBoneMatrices <= g_Scene.numBoneMatrices);
+
+    // each batch is spread over the job workers
+    for (const auto& [skin, instances] : poseBatches) {
+      if (!instances.empty()) PoseBatch::Evaluate(*skin, instances);
+    }
+
+    for (auto [lodPose, offset] : lodPoseOffsets) {
+      lodPose->Resolve(tmpBoneMatrices.data() + offset);
+    }
+
+    // meshes parented to a bone read the global transforms of their own instance
+    for (auto [info, index] : sharedPoses) {
+      auto [owner, skin] = poseOwners[index];
+      info->globalTransforms[skin] = owner->globalTransforms[skin];
+    }
+    for (auto [info, index] : sharedLodPoses) {
+      auto [owner, skin] = lodPoseOwners[index];
+      info->globalTransforms[skin] = owner->globalTransforms[skin];
+    }
+
+    // one item per mesh instance rather than per node, a node can hold hundreds of meshes.
+    // Items write only their own instance data and slot of tmpInstances, poses are read only by now
+    struct InstanceUpdate {
+      Model3D* model;
+      MeshInstance* mi;
+      XMFLOAT4X4 modelWorld;  // of the node, computed once for all its meshes
+    };
+    static std::vector<InstanceUpdate> instanceUpdates;
+    instanceUpdates.clear();
+    for (auto& node : g_Scene.nodes) {
+      XMFLOAT4X4 modelWorld;
+      XMStoreFloat4x4(&modelWorld, node.model->WorldMatrix());
+
+      for (auto& mi : node.meshInstances) {
+        instanceUpdates.push_back({node.model, mi.get(), modelWorld});
+      }
+    }
+
+    Jobs::ParallelForChunks(instanceUpdates.size(), 256, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        auto& [model, mi, modelWorld] = instanceUpdates[i];
 
-      for (auto mi : node.meshInstances) {
+        XMMATRIX modelMat = XMLoadFloat4x4(&modelWorld);
         XMMATRIX world;
 
         if (model->HasCurrentAnimation() && mi->mesh->parentBone > -1) {
-          auto boneMatrix = model->currentAnimation.globalTransforms[mi->mesh->parentBone];
+          auto boneMatrix = model->currentAnimation.GlobalTransform(mi->mesh->parentBone);
 
           world = mi->mesh->LocalTransformMatrix() * boneMatrix * modelMat;
         } else {
@@ -822,12 +1124,15 @@ static void Update(FrameContext* ctx, float time)
 
         tmpInstances[mi->instanceBufferOffset / sizeof(MeshInstance::data)] = mi->data;
       }
-    }
+    });
 
-    if (g_Scene.numBoneMatrices > 0) {
-      g_MeshStore.UpdateBoneMatrices(tmpBoneMatrices.data(), g_Scene.numBoneMatrices * sizeof(XMFLOAT4X4), 0, g_Surface->CurrentFrameIndex());
+    numUploadedBoneMatrices = numUsedBoneMatrices;
+    if (numUsedBoneMatrices > 0) {
+      g_MeshStore.UpdateBoneMatrices(tmpBoneMatrices.data(), numUsedBoneMatrices * sizeof(XMFLOAT4X4), 0, g_Surface->CurrentFrameIndex());
+    }
+    if (g_Scene.numMeshInstances > 0) {
+      g_MeshStore.UpdateInstances(tmpInstances.data(), g_Scene.numMeshInstances * sizeof(MeshInstance::data), 0, g_Surface->CurrentFrameIndex());
     }
-    g_MeshStore.UpdateInstances(tmpInstances.data(), g_Scene.numMeshInstances * sizeof(MeshInstance::data), 0, g_Surface->CurrentFrameIndex());
   }
 
   // ImGui
@@ -841,6 +1146,16 @@ static void Update(FrameContext* ctx, float time)
 
   g_Scene.camera->DebugWindow();
 
+  {
+    ImGui::Begin("Animation");
+    ImGui::Text("Poses: %zu, %zu far ones of which %zu evaluated", g_PoseCache.NumPoses(), g_AnimationLod.NumPoses(),
+                g_AnimationLod.NumEvaluated());
+    ImGui::Checkbox("Blend far poses", &g_AnimationLod.GetSettings().interpolate);
+    ImGui::Text("Bone matrices: %u uploaded, %u reserved", numUploadedBoneMatrices, g_Scene.numBoneMatrices);
+    ImGui::Text("Upload: %.1f KiB per frame", numUploadedBoneMatrices * sizeof(XMFLOAT4X4) / 1024.0);
+    ImGui::End();
+  }
+
   {
     ImGui::Begin("Ray tracing");
     ImGui::Checkbox("Enable RT shadows", &g_EnableRTShadows);
@@ -996,10 +1311,21 @@ static IssouRHI::TextureBarrierDesc BuildTransition(IssouRHI::Texture* tex, Isso
 
 void Render(float time)
 {
+  // waits for the frame that last used this context, like the per frame buffers
   auto renderTarget = g_Surface->GetCurrentTexture();
   auto renderTargetView = renderTarget->CreateView();
   auto ctx = &g_FrameContext[g_Surface->CurrentFrameIndex()];
 
+  ctx->retiredTlasBuffer.reset();
+  ctx->rtInstanceDescBuffer.reset();
+
+  // the meshes streamed in over a few frames go in one build, the last ones as soon as they are all in
+  g_Scene.framesSinceBuild++;
+  if (g_Scene.accelerationStructuresDirty &&
+      (g_Scene.framesSinceBuild >= ACCELERATION_STRUCTURES_BUILD_INTERVAL || Streaming::NumPending() == 0)) {
+    BuildAccelerationStructures(ctx);
+  }
+
   Update(ctx, time);
 
   auto queue = g_Device->GetQueue();
@@ -1024,6 +1350,8 @@ void Render(float time)
     {
       std::array transitions{
           BuildTransition(g_MeshStore.m_VertexPositions.get(), {IssouRHI::PipelineStage::ComputeShader, IssouRHI::Access::ShaderResourceStorage}),
+          BuildTransition(g_MeshStore.m_VertexNormals.get(), {IssouRHI::PipelineStage::ComputeShader, IssouRHI::Access::ShaderResourceStorage}),
+          BuildTransition(g_MeshStore.m_VertexTangents.get(), {IssouRHI::PipelineStage::ComputeShader, IssouRHI::Access::ShaderResourceStorage}),
       };
 
       encoder->Barrier({.buffers = transitions});
@@ -1098,6 +1426,8 @@ void Render(float time)
     {
       std::array transitions{
           BuildTransition(g_MeshStore.m_VertexPositions.get(), {IssouRHI::PipelineStage::MeshShaders, IssouRHI::Access::ShaderResource}),
+          BuildTransition(g_MeshStore.m_VertexNormals.get(), {IssouRHI::PipelineStage::MeshShaders, IssouRHI::Access::ShaderResource}),
+          BuildTransition(g_MeshStore.m_VertexTangents.get(), {IssouRHI::PipelineStage::MeshShaders, IssouRHI::Access::ShaderResource}),
           BuildTransition(g_DrawMeshCommands.get(), {IssouRHI::PipelineStage::Indirect, IssouRHI::Access::ArgumentBuffer}),
       };
 
@@ -1176,7 +1506,7 @@ void Render(float time)
   }
 
   // Ray trace shadows
-  if (g_EnableRTShadows) {
+  if (g_EnableRTShadows && g_Scene.tlasBuffer) {
     {
       std::array transitions{
           BuildTransition(g_ShadowBuffer.get(), {IssouRHI::PipelineStage::RayTracingShaders, IssouRHI::Access::ShaderResourceStorage, IssouRHI::TextureLayout::ShaderResourceStorage}),
@@ -1298,6 +1628,7 @@ void Cleanup()
     g_MeshStore.m_VertexNormals.reset();
     g_MeshStore.m_VertexTangents.reset();
     g_MeshStore.m_VertexUVs.reset();
+    g_MeshStore.m_VertexPacked.reset();
     g_MeshStore.m_VertexBlendWeightsAndIndices.reset();
     g_MeshStore.m_VertexIndices.reset();
     g_MeshStore.m_Meshlets.reset();
@@ -1579,7 +1910,7 @@ static void InitFrameResources()
   }
 
   // MeshStore
-  g_MeshStore.Init(g_Device.get());
+  g_MeshStore.Init(g_Device.get(), g_PackVertexStreams);
 
   // Draw Meshlets commands
   {
@@ -1705,17 +2036,37 @@ static std::shared_ptr<MeshInstance> LoadMesh3D(std::shared_ptr<Mesh3D> mesh)
   auto mi = std::make_shared<MeshInstance>();
   mi->instanceBufferOffset = g_MeshStore.ReserveInstance(sizeof(MeshInstance::data));
   mi->mesh = mesh;
+  mi->data.firstPackedVertex = PACKED_VERTEX_NONE;
 
-  // Assign it to the meshlets of this instance
+  auto it = g_Scene.meshInstanceMap.find(mesh->name);
+
+  // the mesh only knows material names
+  if (it == std::end(g_Scene.meshInstanceMap)) {
+    for (const auto& materialName : mesh->materialNames) {
+      mi->materialIndices.push_back(CreateMaterial(meshBasePath, materialName));
+    }
+  } else {
+    mi->materialIndices = it->second[0]->materialIndices;
+  }
+
+  // Assign it to the meshlets of this instance.
+  // the renderer keeps the meshlets of every uploaded mesh resident for this copy, see ReleaseUploadedGeometry
+  assert(mesh->IsResident(Mesh3D::Meshlets));
   std::vector<MeshletData> instanceMeshlets = mesh->meshlets;
   mi->data.numMeshlets = static_cast<UINT>(mesh->meshlets.size());
   for (auto& m : instanceMeshlets) {
     m.instanceIndex = mi->instanceBufferOffset / sizeof(MeshInstance::data);
+    m.materialIndex = mi->materialIndices[m.materialIndex];  // subset -> material
+  }
+
+  if (g_TrackedMeshes.insert(mesh.get()).second) {
+    g_UploadedMeshes.emplace_back(mesh, mesh->ResidentBytes());
   }
 
   {
-    auto it = g_Scene.meshInstanceMap.find(mesh->name);
     if (it == std::end(g_Scene.meshInstanceMap)) {  // first time seeing this mesh
+      assert(mesh->IsResident(Mesh3D::Indices | Mesh3D::Positions | Mesh3D::Normals | Mesh3D::Tangents | Mesh3D::UVs));
+
       // CreateGeometry
       // vertex data
       if (mesh->Skinned()) {
@@ -1737,25 +2088,46 @@ static std::shared_ptr<MeshInstance> LoadMesh3D(std::shared_ptr<Mesh3D> mesh)
 
         smi->numVertices = mesh->header.numVerts;
         smi->numBoneMatrices = static_cast<UINT>(mesh->SkinMatricesSize());
-        // TODO: should reuse bone matrice buffer for meshes of same model which share skin
-        smi->offsets.boneMatricesBuffer =
-            g_MeshStore.ReserveBoneMatrices(mesh->SkinMatricesBufferSize()) / sizeof(XMFLOAT4X4);
+        // bone matrices are reserved by the scene node, see SceneNode::Add
 
         smi->meshInstance = mi;
         mi->skinnedMeshInstance = smi;
 
         g_Scene.skinnedMeshInstances.push_back(smi);
-        g_Scene.numBoneMatrices += smi->numBoneMatrices;
       } else /* if not skinned */ {
+        // float positions are still uploaded, the BLAS is built from them
         mi->data.firstPosition =
             g_MeshStore.WritePositions(mesh->positions.data(), mesh->PositionsBufferSize()) / sizeof(XMFLOAT3);
-        mi->data.firstNormal =
-            g_MeshStore.WriteNormals(mesh->normals.data(), mesh->NormalsBufferSize()) / sizeof(XMFLOAT3);
-        mi->data.firstTangent =
-            g_MeshStore.WriteTangents(mesh->tangents.data(), mesh->TangentsBufferSize()) / sizeof(XMFLOAT4);
+
+        if (g_PackVertexStreams) {
+          auto packed = VertexPacking::Pack(*mesh);
+          size_t packedSize = packed.vertices.size() * sizeof(PackedVertex);
+          mi->data.firstPackedVertex =
+              g_MeshStore.WritePackedVertices(packed.vertices.data(), packedSize) / sizeof(PackedVertex);
+          mi->data.packedPositionMin = packed.positionMin;
+          mi->data.packedPositionExtent = packed.positionExtent;
+
+          auto& stats = g_MeshStore.m_PackingStats;
+          stats.numVertices += packed.vertices.size();
+          stats.floatBytes += mesh->PositionsBufferSize() + mesh->NormalsBufferSize() + mesh->TangentsBufferSize() +
+                              mesh->UvsBufferSize();
+          stats.uploadedBytes += mesh->PositionsBufferSize() + packedSize;
+          stats.maxError.position = std::max(stats.maxError.position, packed.error.position);
+          stats.maxError.normal = std::max(stats.maxError.normal, packed.error.normal);
+          stats.maxError.tangent = std::max(stats.maxError.tangent, packed.error.tangent);
+          stats.maxError.uv = std::max(stats.maxError.uv, packed.error.uv);
+        } else {
+          mi->data.firstNormal =
+              g_MeshStore.WriteNormals(mesh->normals.data(), mesh->NormalsBufferSize()) / sizeof(XMFLOAT3);
+          mi->data.firstTangent =
+              g_MeshStore.WriteTangents(mesh->tangents.data(), mesh->TangentsBufferSize()) / sizeof(XMFLOAT4);
+        }
       }
 
-      mi->data.firstUV = g_MeshStore.WriteUVs(mesh->uvs.data(), mesh->UvsBufferSize()) / sizeof(XMFLOAT2);
+      // packed vertices carry their UVs
+      if (mi->data.firstPackedVertex == PACKED_VERTEX_NONE) {
+        mi->data.firstUV = g_MeshStore.WriteUVs(mesh->uvs.data(), mesh->UvsBufferSize()) / sizeof(XMFLOAT2);
+      }
       mi->indexBufferOffset = g_MeshStore.WriteIndices(mesh->indices.data(), mesh->IndicesBufferSize());
 
       // meshlet data
@@ -1777,6 +2149,9 @@ static std::shared_ptr<MeshInstance> LoadMesh3D(std::shared_ptr<Mesh3D> mesh)
       mi->data.firstNormal = i->data.firstNormal;
       mi->data.firstTangent = i->data.firstTangent;
       mi->data.firstUV = i->data.firstUV;
+      mi->data.firstPackedVertex = i->data.firstPackedVertex;
+      mi->data.packedPositionMin = i->data.packedPositionMin;
+      mi->data.packedPositionExtent = i->data.packedPositionExtent;
 
       mi->data.firstMeshlet =
           g_MeshStore.WriteMeshlets(instanceMeshlets.data(), mesh->MeshletBufferSize()) / sizeof(MeshletData);
@@ -1797,15 +2172,11 @@ static std::shared_ptr<MeshInstance> LoadMesh3D(std::shared_ptr<Mesh3D> mesh)
           smi->offsets = iSmi->offsets;
           smi->numBoneMatrices = iSmi->numBoneMatrices;
         }
-        // TODO: should reuse bone matrice buffer for meshes of same model which share skin
-        smi->offsets.boneMatricesBuffer =
-            g_MeshStore.ReserveBoneMatrices(smi->BoneMatricesBufferSize()) / sizeof(XMFLOAT4X4);
 
         smi->meshInstance = mi;
         mi->skinnedMeshInstance = smi;
 
         g_Scene.skinnedMeshInstances.push_back(smi);
-        g_Scene.numBoneMatrices += smi->numBoneMatrices;
 
         // a skinned mesh instance counts as unique mesh instance even if mesh already seen
         // g_Scene.uniqueMeshInstances.push_back(mi); // skip for now
@@ -3,6 +3,7 @@
 #include "IssouRHI.h"
 
 class Camera;
+struct Mesh3D;
 struct Model3D;
 
 namespace Renderer
@@ -11,6 +12,8 @@ inline constexpr size_t FRAME_BUFFER_COUNT = 3;
 
 void InitWindow(UINT width, UINT height, std::wstring name);
 void Init(std::unique_ptr<IssouRHI::Device> device);
+// upload static meshes as PackedVertex instead of float streams. call before LoadAssets
+void SetPackVertexStreams(bool enable);
 void LoadAssets();
 void Render(float time);
 void Cleanup();
@@ -24,5 +27,8 @@ void SetSceneCamera(Camera* cam);
 
 void AppendToScene(Model3D* model);
 
+// registers a mesh that was added to a model after LoadAssets, e.g. by Model3D::Stream
+void AppendMesh(Model3D* model, std::shared_ptr<Mesh3D> mesh);
+
 UINT CreateMaterial(std::filesystem::path baseDir, std::wstring filename);
 }  // namespace Renderer
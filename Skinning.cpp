@@ -0,0 +1,298 @@
+#include "stdafx_assets.h"
+
+#include "Skinning.h"
+
+#include "Jobs.h"
+#include "Lanes.h"
+
+using namespace DirectX;
+
+namespace Skinning
+{
+// one vertex per lane
+static constexpr size_t WIDTH = Lanes::WIDTH;
+
+size_t Width() { return WIDTH; }
+
+const char* InstructionSet() { return Lanes::NAME; }
+
+static float UnpackWeight(uint32_t weights, size_t i) { return static_cast<float>((weights >> (8 * i)) & 0xff) / 255.f; }
+
+static uint32_t UnpackBoneIndex(uint32_t indices, size_t i) { return (indices >> (8 * i)) & 0xff; }
+
+static void Normalize(float& x, float& y, float& z)
+{
+  float length = std::sqrt(x * x + y * y + z * z);
+  x /= length;
+  y /= length;
+  z /= length;
+}
+
+static void SkinVertices(const Buffers& buffers, const SkinningPerDispatchConstants& constants, size_t begin, size_t end)
+{
+  for (size_t v = begin; v < end; v++) {
+    XMUINT2 bwi = buffers.blendWeightsAndIndices[constants.firstBWI + v];
+
+    // weighted sum of the bone matrices, then a single transform per stream.
+    // The matrices are transposed: row r gives component r of the result
+    float m[3][4] = {};
+    for (size_t k = 0; k < 4; k++) {
+      float weight = UnpackWeight(bwi.x, k);
+      const XMFLOAT4X4& bone = buffers.boneMatrices[constants.firstBoneMatrix + UnpackBoneIndex(bwi.y, k)];
+
+      for (size_t r = 0; r < 3; r++) {
+        for (size_t c = 0; c < 4; c++) {
+          m[r][c] += weight * bone.m[r][c];
+        }
+      }
+    }
+
+    auto transform = [&m](const float* in, float* out, float w) {
+      for (size_t r = 0; r < 3; r++) {
+        out[r] = m[r][0] * in[0] + m[r][1] * in[1] + m[r][2] * in[2] + m[r][3] * w;
+      }
+    };
+
+    const XMFLOAT3& position = buffers.positions[constants.firstPosition + v];
+    transform(&position.x, &buffers.positions[constants.firstSkinnedPosition + v].x, 1.f);
+
+    if (!buffers.normals.empty()) {
+      XMFLOAT3& normal = buffers.normals[constants.firstSkinnedNormal + v];
+      transform(&buffers.normals[constants.firstNormal + v].x, &normal.x, 0.f);
+      Normalize(normal.x, normal.y, normal.z);
+    }
+
+    if (!buffers.tangents.empty()) {
+      const XMFLOAT4& tangent = buffers.tangents[constants.firstTangent + v];
+      XMFLOAT4& skinnedTangent = buffers.tangents[constants.firstSkinnedTangent + v];
+      transform(&tangent.x, &skinnedTangent.x, 0.f);
+      Normalize(skinnedTangent.x, skinnedTangent.y, skinnedTangent.z);
+      skinnedTangent.w = tangent.w;
+    }
+  }
+}
+
+// Weighted sum of the bone matrices of every lane, rows 0 to 2 (row 3 is not needed, it is always (0, 0, 0, 1))
+static void BlendMatrices(const float* boneMatrices, const float (&weights)[4][WIDTH], const int32_t (&bones)[4][WIDTH],
+                          Lanes (&m)[3][4])
+{
+#if defined(__AVX2__)
+  // per vertex, rows 0 and 1 in one register and row 2 in another, then both are transposed into lanes.
+  // Loading whole rows is much cheaper than gathering the 48 floats of each vertex one by one
+  __m256 rows01[WIDTH];
+  __m256 rows2[WIDTH / 2];  // row 2 of lane i in the low half, of lane i + 4 in the high half
+
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    __m256 sum01 = _mm256_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+
+    for (size_t k = 0; k < 4; k++) {
+      const float* bone = boneMatrices + bones[k][lane];
+      __m256 weight = _mm256_set1_ps(weights[k][lane]);
+
+      sum01 = _mm256_fmadd_ps(_mm256_loadu_ps(bone), weight, sum01);
+      sum2 = _mm_fmadd_ps(_mm_loadu_ps(bone + 8), _mm256_castps256_ps128(weight), sum2);
+    }
+
+    rows01[lane] = sum01;
+    rows2[lane % 4] = lane < 4 ? _mm256_castps128_ps256(sum2) : _mm256_insertf128_ps(rows2[lane % 4], sum2, 1);
+  }
+
+  // 8x8 transpose: element j of every lane, j < 4 from row 0 and the rest from row 1
+  __m256 t[8], u[8];
+  for (size_t i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_ps(rows01[i], rows01[i + 1]);
+    t[i + 1] = _mm256_unpackhi_ps(rows01[i], rows01[i + 1]);
+  }
+  for (size_t i = 0; i < 8; i += 4) {
+    u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for (size_t c = 0; c < 4; c++) {
+    m[0][c] = {_mm256_permute2f128_ps(u[c], u[c + 4], 0x20)};
+    m[1][c] = {_mm256_permute2f128_ps(u[c], u[c + 4], 0x31)};
+  }
+
+  // 4x4 transpose in each half: lanes 0 to 3 in the low half, 4 to 7 in the high one
+  __m256 lo01 = _mm256_unpacklo_ps(rows2[0], rows2[1]);
+  __m256 hi01 = _mm256_unpackhi_ps(rows2[0], rows2[1]);
+  __m256 lo23 = _mm256_unpacklo_ps(rows2[2], rows2[3]);
+  __m256 hi23 = _mm256_unpackhi_ps(rows2[2], rows2[3]);
+  m[2][0] = {_mm256_shuffle_ps(lo01, lo23, _MM_SHUFFLE(1, 0, 1, 0))};
+  m[2][1] = {_mm256_shuffle_ps(lo01, lo23, _MM_SHUFFLE(3, 2, 3, 2))};
+  m[2][2] = {_mm256_shuffle_ps(hi01, hi23, _MM_SHUFFLE(1, 0, 1, 0))};
+  m[2][3] = {_mm256_shuffle_ps(hi01, hi23, _MM_SHUFFLE(3, 2, 3, 2))};
+#elif defined(_M_X64) || defined(__SSE2__)
+  // same with one row per register
+  __m128 rows[3][WIDTH];
+
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    __m128 sums[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+
+    for (size_t k = 0; k < 4; k++) {
+      const float* bone = boneMatrices + bones[k][lane];
+      __m128 weight = _mm_set1_ps(weights[k][lane]);
+
+      for (size_t r = 0; r < 3; r++) {
+        sums[r] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(bone + 4 * r), weight), sums[r]);
+      }
+    }
+
+    for (size_t r = 0; r < 3; r++) {
+      rows[r][lane] = sums[r];
+    }
+  }
+
+  for (size_t r = 0; r < 3; r++) {
+    _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+    for (size_t c = 0; c < 4; c++) {
+      m[r][c] = {rows[r][c]};
+    }
+  }
+#else
+  float blended[3][4][WIDTH] = {};
+
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    for (size_t k = 0; k < 4; k++) {
+      const float* bone = boneMatrices + bones[k][lane];
+
+      for (size_t i = 0; i < 12; i++) {
+        blended[i / 4][i % 4][lane] += weights[k][lane] * bone[i];
+      }
+    }
+  }
+
+  for (size_t r = 0; r < 3; r++) {
+    for (size_t c = 0; c < 4; c++) {
+      m[r][c] = Lanes::Load(blended[r][c]);
+    }
+  }
+#endif
+}
+
+// Same as SkinVertices for WIDTH vertices starting at first. The vertex streams are arrays of structs,
+// they go in and out of lanes through small buffers
+static void SkinGroup(const Buffers& buffers, const SkinningPerDispatchConstants& constants, size_t first)
+{
+  alignas(32) float weights[4][WIDTH];
+  alignas(32) int32_t bones[4][WIDTH];  // first float of each bone matrix
+  alignas(32) float in[3][3][WIDTH];     // position, normal, tangent
+
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    size_t v = first + lane;
+    XMUINT2 bwi = buffers.blendWeightsAndIndices[constants.firstBWI + v];
+
+    for (size_t k = 0; k < 4; k++) {
+      weights[k][lane] = UnpackWeight(bwi.x, k);
+      bones[k][lane] = static_cast<int32_t>((constants.firstBoneMatrix + UnpackBoneIndex(bwi.y, k)) * 16);
+    }
+
+    const XMFLOAT3& position = buffers.positions[constants.firstPosition + v];
+    in[0][0][lane] = position.x;
+    in[0][1][lane] = position.y;
+    in[0][2][lane] = position.z;
+
+    if (!buffers.normals.empty()) {
+      const XMFLOAT3& normal = buffers.normals[constants.firstNormal + v];
+      in[1][0][lane] = normal.x;
+      in[1][1][lane] = normal.y;
+      in[1][2][lane] = normal.z;
+    }
+
+    if (!buffers.tangents.empty()) {
+      const XMFLOAT4& tangent = buffers.tangents[constants.firstTangent + v];
+      in[2][0][lane] = tangent.x;
+      in[2][1][lane] = tangent.y;
+      in[2][2][lane] = tangent.z;
+    }
+  }
+
+  Lanes m[3][4];
+  BlendMatrices(&buffers.boneMatrices[0].m[0][0], weights, bones, m);
+
+  alignas(32) float out[3][WIDTH];
+
+  auto transform = [&](const float (&stream)[3][WIDTH], bool point, bool normalize) {
+    Lanes x = Lanes::Load(stream[0]);
+    Lanes y = Lanes::Load(stream[1]);
+    Lanes z = Lanes::Load(stream[2]);
+
+    Lanes result[3];
+    for (size_t r = 0; r < 3; r++) {
+      result[r] = m[r][0] * x + m[r][1] * y + m[r][2] * z;
+      if (point) result[r] = result[r] + m[r][3];
+    }
+
+    if (normalize) {
+      Lanes length = Sqrt(result[0] * result[0] + result[1] * result[1] + result[2] * result[2]);
+      for (auto& component : result) {
+        component = component / length;
+      }
+    }
+
+    for (size_t r = 0; r < 3; r++) {
+      result[r].Store(out[r]);
+    }
+  };
+
+  transform(in[0], true, false);
+  for (size_t lane = 0; lane < WIDTH; lane++) {
+    buffers.positions[constants.firstSkinnedPosition + first + lane] = {out[0][lane], out[1][lane], out[2][lane]};
+  }
+
+  if (!buffers.normals.empty()) {
+    transform(in[1], false, true);
+    for (size_t lane = 0; lane < WIDTH; lane++) {
+      buffers.normals[constants.firstSkinnedNormal + first + lane] = {out[0][lane], out[1][lane], out[2][lane]};
+    }
+  }
+
+  if (!buffers.tangents.empty()) {
+    transform(in[2], false, true);
+    for (size_t lane = 0; lane < WIDTH; lane++) {
+      size_t v = first + lane;
+      float w = buffers.tangents[constants.firstTangent + v].w;
+      buffers.tangents[constants.firstSkinnedTangent + v] = {out[0][lane], out[1][lane], out[2][lane], w};
+    }
+  }
+}
+
+// every stream must hold the base and skinned ranges of the dispatch
+static void CheckBuffers(const Buffers& buffers, const SkinningPerDispatchConstants& c)
+{
+  assert(buffers.positions.size() >= std::max(c.firstPosition, c.firstSkinnedPosition) + c.numVertices);
+  assert(buffers.normals.empty() ||
+         buffers.normals.size() >= std::max(c.firstNormal, c.firstSkinnedNormal) + c.numVertices);
+  assert(buffers.tangents.empty() ||
+         buffers.tangents.size() >= std::max(c.firstTangent, c.firstSkinnedTangent) + c.numVertices);
+  assert(buffers.blendWeightsAndIndices.size() >= c.firstBWI + c.numVertices);
+  assert(buffers.boneMatrices.size() > c.firstBoneMatrix);
+}
+
+void DispatchScalar(const Buffers& buffers, const SkinningPerDispatchConstants& constants)
+{
+  CheckBuffers(buffers, constants);
+
+  SkinVertices(buffers, constants, 0, constants.numVertices);
+}
+
+void Dispatch(const Buffers& buffers, const SkinningPerDispatchConstants& constants)
+{
+  CheckBuffers(buffers, constants);
+
+  // a multiple of WIDTH, so only the last chunk has vertices left over for the scalar path
+  constexpr size_t VERTICES_PER_JOB = 4096;
+  static_assert(VERTICES_PER_JOB % WIDTH == 0);
+
+  Jobs::ParallelForChunks(constants.numVertices, VERTICES_PER_JOB, [&](size_t begin, size_t end) {
+    size_t groupsEnd = begin + (end - begin) / WIDTH * WIDTH;
+
+    for (size_t first = begin; first < groupsEnd; first += WIDTH) {
+      SkinGroup(buffers, constants, first);
+    }
+    SkinVertices(buffers, constants, groupsEnd, end);
+  });
+}
+}  // namespace Skinning
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "shaders/Shared.h"
+
+// CPU version of shaders/Skinning.cs.hlsl: same buffers, same packing, same offsets, same math.
+// It is the reference the compute shader is checked against, and the fallback where there is no GPU.
+// Vertices are spread over the job workers and skinned Lanes::WIDTH at a time
+namespace Skinning
+{
+// Laid out like the MeshStore buffers: skinned streams are written to the same buffers as the base ones,
+// at the offsets given by SkinningPerDispatchConstants
+struct Buffers {
+  std::span<DirectX::XMFLOAT3> positions;
+  std::span<DirectX::XMFLOAT3> normals;                      // empty to skin positions only
+  std::span<DirectX::XMFLOAT4> tangents;                     // empty to skip them, w is copied as is
+  std::span<const DirectX::XMUINT2> blendWeightsAndIndices;  // x: 4 UNORM8 weights, y: 4 uint8 bone indices
+  std::span<const DirectX::XMFLOAT4X4> boneMatrices;         // transposed, as AnimationInfo::BoneTransforms gives them
+};
+
+// vertices skinned together, 8 with AVX2, 4 with SSE
+size_t Width();
+
+const char* InstructionSet();
+
+// one vertex at a time on the calling thread, the plain version to compare against
+void DispatchScalar(const Buffers& buffers, const SkinningPerDispatchConstants& constants);
+
+void Dispatch(const Buffers& buffers, const SkinningPerDispatchConstants& constants);
+}  // namespace Skinning
@@ -0,0 +1,25 @@
+#pragma once
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the process, in bytes
+inline size_t PeakResidentSetSize()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;  // KiB on Linux
+#endif
+}
+
+inline double ToMiB(size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
@@ -0,0 +1,175 @@
+#include "stdafx_assets.h"
+
+#include "Streaming.h"
+
+namespace Streaming
+{
+struct PendingRequest {
+  Request request;
+  uint64_t sequence;  // keeps requests of equal priority in submission order
+
+  // heap order: the front is the lowest priority value, then the oldest
+  bool operator<(const PendingRequest& other) const
+  {
+    if (request.priority != other.request.priority) return request.priority > other.request.priority;
+
+    return sequence > other.sequence;
+  }
+};
+
+struct Completion {
+  std::function<void()> complete;
+  std::exception_ptr error;
+  Completion* next = nullptr;
+};
+
+static std::vector<std::thread> g_Threads;
+static std::vector<PendingRequest> g_Queue;  // binary heap
+static uint64_t g_NextSequence = 0;
+static std::mutex g_Mutex;
+static std::condition_variable g_WakeUp;
+static bool g_Stop = false;
+
+// Finished loads. Streaming threads push without locking, Poll takes the whole list at once,
+// so the main thread never waits on a thread that is busy loading.
+static std::atomic<Completion*> g_Completed = nullptr;
+static std::deque<std::unique_ptr<Completion>> g_Ready;  // main thread only, oldest first
+static std::atomic<size_t> g_NumPending = 0;
+
+static void PushCompleted(Completion* completion)
+{
+  completion->next = g_Completed.load(std::memory_order_relaxed);
+  while (!g_Completed.compare_exchange_weak(completion->next, completion, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+  }
+}
+
+static void Load(Request& request)
+{
+  auto completion = std::make_unique<Completion>();
+
+  try {
+    if (request.load) request.load();
+  } catch (...) {
+    completion->error = std::current_exception();
+  }
+  completion->complete = std::move(request.complete);
+
+  PushCompleted(completion.release());
+}
+
+static void StreamingLoop()
+{
+  for (;;) {
+    Request request;
+
+    {
+      std::unique_lock lock(g_Mutex);
+      g_WakeUp.wait(lock, [] { return g_Stop || !g_Queue.empty(); });
+
+      if (g_Stop) return;
+
+      std::pop_heap(g_Queue.begin(), g_Queue.end());
+      request = std::move(g_Queue.back().request);
+      g_Queue.pop_back();
+    }
+
+    Load(request);
+  }
+}
+
+void Init(size_t numThreads)
+{
+  assert(g_Threads.empty());
+
+  g_Stop = false;
+  g_Threads.reserve(numThreads);
+  for (size_t i = 0; i < numThreads; i++) {
+    g_Threads.emplace_back(StreamingLoop);
+  }
+}
+
+void Shutdown()
+{
+  {
+    std::lock_guard lock(g_Mutex);
+    g_Stop = true;
+  }
+  g_WakeUp.notify_all();
+
+  for (auto& thread : g_Threads) {
+    thread.join();
+  }
+  g_Threads.clear();
+
+  g_Queue.clear();
+  g_Ready.clear();
+  for (Completion* c = g_Completed.exchange(nullptr); c;) {
+    std::unique_ptr<Completion> completion(c);
+    c = c->next;
+  }
+  g_NumPending = 0;
+}
+
+void Submit(Request request)
+{
+  g_NumPending++;
+
+  if (g_Threads.empty()) {
+    Load(request);
+    return;
+  }
+
+  {
+    std::lock_guard lock(g_Mutex);
+    g_Queue.push_back({std::move(request), g_NextSequence++});
+    std::push_heap(g_Queue.begin(), g_Queue.end());
+  }
+  g_WakeUp.notify_one();
+}
+
+void UpdatePriorities()
+{
+  std::lock_guard lock(g_Mutex);
+
+  bool changed = false;
+  for (auto& pending : g_Queue) {
+    if (!pending.request.update) continue;
+
+    float priority = pending.request.update();
+    changed = changed || priority != pending.request.priority;
+    pending.request.priority = priority;
+  }
+
+  if (changed) std::make_heap(g_Queue.begin(), g_Queue.end());
+}
+
+size_t Poll(std::chrono::microseconds budget)
+{
+  // the list is newest first
+  size_t first = g_Ready.size();
+  for (Completion* c = g_Completed.exchange(nullptr, std::memory_order_acquire); c; c = c->next) {
+    g_Ready.emplace_back(c);
+  }
+  std::reverse(g_Ready.begin() + first, g_Ready.end());
+
+  auto start = std::chrono::steady_clock::now();
+  size_t count = 0;
+
+  while (!g_Ready.empty()) {
+    auto completion = std::move(g_Ready.front());
+    g_Ready.pop_front();
+    g_NumPending--;
+    count++;
+
+    if (completion->error) std::rethrow_exception(completion->error);
+    if (completion->complete) completion->complete();
+
+    if (std::chrono::steady_clock::now() - start >= budget) break;
+  }
+
+  return count;
+}
+
+size_t NumPending() { return g_NumPending; }
+}  // namespace Streaming
@@ -0,0 +1,33 @@
+#pragma once
+
+// Background asset loading.
+// Requests are loaded on dedicated threads, most urgent first, and their completion callbacks
+// are handed back to the main thread through Poll, where the renderer can be touched.
+namespace Streaming
+{
+struct Request {
+  float priority = 0.f;             // lower is loaded first, e.g. the distance to the camera
+  std::function<void()> load;      // on a streaming thread
+  std::function<void()> complete;  // on the main thread, from Poll
+  std::function<float()> update;   // on the main thread, from UpdatePriorities. Null keeps priority
+};
+
+void Init(size_t numThreads);
+
+// pending requests are dropped, completions that were not polled yet are discarded
+void Shutdown();
+
+void Submit(Request request);
+
+// Runs completion callbacks in the order the loads finished, until the queue is empty or budget is spent.
+// At least one completion runs per call. An exception thrown by a load is rethrown here.
+// Returns the number of completions that ran.
+size_t Poll(std::chrono::microseconds budget);
+
+// Recomputes the priority of the requests still waiting for a thread, e.g. once per frame as the camera moves.
+// On the main thread, the streaming threads only wait for it to pick their next request
+void UpdatePriorities();
+
+// submitted, but not polled yet
+size_t NumPending();
+}  // namespace Streaming
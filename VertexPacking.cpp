@@ -0,0 +1,63 @@
+#include "stdafx_assets.h"
+
+#include "VertexPacking.h"
+
+#include "Mesh.h"
+
+using namespace DirectX;
+
+namespace VertexPacking
+{
+static float AngleDegrees(XMFLOAT3 a, XMFLOAT3 b)
+{
+  XMVECTOR va = XMVector3Normalize(XMLoadFloat3(&a));
+  XMVECTOR vb = XMVector3Normalize(XMLoadFloat3(&b));
+
+  return XMConvertToDegrees(XMVectorGetX(XMVector3AngleBetweenNormals(va, vb)));
+}
+
+PackedMesh Pack(const Mesh3D& mesh)
+{
+  const size_t numVerts = mesh.header.numVerts;
+  assert(mesh.tangents.size() == numVerts);
+
+  PackedMesh packed;
+  packed.vertices.resize(numVerts);
+
+  XMVECTOR vmin = XMVectorReplicate(std::numeric_limits<float>::max());
+  XMVECTOR vmax = XMVectorReplicate(-std::numeric_limits<float>::max());
+  for (const auto& p : mesh.positions) {
+    XMVECTOR v = XMLoadFloat3(&p);
+    vmin = XMVectorMin(vmin, v);
+    vmax = XMVectorMax(vmax, v);
+  }
+  if (numVerts == 0) vmin = vmax = XMVectorZero();
+
+  XMStoreFloat3(&packed.positionMin, vmin);
+  XMStoreFloat3(&packed.positionExtent, XMVectorSubtract(vmax, vmin));
+
+  Error& error = packed.error;
+  for (size_t i = 0; i < numVerts; i++) {
+    auto& v = packed.vertices[i];
+    v.position = EncodePosition(mesh.positions[i], packed.positionMin, packed.positionExtent);
+    v.normal = EncodeNormal(mesh.normals[i]);
+    v.tangent = EncodeTangent(mesh.tangents[i]);
+    v.uv = EncodeUV(mesh.uvs[i]);
+
+    XMFLOAT3 p = DecodePosition(v.position, packed.positionMin, packed.positionExtent);
+    XMVECTOR dp = XMVectorSubtract(XMLoadFloat3(&p), XMLoadFloat3(&mesh.positions[i]));
+    error.position = std::max(error.position, XMVectorGetX(XMVector3Length(dp)));
+
+    error.normal = std::max(error.normal, AngleDegrees(DecodeNormal(v.normal), mesh.normals[i]));
+
+    XMFLOAT4 t = DecodeTangent(v.tangent);
+    const XMFLOAT4& src = mesh.tangents[i];
+    error.tangent = std::max(error.tangent, AngleDegrees({t.x, t.y, t.z}, {src.x, src.y, src.z}));
+
+    XMFLOAT2 uv = DecodeUV(v.uv);
+    error.uv = std::max({error.uv, std::abs(uv.x - mesh.uvs[i].x), std::abs(uv.y - mesh.uvs[i].y)});
+  }
+
+  return packed;
+}
+}  // namespace VertexPacking
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "shaders/Shared.h"
+
+struct Mesh3D;
+
+// CPU side of the PackedVertex layout described in Shared.h.
+// Every encoder has a matching decoder so the quantization error can be measured;
+// VertexPacking.hlsli mirrors the decoders.
+namespace VertexPacking
+{
+inline uint32_t QuantizeUnorm(float v, uint32_t bits)
+{
+  const float scale = static_cast<float>((1u << bits) - 1);
+  return static_cast<uint32_t>(std::clamp(v, 0.f, 1.f) * scale + 0.5f);
+}
+
+inline float DequantizeUnorm(uint32_t q, uint32_t bits)
+{
+  return static_cast<float>(q) / static_cast<float>((1u << bits) - 1);
+}
+
+inline uint32_t QuantizeSnorm16(float v)
+{
+  auto q = static_cast<int16_t>(std::round(std::clamp(v, -1.f, 1.f) * 32767.f));
+  return static_cast<uint16_t>(q);
+}
+
+inline float DequantizeSnorm16(uint32_t q)
+{
+  return std::max(static_cast<float>(static_cast<int16_t>(q & 0xffff)) / 32767.f, -1.f);
+}
+
+// unit vector to [-1, 1]^2
+inline DirectX::XMFLOAT2 OctEncode(DirectX::XMFLOAT3 n)
+{
+  float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.f) return {0.f, 0.f};
+
+  float x = n.x / l1;
+  float y = n.y / l1;
+  if (n.z < 0.f) {
+    float wx = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+    float wy = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+    x = wx;
+    y = wy;
+  }
+
+  return {x, y};
+}
+
+inline DirectX::XMFLOAT3 OctDecode(DirectX::XMFLOAT2 e)
+{
+  DirectX::XMFLOAT3 n{e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y)};
+  float t = std::clamp(-n.z, 0.f, 1.f);
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+
+  DirectX::XMStoreFloat3(&n, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&n)));
+  return n;
+}
+
+// position relative to the [min, min + extent] box, 16 bits per axis
+inline DirectX::XMUINT2 EncodePosition(DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 min, DirectX::XMFLOAT3 extent)
+{
+  auto axis = [](float v, float lo, float size) { return QuantizeUnorm(size > 0.f ? (v - lo) / size : 0.f, 16); };
+
+  return {axis(p.x, min.x, extent.x) | axis(p.y, min.y, extent.y) << 16, axis(p.z, min.z, extent.z)};
+}
+
+inline DirectX::XMFLOAT3 DecodePosition(DirectX::XMUINT2 q, DirectX::XMFLOAT3 min, DirectX::XMFLOAT3 extent)
+{
+  return {
+      min.x + extent.x * DequantizeUnorm(q.x & 0xffff, 16),
+      min.y + extent.y * DequantizeUnorm(q.x >> 16, 16),
+      min.z + extent.z * DequantizeUnorm(q.y & 0xffff, 16),
+  };
+}
+
+inline uint32_t EncodeNormal(DirectX::XMFLOAT3 n)
+{
+  auto e = OctEncode(n);
+  return QuantizeSnorm16(e.x) | QuantizeSnorm16(e.y) << 16;
+}
+
+inline DirectX::XMFLOAT3 DecodeNormal(uint32_t q)
+{
+  return OctDecode({DequantizeSnorm16(q), DequantizeSnorm16(q >> 16)});
+}
+
+// xyz octahedral in 16 + 15 bits, w (bitangent sign) in the top bit
+inline uint32_t EncodeTangent(DirectX::XMFLOAT4 t)
+{
+  auto e = OctEncode({t.x, t.y, t.z});
+  uint32_t sign = t.w < 0.f ? 1u : 0u;
+
+  return QuantizeUnorm(e.x * 0.5f + 0.5f, 16) | QuantizeUnorm(e.y * 0.5f + 0.5f, 15) << 16 | sign << 31;
+}
+
+inline DirectX::XMFLOAT4 DecodeTangent(uint32_t q)
+{
+  float x = DequantizeUnorm(q & 0xffff, 16) * 2.f - 1.f;
+  float y = DequantizeUnorm((q >> 16) & 0x7fff, 15) * 2.f - 1.f;
+  auto t = OctDecode({x, y});
+
+  return {t.x, t.y, t.z, (q >> 31) ? -1.f : 1.f};
+}
+
+inline uint32_t EncodeUV(DirectX::XMFLOAT2 uv)
+{
+  using DirectX::PackedVector::XMConvertFloatToHalf;
+  return static_cast<uint32_t>(XMConvertFloatToHalf(uv.x)) | static_cast<uint32_t>(XMConvertFloatToHalf(uv.y)) << 16;
+}
+
+inline DirectX::XMFLOAT2 DecodeUV(uint32_t q)
+{
+  using DirectX::PackedVector::XMConvertHalfToFloat;
+  return {XMConvertHalfToFloat(static_cast<uint16_t>(q & 0xffff)), XMConvertHalfToFloat(static_cast<uint16_t>(q >> 16))};
+}
+
+// worst round trip error over a mesh
+struct Error {
+  float position = 0.f;  // distance, in mesh units
+  float normal = 0.f;    // angle, in degrees
+  float tangent = 0.f;   // angle, in degrees. bitangent sign is exact
+  float uv = 0.f;        // absolute, per component
+};
+
+struct PackedMesh {
+  std::vector<PackedVertex> vertices;
+  DirectX::XMFLOAT3 positionMin;
+  DirectX::XMFLOAT3 positionExtent;
+  Error error;
+};
+
+// needs the tangents, so call after Mesh3D::Read
+PackedMesh Pack(const Mesh3D& mesh);
+}  // namespace VertexPacking
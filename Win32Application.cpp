@@ -4,6 +4,8 @@
 #include "Renderer.h"
 #include "Input.h"
 #include "Game.h"
+#include "Stats.h"
+#include "Streaming.h"
 
 using namespace DirectX;
 
@@ -14,6 +16,9 @@ static const LONG WINDOW_HEIGHT = 1080;
 
 static HWND g_Hwnd = nullptr;
 
+// main thread time spent registering streamed meshes each frame
+static constexpr std::chrono::microseconds STREAMING_BUDGET{4000};
+
 StepTimer g_Timer;
 
 static LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
@@ -60,10 +65,18 @@ int Win32Application::Run(HINSTANCE hInstance, int nCmdShow, std::unique_ptr<Iss
 
   ShowWindow(g_Hwnd, nCmdShow);
 
+  auto loadStart = std::chrono::steady_clock::now();
+
   Game::Init();
 
   Renderer::LoadAssets();
 
+  std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+  wprintf(L"Startup: %.2f ms, peak RSS: %.2f MiB\n", loadTime.count(), ToMiB(PeakResidentSetSize()));
+
+  bool firstFrame = true;
+  bool streaming = Streaming::NumPending() > 0;
+
   MSG msg;
   for (;;) {
     if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -85,8 +98,26 @@ int Win32Application::Run(HINSTANCE hInstance, int nCmdShow, std::unique_ptr<Iss
         Game::Update(t, dt);
       });
 
+      if (streaming) {
+        // what is closest to the camera now loads first
+        Streaming::UpdatePriorities();
+        Streaming::Poll(STREAMING_BUDGET);
+      }
+
       float t = static_cast<float>(g_Timer.GetTotalSeconds());
       Renderer::Render(t);
+
+      if (firstFrame) {
+        firstFrame = false;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - loadStart;
+        wprintf(L"First frame: %.2f ms\n", elapsed.count());
+      }
+
+      if (streaming && Streaming::NumPending() == 0) {
+        streaming = false;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - loadStart;
+        wprintf(L"Scene fully loaded: %.2f ms, peak RSS: %.2f MiB\n", elapsed.count(), ToMiB(PeakResidentSetSize()));
+      }
     }
   }
 
@@ -2,6 +2,7 @@
 # gltfpack.exe -i "$InFile" -o "$OutFile -noq
 # python3 gltf.py -i "$InFile" [--skinned]
 import json
+import math
 import os
 import re
 from urllib.parse import unquote
@@ -15,13 +16,8 @@ import subprocess
 
 from typing import List, Dict
 
-MAX_PATH = 260
 SKIP_TEXTURES = False
 
-def pack_string(s):
-    assert(len(s) < MAX_PATH)
-    return bytes(s.ljust(MAX_PATH, "\0"), "utf-16le")
-
 def sanitize_path(s):
     return re.sub(r'[<>:"/\\|?*]', '_', s)
 
@@ -170,9 +166,6 @@ class Material:
         self.metallic_roughness_texture = metallic_roughness_texture
         self.normal_map_texture = normal_map_texture
 
-    def pack_name(self):
-        return pack_string(self.filename)
-
     def pack(self):
         buf = '{}\n'.format(self.base_color_texture.filename)
         buf += '{}\n'.format(self.metallic_roughness_texture.filename)
@@ -201,11 +194,227 @@ class Subset:
     def __str__(self):
         return "{} {}".format(self.istart, self.icount)
 
-    def pack(self):
+    def pack(self, strings: bytearray):
         assert(self.istart % 3 == 0)
         assert(self.icount % 3 == 0)
-        data = struct.pack("<II", self.istart, self.icount)
-        return data + self.material.pack_name()
+        name = self.material.filename.encode("utf-8")
+        data = struct.pack("<IIII", self.istart, self.icount, len(strings), len(name))
+        strings += name + b"\0"
+        return data
+
+
+# .mesh container, see MeshFormat.h
+MESH_MAGIC = 0x4853454D  # "MESH"
+MESH_VERSION = 1
+MESH_FLAG_SKINNED = 1 << 0
+
+SECTION_ALIGNMENT = 16
+STREAM_ALIGNMENT = 256
+
+SECTION_INDICES = 1
+SECTION_POSITIONS = 2
+SECTION_NORMALS = 3
+SECTION_TANGENTS = 4
+SECTION_UVS = 5
+SECTION_BLEND_WEIGHTS_AND_INDICES = 6
+SECTION_SUBSETS = 7
+SECTION_STRINGS = 8
+SECTION_MESHLETS = 9
+SECTION_MESHLET_VERTEX_INDICES = 10
+SECTION_MESHLET_PRIMITIVES = 11
+SECTION_BOUNDS = 12
+SECTION_TRANSFORM = 13
+
+STREAM_SECTIONS = (
+    SECTION_INDICES,
+    SECTION_POSITIONS,
+    SECTION_NORMALS,
+    SECTION_TANGENTS,
+    SECTION_UVS,
+    SECTION_BLEND_WEIGHTS_AND_INDICES,
+)
+
+
+def align_up(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+def pack_mesh_container(num_verts, num_indices, num_subsets, flags, sections):
+    # sections: list of (type, element_size, bytes)
+    header_size = 32 + 24 * len(sections)
+    table = bytearray()
+    body = bytearray()
+    offset = header_size
+
+    for section_type, element_size, payload in sections:
+        alignment = STREAM_ALIGNMENT if section_type in STREAM_SECTIONS else SECTION_ALIGNMENT
+        aligned = align_up(offset, alignment)
+        body += bytes(aligned - offset)
+        table += struct.pack("<IIQQ", section_type, element_size, aligned, len(payload))
+        body += payload
+        offset = aligned + len(payload)
+
+    header = struct.pack("<8I", MESH_MAGIC, MESH_VERSION, num_verts, num_indices, num_subsets, len(sections), flags, 0)
+
+    return header + table + body
+
+
+# the additional data Mesh3D computes when a mesh file lacks it, see Mesh3D::ComputeAdditionalData
+MESHLET_MAX_VERT = 64  # see shaders/Shared.h
+MESHLET_MAX_PRIM = 124
+EPSILON = 1e-7
+
+
+def sub(a, b):
+    return (a[0] - b[0], a[1] - b[1], a[2] - b[2])
+
+
+def dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+
+def cross(a, b):
+    return (a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0])
+
+
+def normalize(a):
+    length = math.sqrt(dot(a, a))
+    return (a[0] / length, a[1] / length, a[2] / length) if length > EPSILON else (0.0, 0.0, 0.0)
+
+
+def bounding_sphere(points):
+    # BoundingSphere::CreateFromPoints: the farthest apart pair of axis extremes, grown to the points outside.
+    # Flat grids grow loose spheres, so the sphere around the box center is kept when it is smaller
+    extremes = []
+    for axis in range(3):
+        extremes.append((min(points, key=lambda p: p[axis]), max(points, key=lambda p: p[axis])))
+    a, b = max(extremes, key=lambda e: dot(sub(e[1], e[0]), sub(e[1], e[0])))
+
+    center = ((a[0] + b[0]) * 0.5, (a[1] + b[1]) * 0.5, (a[2] + b[2]) * 0.5)
+    radius = math.sqrt(dot(sub(b, a), sub(b, a))) * 0.5
+
+    for p in points:
+        delta = sub(p, center)
+        dist = math.sqrt(dot(delta, delta))
+        if dist > radius:
+            radius = (radius + dist) * 0.5
+            k = 1.0 - radius / dist
+            center = (center[0] + delta[0] * k, center[1] + delta[1] * k, center[2] + delta[2] * k)
+
+    box_center = tuple((min(p[axis] for p in points) + max(p[axis] for p in points)) * 0.5 for axis in range(3))
+    box_radius = math.sqrt(max(dot(sub(p, box_center), sub(p, box_center)) for p in points))
+    if box_radius < radius:
+        return box_center, box_radius
+
+    return center, radius
+
+
+def compute_tangents(positions, normals, uvs, tris):
+    # like DirectXMesh ComputeTangentFrame: uv directions summed per vertex, made orthonormal to the normal,
+    # w is the handedness of the bitangent
+    tangents = [[0.0, 0.0, 0.0] for _ in positions]
+    bitangents = [[0.0, 0.0, 0.0] for _ in positions]
+
+    for i0, i1, i2 in tris:
+        e1 = sub(positions[i1], positions[i0])
+        e2 = sub(positions[i2], positions[i0])
+        du1, dv1 = uvs[i1][0] - uvs[i0][0], uvs[i1][1] - uvs[i0][1]
+        du2, dv2 = uvs[i2][0] - uvs[i0][0], uvs[i2][1] - uvs[i0][1]
+
+        d = du1 * dv2 - du2 * dv1
+        r = 1.0 / d if abs(d) > EPSILON else 1.0
+        t = ((e1[0] * dv2 - e2[0] * dv1) * r, (e1[1] * dv2 - e2[1] * dv1) * r, (e1[2] * dv2 - e2[2] * dv1) * r)
+        b = ((e2[0] * du1 - e1[0] * du2) * r, (e2[1] * du1 - e1[1] * du2) * r, (e2[2] * du1 - e1[2] * du2) * r)
+
+        for i in (i0, i1, i2):
+            for c in range(3):
+                tangents[i][c] += t[c]
+                bitangents[i][c] += b[c]
+
+    out = []
+    for n, t, b in zip(normals, tangents, bitangents):
+        t = normalize(sub(t, tuple(x * dot(n, t) for x in n)))
+        if t == (0.0, 0.0, 0.0):
+            # no uv direction to follow, any tangent will do
+            t = normalize(cross(n, (0.0, 1.0, 0.0) if abs(n[1]) < 0.9 else (1.0, 0.0, 0.0)))
+        w = -1.0 if dot(cross(n, t), b) < 0.0 else 1.0
+        out.append((t[0], t[1], t[2], w))
+
+    return out
+
+
+def compute_meshlets(tris, subsets):
+    # Greedy in index order, which gltfpack has optimized for locality, and never across subsets.
+    # Returns (first vertex, vertex count, first primitive, primitive count, subset) per meshlet, the vertex
+    # indices and the primitives packed 10:10:10 like DirectX::MeshletTriangle
+    meshlets = []
+    vertex_indices = []
+    primitives = []
+
+    for si, subset in enumerate(subsets):
+        local = {}
+        first_vert = len(vertex_indices)
+        first_prim = len(primitives)
+
+        for tri in tris[subset.istart // 3 : (subset.istart + subset.icount) // 3]:
+            new_verts = len(set(i for i in tri if i not in local))
+            if len(local) + new_verts > MESHLET_MAX_VERT or len(primitives) - first_prim == MESHLET_MAX_PRIM:
+                meshlets.append((first_vert, len(local), first_prim, len(primitives) - first_prim, si))
+                local = {}
+                first_vert = len(vertex_indices)
+                first_prim = len(primitives)
+
+            for i in tri:
+                if i not in local:
+                    local[i] = len(local)
+                    vertex_indices.append(i)
+            primitives.append(local[tri[0]] | local[tri[1]] << 10 | local[tri[2]] << 20)
+
+        if len(primitives) > first_prim:
+            meshlets.append((first_vert, len(local), first_prim, len(primitives) - first_prim, si))
+
+    return meshlets, vertex_indices, primitives
+
+
+def compute_cull_data(positions, meshlet, vertex_indices, primitives):
+    # Like DirectXMesh ComputeCullData: bounding sphere, and the normal cone packed as Meshlet.as.hlsl reads it,
+    # rounded so that it never culls more. Returns center, radius, packed cone and apex offset
+    first_vert, num_verts, first_prim, num_prims, _ = meshlet
+    verts = vertex_indices[first_vert : first_vert + num_verts]
+    center, radius = bounding_sphere([positions[i] for i in verts])
+    degenerate = (center, radius, 0xFF << 24, 0.0)
+
+    faces = []
+    for packed in primitives[first_prim : first_prim + num_prims]:
+        p0, p1, p2 = (positions[verts[(packed >> shift) & 0x3FF]] for shift in (0, 10, 20))
+        n = normalize(cross(sub(p1, p0), sub(p2, p0)))
+        if n != (0.0, 0.0, 0.0):
+            faces.append((n, p0))
+    if not faces:
+        return degenerate
+
+    axis = normalize(bounding_sphere([n for n, _ in faces])[0])
+    if axis == (0.0, 0.0, 0.0):
+        return degenerate
+
+    # the shader sees the quantized axis
+    quantized = [min(max(round((a * 0.5 + 0.5) * 255.0), 0), 255) for a in axis]
+    axis = normalize(tuple(q / 255.0 * 2.0 - 1.0 for q in quantized))
+
+    min_dot = min(dot(axis, n) for n, _ in faces)
+    if min_dot < 0.1:
+        return degenerate
+
+    # the apex is behind every triangle along the axis
+    apex_offset = max(0.0, max(dot(sub(center, p0), n) / dot(axis, n) for n, p0 in faces))
+
+    # -cos(a + 90) = sin(a)
+    cutoff = math.ceil(math.sqrt(1.0 - min_dot * min_dot) * 255.0)
+    if cutoff >= 0xFF:
+        return degenerate
+
+    cone = quantized[0] | quantized[1] << 8 | quantized[2] << 16 | cutoff << 24
+    return center, radius, cone, apex_offset
 
 
 class Mesh:
@@ -220,17 +429,14 @@ class Mesh:
         self.scale = Vec3()
 
     def pack(self, outfile):
-        data = bytearray()
-
-        # print(len(self.vertices), len(self.tris) * 3, len(self.subsets))
-        # TODO: add parent_node and bounding box
-        data += struct.pack("<III", len(self.vertices), len(self.tris) * 3, len(self.subsets))
-
+        indices_data = bytearray()
         for t in self.tris:
-            data += t.pack()
+            indices_data += t.pack()
 
+        strings = bytearray()
+        subsets_data = bytearray()
         for s in self.subsets:
-            data += s.pack()
+            subsets_data += s.pack(strings)
 
         positions_data = bytearray()
         normals_data = bytearray()
@@ -238,7 +444,6 @@ class Mesh:
         weights_and_indices = bytearray()
 
         for v in self.vertices:
-            # data += v.pack()
             positions_data += v.pack_positions()
             normals_data += v.pack_normals()
             uvs_data += v.pack_uvs()
@@ -246,14 +451,57 @@ class Mesh:
             if self.skinned:
                 weights_and_indices += v.pack_weights_and_indices()
 
-        data += (positions_data + normals_data + uvs_data + weights_and_indices)
-        data += (
+        transform_data = (
             struct.pack("<i", self.parent_node)
             + self.scale.pack_f32()
             + self.translation.pack_f32()
             + self.rotation.pack()
         )
 
+        # so that loading the mesh computes nothing, see Mesh3D::HasAdditionalData
+        positions = [(v.position.x, v.position.y, v.position.z) for v in self.vertices]
+        normals = [(v.normal.x, v.normal.y, v.normal.z) for v in self.vertices]
+        uvs = [(v.uv.x, v.uv.y) for v in self.vertices]
+        tris = [tuple(t.vertIndices) for t in self.tris]
+
+        tangents_data = bytearray()
+        for t in compute_tangents(positions, normals, uvs, tris):
+            tangents_data += struct.pack("<ffff", *t)
+
+        meshlets, vertex_indices, primitives = compute_meshlets(tris, self.subsets)
+        meshlets_data = bytearray()
+        for meshlet in meshlets:
+            first_vert, num_verts, first_prim, num_prims, subset = meshlet
+            center, radius, cone, apex_offset = compute_cull_data(positions, meshlet, vertex_indices, primitives)
+            # MeshletData, the renderer sets the instance and maps the subset to its material
+            meshlets_data += struct.pack("<4I4fIf2I", num_verts, first_vert, num_prims, first_prim, *center, radius,
+                                         cone, apex_offset, 0, subset)
+
+        center, radius = bounding_sphere(positions)
+        bounds_data = struct.pack("<4f", *center, radius)
+
+        sections = [
+            (SECTION_INDICES, 4, indices_data),
+            (SECTION_POSITIONS, 12, positions_data),
+            (SECTION_NORMALS, 12, normals_data),
+            (SECTION_TANGENTS, 16, tangents_data),
+            (SECTION_UVS, 8, uvs_data),
+        ]
+        if self.skinned:
+            sections.append((SECTION_BLEND_WEIGHTS_AND_INDICES, 8, weights_and_indices))
+        sections += [
+            (SECTION_SUBSETS, 16, subsets_data),
+            (SECTION_STRINGS, 1, strings),
+            (SECTION_MESHLETS, 48, meshlets_data),
+            (SECTION_MESHLET_VERTEX_INDICES, 1, struct.pack("<{}I".format(len(vertex_indices)), *vertex_indices)),
+            (SECTION_MESHLET_PRIMITIVES, 4, struct.pack("<{}I".format(len(primitives)), *primitives)),
+            (SECTION_BOUNDS, 16, bounds_data),
+            (SECTION_TRANSFORM, 44, transform_data),
+        ]
+
+        flags = MESH_FLAG_SKINNED if self.skinned else 0
+        data = pack_mesh_container(len(self.vertices), len(self.tris) * 3, len(self.subsets), flags, sections)
+
         with open(outfile, "wb") as f:
             f.write(data)
 
@@ -530,9 +778,7 @@ class GLTFConvert:
             values = self.get_values(idx)
             normals = [Vec3(v[0], v[1], v[2]) for v in values]
 
-            # if attributes.get('TANGENT', None) is not None:
-            #     pass # TODO compute if not present
-
+            # tangents are computed in Mesh.pack, like the runtime computes them for files without them
             idx = attributes.get("TEXCOORD_0", None)
             if idx is not None:
                 assert self.accessors[idx]["componentType"] == FLOAT32
@@ -0,0 +1,94 @@
+# Rewrite legacy headerless .mesh files into the sectioned container format
+# python3 migrate_mesh.py OPTIM_knight/*.mesh
+import struct
+import argparse
+
+from gltf import (
+    pack_mesh_container,
+    MESH_FLAG_SKINNED,
+    MESH_MAGIC,
+    SECTION_INDICES,
+    SECTION_POSITIONS,
+    SECTION_NORMALS,
+    SECTION_UVS,
+    SECTION_BLEND_WEIGHTS_AND_INDICES,
+    SECTION_SUBSETS,
+    SECTION_STRINGS,
+    SECTION_TRANSFORM,
+)
+
+MAX_PATH = 260
+LEGACY_SUBSET_SIZE = 8 + MAX_PATH * 2
+TRANSFORM_SIZE = 44
+
+
+def migrate(infile):
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    (magic,) = struct.unpack_from("<I", data, 0)
+    if magic == MESH_MAGIC:
+        print("{}: already migrated".format(infile))
+        return
+
+    num_verts, num_indices, num_subsets = struct.unpack_from("<III", data, 0)
+    offset = 12
+
+    indices_data = data[offset : offset + num_indices * 4]
+    offset += num_indices * 4
+
+    strings = bytearray()
+    subsets_data = bytearray()
+    for i in range(num_subsets):
+        start, count = struct.unpack_from("<II", data, offset)
+        name = data[offset + 8 : offset + LEGACY_SUBSET_SIZE].decode("utf-16le").split("\0")[0].encode("utf-8")
+        subsets_data += struct.pack("<IIII", start, count, len(strings), len(name))
+        strings += name + b"\0"
+        offset += LEGACY_SUBSET_SIZE
+
+    positions_data = data[offset : offset + num_verts * 12]
+    offset += num_verts * 12
+    normals_data = data[offset : offset + num_verts * 12]
+    offset += num_verts * 12
+    uvs_data = data[offset : offset + num_verts * 8]
+    offset += num_verts * 8
+
+    # the legacy format does not say whether blend weights are present
+    remaining = len(data) - offset
+    skinned = remaining == num_verts * 8 + TRANSFORM_SIZE
+    assert skinned or remaining == TRANSFORM_SIZE
+
+    sections = [
+        (SECTION_INDICES, 4, indices_data),
+        (SECTION_POSITIONS, 12, positions_data),
+        (SECTION_NORMALS, 12, normals_data),
+        (SECTION_UVS, 8, uvs_data),
+    ]
+
+    if skinned:
+        sections.append((SECTION_BLEND_WEIGHTS_AND_INDICES, 8, data[offset : offset + num_verts * 8]))
+        offset += num_verts * 8
+
+    sections += [
+        (SECTION_SUBSETS, 16, subsets_data),
+        (SECTION_STRINGS, 1, strings),
+        (SECTION_TRANSFORM, TRANSFORM_SIZE, data[offset : offset + TRANSFORM_SIZE]),
+    ]
+
+    flags = MESH_FLAG_SKINNED if skinned else 0
+    out = pack_mesh_container(num_verts, num_indices, num_subsets, flags, sections)
+
+    with open(infile, "wb") as f:
+        f.write(out)
+
+    print("{}: {} -> {} bytes{}".format(infile, len(data), len(out), " (skinned)" if skinned else ""))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Migrate legacy .mesh files to the container format")
+    parser.add_argument("infiles", nargs="+", help="legacy .mesh files, rewritten in place")
+
+    args = parser.parse_args()
+
+    for f in args.infiles:
+        migrate(f)
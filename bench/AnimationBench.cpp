@@ -0,0 +1,722 @@
+#include "stdafx_assets.h"
+
+#include "Bench.h"
+
+#include "AnimationFormat.h"
+#include "AnimationLod.h"
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Legacy.h"
+#include "Mesh.h"
+#include "PoseBatch.h"
+#include "PoseCache.h"
+#include "Stats.h"
+
+using namespace DirectX;
+
+// ========== skeleton
+
+// Poses of rigs the size of the sample models, the legacy evaluation (see Legacy.h) against the flat skeleton
+int Skeleton(const Options& options)
+{
+  const size_t evaluations = options.Get("evaluations", 20000);
+  const size_t numKeyframes = options.Get("keyframes", 60);
+  const std::filesystem::path dir = options.Dir();
+
+  // bone counts in the range of the sample models, or a single custom size
+  std::vector<std::pair<std::string, uint32_t>> rigs = {
+      {"CesiumMan-sized", 22},
+      {"BrainStem-sized", 40},
+      {"knight-sized", 67},
+  };
+  if (size_t bones = options.Get("bones", 0); bones > 1) {
+    rigs = {{"custom", static_cast<uint32_t>(bones)}};
+  }
+
+  printf("%-16s %6s %6s %12s %12s %8s\n", "rig", "bones", "joints", "legacy us", "flat us", "speedup");
+
+  for (const auto& [name, numBones] : rigs) {
+    Rig rig = LoadRig(dir, numBones, static_cast<uint32_t>(numKeyframes), 30.f, numBones);
+    const Skin& skin = *rig.skin;
+    const Animation& animation = *rig.animation;
+
+    Legacy::Skeleton legacySkeleton(skin);
+    Legacy::Clip legacyClip(animation);
+    std::unordered_map<int, XMMATRIX> legacyGlobals;
+    std::vector<XMMATRIX> globals;
+
+    const float duration = animation.maxTime - animation.minTime;
+    auto timeAt = [&](size_t i) { return animation.minTime + std::fmod(i / 60.f, duration); };
+
+    float sink = 0.f;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < evaluations; i++) {
+      sink += Legacy::BoneTransforms(legacyClip, timeAt(i), legacySkeleton, skin, legacyGlobals)[0].m[3][0];
+    }
+    Milliseconds legacyTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (size_t i = 0; i < evaluations; i++) {
+      sink += animation.BoneTransforms(timeAt(i), &skin, globals)[0].m[3][0];
+    }
+    Milliseconds flatTime = Clock::now() - start;
+
+    g_Sink = sink;
+
+    double legacyUs = legacyTime.count() * 1000.0 / evaluations;
+    double flatUs = flatTime.count() * 1000.0 / evaluations;
+    printf("%-16s %6u %6u %12.3f %12.3f %7.2fx\n", name.c_str(), numBones, skin.header.numJoints, legacyUs, flatUs,
+           legacyUs / flatUs);
+  }
+
+  return 0;
+}
+
+// ========== tracks
+
+// Long mocap-like clips sampled at random times, so every lookup searches its track from scratch
+int Tracks(const Options& options)
+{
+  const size_t numBones = options.Get("bones", 67);
+  const size_t seconds = options.Get("seconds", 60);
+  const size_t fps = options.Get("fps", 120);
+  const size_t evaluations = options.Get("evaluations", 2000);
+  const size_t legacyEvaluations = options.Get("legacy", 20);
+  const std::filesystem::path dir = options.Dir();
+
+  const size_t numKeyframes = seconds * fps + 1;
+  Rig rig = LoadRig(dir, static_cast<uint32_t>(numBones), static_cast<uint32_t>(numKeyframes), static_cast<float>(fps), 1);
+  const Skin& skin = *rig.skin;
+  const Animation& animation = *rig.animation;
+
+  Legacy::Skeleton legacySkeleton(skin);
+  Legacy::Clip legacyClip(animation);
+  std::unordered_map<int, XMMATRIX> legacyGlobals;
+  std::vector<XMMATRIX> globals;
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> randomTime(animation.minTime, animation.maxTime);
+
+  std::vector<float> sampleTimes(std::max(evaluations, legacyEvaluations));
+  for (auto& t : sampleTimes) t = randomTime(rng);
+
+  float sink = 0.f;
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < legacyEvaluations; i++) {
+    sink += Legacy::BoneTransforms(legacyClip, sampleTimes[i], legacySkeleton, skin, legacyGlobals)[0].m[3][0];
+  }
+  Milliseconds legacyTime = Clock::now() - start;
+
+  start = Clock::now();
+  for (size_t i = 0; i < evaluations; i++) {
+    sink += animation.BoneTransforms(sampleTimes[i], &skin, globals)[0].m[3][0];
+  }
+  Milliseconds tracksTime = Clock::now() - start;
+
+  g_Sink = sink;
+
+  double legacyUs = legacyTime.count() * 1000.0 / legacyEvaluations;
+  double tracksUs = tracksTime.count() * 1000.0 / evaluations;
+  size_t clipBytes = sizeof(float) * animation.times.size() + sizeof(XMFLOAT3) * animation.scales.size() +
+                     sizeof(XMFLOAT3) * animation.translations.size() + sizeof(XMFLOAT4) * animation.rotations.size();
+
+  printf("%zu bones, %zu tracks of %zu keys (%zu s at %zu fps), %.2f MiB of keys\n", numBones, animation.tracks.size(),
+         numKeyframes, seconds, fps, ToMiB(clipBytes));
+  printf("legacy (copy + linear scan): %10.3f us per pose\n", legacyUs);
+  printf("tracks (binary search):      %10.3f us per pose, %.1f ns per bone, %.1fx faster\n", tracksUs,
+         tracksUs * 1000.0 / numBones, legacyUs / tracksUs);
+
+  return 0;
+}
+
+// ========== cursors
+
+// Many characters playing the same clip forward, each with its own phase, as AnimationInfo does every frame.
+// With per-instance cursors the frame time should not depend on the clip length
+int Cursors(const Options& options)
+{
+  const size_t numInstances = options.Get("instances", 32);
+  const size_t numBones = options.Get("bones", 67);
+  const size_t fps = options.Get("fps", 120);
+  const size_t numFrames = options.Get("frames", 600);
+  const std::filesystem::path dir = options.Dir();
+
+  printf("%zu instances of %zu bones, %zu frames at 60 Hz\n", numInstances, numBones, numFrames);
+  printf("%10s %10s %16s %16s\n", "clip s", "keys", "search us/frame", "cursor us/frame");
+
+  for (size_t seconds : {10, 60, 240}) {
+    const size_t numKeyframes = seconds * fps + 1;
+    auto [skin, animation] =
+        LoadRig(dir, static_cast<uint32_t>(numBones), static_cast<uint32_t>(numKeyframes), static_cast<float>(fps), 1);
+
+    std::vector<AnimationInfo> instances(numInstances);
+    std::vector<std::vector<XMMATRIX>> searchGlobals(numInstances);
+    for (size_t i = 0; i < numInstances; i++) {
+      instances[i].animation = animation;
+    }
+
+    auto instanceTime = [&](size_t instance, size_t frame) { return instance * 0.37f + frame / 60.f; };
+
+    float sink = 0.f;
+
+    // search only: same wrapping as AnimationInfo, without cursors
+    auto start = Clock::now();
+    for (size_t frame = 0; frame < numFrames; frame++) {
+      for (size_t i = 0; i < numInstances; i++) {
+        float duration = animation->maxTime - animation->minTime;
+        float curTime = animation->minTime + std::fmod(instanceTime(i, frame), duration);
+        sink += animation->BoneTransforms(curTime, skin.get(), searchGlobals[i])[0].m[3][0];
+      }
+    }
+    Milliseconds searchTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (size_t frame = 0; frame < numFrames; frame++) {
+      for (size_t i = 0; i < numInstances; i++) {
+        sink += instances[i].BoneTransforms(instanceTime(i, frame), skin.get())[0].m[3][0];
+      }
+    }
+    Milliseconds cursorTime = Clock::now() - start;
+
+    g_Sink = sink;
+
+    printf("%10zu %10zu %16.2f %16.2f\n", seconds, numKeyframes, searchTime.count() * 1000.0 / numFrames,
+           cursorTime.count() * 1000.0 / numFrames);
+  }
+
+  return 0;
+}
+
+// ========== batch
+
+// A crowd of one character, every instance at its own phase: one pose per instance with the scalar path,
+// then all of them through PoseBatch
+int Batch(const Options& options)
+{
+  const size_t numInstances = options.Get("instances", 256);
+  const size_t numBones = options.Get("bones", 67);
+  const size_t numFrames = options.Get("frames", 120);
+  const std::filesystem::path dir = options.Dir();
+
+  auto [skin, animation] = LoadRig(dir, static_cast<uint32_t>(numBones), 301, 30.f, 1);
+
+  std::vector<AnimationInfo> scalarInstances(numInstances), batchInstances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    scalarInstances[i].animation = animation;
+    batchInstances[i].animation = animation;
+  }
+
+  auto instanceTime = [&](size_t instance, size_t frame) { return instance * 0.37f + frame / 60.f; };
+
+  printf("%zu instances of %zu bones, %zu frames at 60 Hz, %s (%zu lanes)\n", numInstances, numBones, numFrames,
+         PoseBatch::InstructionSet(), PoseBatch::Width());
+
+  float sink = 0.f;
+
+  auto start = Clock::now();
+  for (size_t frame = 0; frame < numFrames; frame++) {
+    for (size_t i = 0; i < numInstances; i++) {
+      sink += scalarInstances[i].BoneTransforms(instanceTime(i, frame), skin.get())[0].m[3][0];
+    }
+  }
+  Milliseconds scalarTime = Clock::now() - start;
+
+  std::vector<PoseBatch::Instance> batch(numInstances);
+
+  start = Clock::now();
+  for (size_t frame = 0; frame < numFrames; frame++) {
+    for (size_t i = 0; i < numInstances; i++) {
+      batch[i] = PoseBatch::Prepare(batchInstances[i], instanceTime(i, frame), skin.get());
+    }
+    PoseBatch::Evaluate(*skin, batch);
+    sink += batchInstances[0].boneTransforms[skin.get()][0].m[3][0];
+  }
+  Milliseconds batchTime = Clock::now() - start;
+
+  g_Sink = sink;
+
+  double poses = static_cast<double>(numFrames * numInstances);
+  printf("%10s %12s %10s\n", "", "us/pose", "ms/frame");
+  printf("%10s %12.3f %10.3f\n", "scalar", scalarTime.count() * 1000.0 / poses, scalarTime.count() / numFrames);
+  printf("%10s %12.3f %10.3f\n", "batch", batchTime.count() * 1000.0 / poses, batchTime.count() / numFrames);
+  printf("speedup: %.2fx\n", scalarTime.count() / batchTime.count());
+
+  return 0;
+}
+
+// ========== compress
+
+// distinct cache lines read to sample every track at time, when the cursors are already on the right keys
+static size_t LinesTouched(const Animation& animation, float time)
+{
+  std::vector<uintptr_t> lines;
+  auto touch = [&](const void* p, size_t size) {
+    for (uintptr_t line = reinterpret_cast<uintptr_t>(p) / 64; line <= (reinterpret_cast<uintptr_t>(p) + size - 1) / 64;
+         line++) {
+      lines.push_back(line);
+    }
+  };
+
+  for (size_t t = 0; t < animation.tracks.size(); t++) {
+    const Animation::Track& track = animation.tracks[t];
+    size_t key = animation.FindKey(track, time);
+    size_t keys[2] = {key, std::min<size_t>(key + 1, track.numKeys - 1)};
+
+    touch(&track, sizeof(track));
+
+    for (size_t k : keys) {
+      touch(&animation.times[track.firstKey + k], sizeof(float));
+
+      if (animation.Compressed()) {
+        const auto& c = animation.trackChannels[t];
+        touch(&c, sizeof(c));
+        touch(&animation.packedRotations[c.firstRotation + k * c.rotationStride], sizeof(AnimationFormat::PackedQuaternion));
+        touch(&animation.packedTranslations[c.firstTranslation + k * c.translationStride], sizeof(AnimationFormat::PackedVector));
+        touch(&animation.packedScales[c.firstScale + k * c.scaleStride], sizeof(AnimationFormat::PackedVector));
+      } else {
+        touch(&animation.scales[track.firstKey + k], sizeof(XMFLOAT3));
+        touch(&animation.translations[track.firstKey + k], sizeof(XMFLOAT3));
+        touch(&animation.rotations[track.firstKey + k], sizeof(XMFLOAT4));
+      }
+    }
+  }
+
+  std::sort(lines.begin(), lines.end());
+  return std::unique(lines.begin(), lines.end()) - lines.begin();
+}
+
+// Offline compression of a clip, from files (--anim, --skin, optionally --transforms) or a generated rig.
+// Then poses sampled at random times from many copies of the clip, more than the caches hold
+int Compress(const Options& options)
+{
+  const size_t numBones = options.Get("bones", 67);
+  const size_t seconds = options.Get("seconds", 60);
+  const size_t fps = options.Get("fps", 30);
+  const size_t numClips = options.Get("clips", 16);
+  const size_t numPoses = options.Get("poses", 20000);
+  const std::filesystem::path dir = options.Dir();
+
+  AnimationFormat::Settings settings;
+  settings.tolerance = std::stof(options.Get("tolerance", std::to_string(settings.tolerance)));
+
+  std::filesystem::path animPath = options.Get("anim", "");
+  std::filesystem::path skinPath = options.Get("skin", "");
+  std::filesystem::path transformsPath = options.Get("transforms", "");
+
+  if (animPath.empty() != skinPath.empty()) {
+    fprintf(stderr, "--anim and --skin go together\n");
+    return 1;
+  }
+  if (animPath.empty()) {
+    WriteRig(dir, static_cast<uint32_t>(numBones), static_cast<uint32_t>(seconds * fps + 1), static_cast<float>(fps), 1);
+
+    animPath = dir / "rig.anim";
+    skinPath = dir / "rig.skin";
+    transformsPath = dir / "rig.transforms";
+  }
+
+  Skin skin;
+  skin.Read(skinPath);
+  if (!transformsPath.empty()) skin.ReadStaticTransforms(transformsPath);
+
+  Animation raw;
+  raw.Read(animPath);
+  if (raw.Compressed()) {
+    fprintf(stderr, "%s is already compressed\n", animPath.string().c_str());
+    return 1;
+  }
+
+  AnimationFormat::Report report;
+  auto start = Clock::now();
+  Animation compressed = AnimationFormat::Compress(raw, skin, settings, &report);
+  Milliseconds compressTime = Clock::now() - start;
+
+  printf("%s: %zu tracks, %.2f s, compressed in %.1f ms\n", animPath.string().c_str(), raw.tracks.size(),
+         raw.maxTime - raw.minTime, compressTime.count());
+  printf("keys: %zu -> %zu (%.1f%%)\n", report.rawKeys, report.keptKeys, 100.0 * report.keptKeys / report.rawKeys);
+  printf("memory: %.1f KiB -> %.1f KiB, ratio %.2f\n", report.rawBytes / 1024.0, report.compressedBytes / 1024.0,
+         static_cast<double>(report.rawBytes) / report.compressedBytes);
+  printf("max joint position error: %g (tolerance %g)\n", report.maxJointError, settings.tolerance);
+
+  std::string out = options.Get("out", "");
+  if (!out.empty()) {
+    if (!AnimationFormat::Save(out, compressed)) {
+      fprintf(stderr, "cannot write %s\n", out.c_str());
+      return 1;
+    }
+
+    Animation reloaded;
+    reloaded.Read(out);
+    float times[] = {raw.minTime, (raw.minTime + raw.maxTime) * .5f, raw.maxTime};
+    printf("wrote %s, %ju bytes, reload error %g\n", out.c_str(), static_cast<uintmax_t>(std::filesystem::file_size(out)),
+           AnimationFormat::MaxJointError(compressed, reloaded, skin, times));
+  }
+
+  std::vector<Animation> rawClips(numClips, raw);
+  std::vector<Animation> compressedClips(numClips, compressed);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> time(raw.minTime, raw.maxTime);
+  std::uniform_int_distribution<size_t> pick(0, numClips - 1);
+
+  std::vector<std::pair<size_t, float>> samples(numPoses);
+  for (auto& sample : samples) {
+    sample = {pick(rng), time(rng)};
+  }
+
+  auto run = [&](const std::vector<Animation>& clips) {
+    std::vector<XMMATRIX> globals;
+    float sink = 0.f;
+    size_t lines = 0;
+
+    auto start = Clock::now();
+    for (const auto& [clip, t] : samples) {
+      sink += clips[clip].BoneTransforms(t, &skin, globals)[0].m[3][0];
+    }
+    Milliseconds elapsed = Clock::now() - start;
+
+    const size_t numCounted = std::min<size_t>(samples.size(), 256);
+    for (size_t i = 0; i < numCounted; i++) {
+      lines += LinesTouched(clips[samples[i].first], samples[i].second);
+    }
+
+    g_Sink = sink;
+
+    printf("%12s %14.1f %12.2f %16.1f\n", &clips == &rawClips ? "raw" : "compressed",
+           clips.size() * clips[0].SizeInBytes() / 1024.0 / 1024.0, elapsed.count() * 1000.0 / numPoses,
+           static_cast<double>(lines) / numCounted);
+  };
+
+  printf("\n%zu poses at random times from %zu copies of the clip\n", numPoses, numClips);
+  printf("%12s %14s %12s %16s\n", "", "clips MiB", "us/pose", "lines/pose");
+  run(rawClips);
+  run(compressedClips);
+
+  return 0;
+}
+
+// ========== posecache
+
+// A crowd playing one clip, evaluated like Renderer::Update does: every instance on its own,
+// then through the pose cache, in sync and with random offsets rounded to the cache bucket
+int PoseCacheBench(const Options& options)
+{
+  const size_t numBones = options.Get("bones", 67);
+  const size_t numFrames = options.Get("frames", 120);
+  const float maxOffset = std::stof(options.Get("offsets", "2"));
+  const std::filesystem::path dir = options.Dir();
+
+  auto [skin, animation] = LoadRig(dir, static_cast<uint32_t>(numBones), 301, 30.f, 1);
+
+  PoseCache cache(1.f / 30.f);
+
+  // ms per frame, and poses evaluated in the last frame
+  auto run = [&](std::vector<AnimationInfo>& instances, bool useCache) -> std::pair<double, size_t> {
+    std::vector<XMFLOAT4X4> boneMatrices(instances.size() * skin->header.numJoints);
+    std::vector<PoseBatch::Instance> batch;
+    float sink = 0.f;
+
+    auto start = Clock::now();
+    for (size_t frame = 0; frame < numFrames; frame++) {
+      float time = frame / 60.f;
+      cache.Clear();
+      batch.clear();
+
+      for (auto& info : instances) {
+        float clipTime = info.ClipTime(time + info.timeOffset);
+
+        if (useCache) {
+          auto pose = cache.Find(info, time, skin.get());
+          if (!pose.first) continue;
+
+          clipTime = pose.clipTime;
+        }
+
+        auto instance = PoseBatch::Prepare(info, time, skin.get());
+        instance.time = clipTime;
+        instance.boneTransforms = boneMatrices.data() + batch.size() * skin->header.numJoints;
+        batch.push_back(instance);
+      }
+
+      PoseBatch::Evaluate(*skin, batch);
+      sink += boneMatrices[0].m[3][0];
+    }
+    Milliseconds elapsed = Clock::now() - start;
+
+    g_Sink = sink;
+
+    return {elapsed.count() / numFrames, batch.size()};
+  };
+
+  printf("%zu bones, %zu frames, offsets up to %g s in buckets of %g s\n", numBones, numFrames, maxOffset,
+         cache.Bucket());
+  printf("%10s %14s %20s %24s\n", "instances", "no cache ms", "in sync ms (poses)", "offsets ms (poses)");
+
+  for (size_t numInstances : {1, 4, 16, 64, 256, 1024}) {
+    std::vector<AnimationInfo> instances(numInstances);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> offset(0.f, maxOffset);
+    for (auto& info : instances) {
+      info.animation = animation;
+    }
+
+    auto [uncached, all] = run(instances, false);
+    auto [synced, syncedPoses] = run(instances, true);
+
+    for (auto& info : instances) {
+      info.timeOffset = offset(rng);
+    }
+    auto [offsets, offsetPoses] = run(instances, true);
+
+    printf("%10zu %14.3f %13.3f (%4zu) %17.3f (%4zu)\n", numInstances, uncached, synced, syncedPoses, offsets,
+           offsetPoses);
+  }
+
+  return 0;
+}
+
+// ========== lod
+
+// A crowd spread up to --distance away from the camera, every instance at its own phase, posed the way
+// Renderer::Update does: every frame, then with the animation LOD holding and blending the far poses.
+// The error of an instance is its largest bone matrix difference to the pose of the frame, in model units for
+// the translations; the clip wraps with a jump of the root, hence the percentiles rather than the maximum
+int LodBench(const Options& options)
+{
+  const size_t numInstances = options.Get("instances", 1024);
+  const size_t numBones = options.Get("bones", 67);
+  const size_t numFrames = options.Get("frames", 240);
+  const float maxDistance = std::stof(options.Get("distance", "120"));
+  const std::filesystem::path dir = options.Dir();
+
+  auto [skin, animation] = LoadRig(dir, static_cast<uint32_t>(numBones), 301, 30.f, 1);
+
+  const size_t numJoints = skin->header.numJoints;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  std::vector<AnimationInfo> instances(numInstances), references(numInstances);
+  std::vector<float> distances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    instances[i].animation = animation;
+    instances[i].timeOffset = unit(rng) * 10.f;
+    references[i] = instances[i];
+    distances[i] = unit(rng) * maxDistance;
+  }
+
+  struct Result {
+    double averageMs = 0.0, maxMs = 0.0;
+    size_t averagePoses = 0, maxPoses = 0;
+    std::vector<float> errors;  // per instance and frame, sorted
+  };
+
+  std::vector<XMFLOAT4X4> boneMatrices(numInstances * numJoints);
+  std::vector<XMFLOAT4X4> expected(numInstances * numJoints);
+  std::vector<PoseBatch::Instance> batch;
+
+  // lod is null to pose every instance every frame
+  auto run = [&](AnimationLod* lod, std::vector<AnimationInfo>& infos) {
+    Result result;
+    std::vector<std::pair<AnimationLod::Pose*, size_t>> lodPoses;
+    PoseCache cache;  // no bucket, every instance keeps its own phase
+
+    for (size_t frame = 0; frame < numFrames; frame++) {
+      float time = frame / 60.f;
+
+      auto start = Clock::now();
+      batch.clear();
+      lodPoses.clear();
+      if (lod) lod->BeginFrame(time);
+
+      for (size_t i = 0; i < numInstances; i++) {
+        XMFLOAT4X4* out = boneMatrices.data() + i * numJoints;
+
+        if (auto pose = lod ? lod->Find(infos[i], skin.get(), distances[i], cache).pose : nullptr) {
+          if (pose->NeedsEvaluation()) {
+            batch.push_back(PoseBatch::Prepare(infos[i], time, skin.get()));
+            batch.back().time = pose->Time();
+            batch.back().boneTransforms = pose->Target();
+          }
+          lodPoses.push_back({pose, i});
+          continue;
+        }
+
+        batch.push_back(PoseBatch::Prepare(infos[i], time, skin.get()));
+        batch.back().boneTransforms = out;
+      }
+
+      PoseBatch::Evaluate(*skin, batch);
+
+      for (auto [pose, i] : lodPoses) {
+        pose->Resolve(boneMatrices.data() + i * numJoints);
+      }
+      Milliseconds elapsed = Clock::now() - start;
+
+      // the first frame poses everyone, whatever the distance
+      if (frame > 0) {
+        result.averageMs += elapsed.count() / (numFrames - 1);
+        result.maxMs = std::max(result.maxMs, elapsed.count());
+        result.averagePoses += batch.size();
+        result.maxPoses = std::max(result.maxPoses, batch.size());
+      }
+
+      // what every frame posing would show, not timed
+      if (lod) {
+        for (size_t i = 0; i < numInstances; i++) {
+          auto reference = PoseBatch::Prepare(references[i], time, skin.get());
+          reference.boneTransforms = expected.data() + i * numJoints;
+          batch.resize(1);
+          batch[0] = reference;
+          PoseBatch::Evaluate(*skin, batch);
+        }
+        for (size_t i = 0; i < numInstances; i++) {
+          result.errors.push_back(MaxDifference(std::span(expected).subspan(i * numJoints, numJoints),
+                                                std::span(boneMatrices).subspan(i * numJoints, numJoints)));
+        }
+      }
+    }
+    result.averagePoses /= numFrames - 1;
+    std::sort(result.errors.begin(), result.errors.end());
+
+    return result;
+  };
+
+  printf("%zu instances of %zu bones up to %g away, %zu frames\n", numInstances, numBones, maxDistance, numFrames);
+  printf("%14s %8s %8s %10s %10s %12s %12s\n", "", "ms avg", "ms max", "poses avg", "poses max", "error 50%",
+         "error 99%");
+
+  auto print = [](const char* name, const Result& r) {
+    auto percentile = [&r](size_t p) { return r.errors.empty() ? 0.f : r.errors[(r.errors.size() - 1) * p / 100]; };
+    printf("%14s %8.3f %8.3f %10zu %10zu %12.5f %12.5f\n", name, r.averageMs, r.maxMs, r.averagePoses, r.maxPoses,
+           percentile(50), percentile(99));
+  };
+
+  print("every frame", run(nullptr, instances));
+
+  for (bool interpolate : {false, true}) {
+    std::vector<AnimationInfo> infos = instances;
+    AnimationLod lod({.interpolate = interpolate});
+    print(interpolate ? "lod, blended" : "lod, held", run(&lod, infos));
+  }
+
+  return 0;
+}
+
+// ========== update
+
+// The per frame work of Renderer::Update on a large scene, for a growing number of job workers:
+// poses of the characters, then world and normal matrices of every mesh instance into a staging array.
+// The first instances are props parented to a bone of a character, the others are static
+int UpdateBench(const Options& options)
+{
+  const size_t numInstances = options.Get("instances", 16384);
+  const size_t numCharacters = options.Get("characters", 1024);
+  const size_t numBones = options.Get("bones", 67);
+  const size_t numFrames = options.Get("frames", 60);
+  const size_t maxWorkers = options.Get("workers", std::max<size_t>(std::thread::hardware_concurrency(), 4) - 1);
+  const std::filesystem::path dir = options.Dir();
+
+  auto [skin, animation] = LoadRig(dir, static_cast<uint32_t>(numBones), 301, 30.f, 1);
+
+  // same outputs as MeshInstanceData
+  struct StagedInstance {
+    XMFLOAT4X4 worldMatrix;
+    XMFLOAT3X3 normalMatrix;
+    float scale;
+  };
+  struct Node {
+    XMFLOAT4X4 model;
+    XMFLOAT4X4 local;
+    size_t character;  // parent character, or numCharacters
+    int bone;
+  };
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  std::vector<AnimationInfo> characters(numCharacters);
+  for (auto& info : characters) {
+    info.animation = animation;
+    info.timeOffset = unit(rng) * 10.f;
+  }
+
+  std::vector<Node> nodes(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    XMMATRIX model = XMMatrixAffineTransformation(
+        XMVectorReplicate(0.5f + unit(rng)), XMVectorZero(),
+        XMQuaternionRotationRollPitchYawFromVector(XMVectorSet(unit(rng) * XM_2PI, unit(rng) * XM_2PI, 0.f, 0.f)),
+        XMVectorSet(unit(rng) * 100.f, 0.f, unit(rng) * 100.f, 1.f));
+    XMStoreFloat4x4(&nodes[i].model, model);
+    XMStoreFloat4x4(&nodes[i].local, XMMatrixTranslation(0.f, unit(rng), 0.f));
+    nodes[i].character = i < numCharacters ? i : numCharacters;
+    nodes[i].bone = static_cast<int>(i % numBones);
+  }
+
+  std::vector<StagedInstance> staged(numInstances);
+  std::vector<XMFLOAT4X4> boneMatrices(numCharacters * skin->header.numJoints);
+  std::vector<PoseBatch::Instance> batch(numCharacters);
+
+  auto frame = [&](float time) {
+    for (size_t i = 0; i < numCharacters; i++) {
+      batch[i] = PoseBatch::Prepare(characters[i], time, skin.get());
+      batch[i].boneTransforms = boneMatrices.data() + i * skin->header.numJoints;
+    }
+    PoseBatch::Evaluate(*skin, batch);
+
+    Jobs::ParallelForChunks(numInstances, 256, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const Node& node = nodes[i];
+
+        XMMATRIX world = XMLoadFloat4x4(&node.local);
+        if (node.character < numCharacters) {
+          world = world * characters[node.character].globalTransforms[skin.get()][node.bone];
+        }
+        world = world * XMLoadFloat4x4(&node.model);
+
+        XMStoreFloat4x4(&staged[i].worldMatrix, XMMatrixTranspose(world));
+        XMStoreFloat3x3(&staged[i].normalMatrix, XMMatrixInverse(nullptr, world));
+
+        XMVECTOR scale, rot, pos;
+        XMMatrixDecompose(&scale, &rot, &pos, world);
+        staged[i].scale = XMVectorGetX(scale);
+      }
+    });
+  };
+
+  printf("%zu instances, %zu characters of %zu bones, %zu frames, %s (%zu lanes), %u cores\n", numInstances,
+         numCharacters, numBones, numFrames, PoseBatch::InstructionSet(), PoseBatch::Width(),
+         std::thread::hardware_concurrency());
+  printf("%10s %10s %10s\n", "workers", "ms/frame", "speedup");
+
+  const size_t defaultWorkers = Jobs::NumWorkers();
+  double serialTime = 0.0;
+
+  for (size_t numWorkers : WorkerCounts(maxWorkers)) {
+    Jobs::Shutdown();
+    Jobs::Init(numWorkers);
+
+    // warm up, then the same frames for every worker count
+    frame(0.f);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numFrames; i++) {
+      frame(i / 60.f);
+    }
+    Milliseconds elapsed = Clock::now() - start;
+    double msPerFrame = elapsed.count() / numFrames;
+
+    if (numWorkers == 0) serialTime = msPerFrame;
+
+    printf("%10zu %10.3f %9.2fx\n", numWorkers, msPerFrame, serialTime / msPerFrame);
+  }
+
+  Jobs::Shutdown();
+  Jobs::Init(defaultWorkers);
+
+  g_Sink = staged[0].scale;
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "stdafx_assets.h"
+
+#include "Bench.h"
+
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Mesh.h"
+#include "Stats.h"
+
+// Headless benchmarks of the Assets library.
+//   AssetsBench <command> [--option value]...
+
+volatile float g_Sink;
+
+std::filesystem::path Options::Dir() const
+{
+  auto it = values.find("dir");
+  if (it == values.end()) return FixtureDirectory("AssetsBench");
+
+  std::filesystem::create_directories(it->second);
+  return it->second;
+}
+
+std::vector<size_t> WorkerCounts(size_t maxWorkers)
+{
+  std::vector<size_t> counts = {0};
+  for (size_t n = 1; n < maxWorkers; n *= 2) {
+    counts.push_back(n);
+  }
+  if (maxWorkers > 0) counts.push_back(maxWorkers);
+
+  return counts;
+}
+
+// ========== parse
+
+static int Parse(const Options& options)
+{
+  const size_t numMeshes = options.Get("meshes", 64);
+  const size_t gridSize = options.Get("grid", 128);
+  const size_t iterations = options.Get("iterations", 3);
+  const std::filesystem::path dir = options.Dir();
+
+  std::vector<std::filesystem::path> files(numMeshes);
+  size_t totalBytes = 0;
+  for (size_t i = 0; i < numMeshes; i++) {
+    files[i] = dir / ("grid_" + std::to_string(i) + ".mesh");
+    totalBytes += WriteGridMesh(files[i], static_cast<uint32_t>(gridSize), static_cast<uint32_t>(i));
+    std::filesystem::remove(std::filesystem::path(files[i]).replace_extension(".meshcache"));
+  }
+
+  printf("%zu meshes, %zu vertices each, %.2f MiB, %zu workers\n", numMeshes, gridSize * gridSize, ToMiB(totalBytes),
+         Jobs::NumWorkers());
+
+  auto run = [&](const char* label) {
+    std::vector<std::shared_ptr<Mesh3D>> meshes(numMeshes);
+
+    auto start = Clock::now();
+    Jobs::ParallelFor(numMeshes, [&](size_t i) {
+      meshes[i] = std::make_shared<Mesh3D>();
+      meshes[i]->Read(files[i]);
+    });
+    Milliseconds time = Clock::now() - start;
+
+    double seconds = time.count() / 1000.0;
+    printf("%-36s %10.2f ms %10.2f MiB/s %10.2f meshes/s\n", label, time.count(), ToMiB(totalBytes) / seconds,
+           numMeshes / seconds);
+  };
+
+  // the first pass builds the .meshcache files, the following ones read them back
+  run("cold (compute + write cache)");
+  for (size_t i = 0; i < iterations; i++) {
+    run("warm (cache hit)");
+  }
+
+  printf("peak RSS: %.2f MiB\n", ToMiB(PeakResidentSetSize()));
+
+  return 0;
+}
+
+// ========== main
+
+struct Command {
+  const char* name;
+  const char* help;
+  int (*run)(const Options&);
+};
+
+static const Command g_Commands[] = {
+    {"parse", "--meshes N --grid N --iterations N --dir PATH   read generated meshes, cold then warm cache", Parse},
+    {"skeleton", "--bones N --keyframes N --evaluations N --dir PATH   pose evaluation, hash map walk vs flat skeleton",
+     Skeleton},
+    {"tracks", "--bones N --seconds N --fps N --evaluations N --legacy N --dir PATH   random sampling of a long clip",
+     Tracks},
+    {"cursors", "--instances N --bones N --fps N --frames N --dir PATH   forward playback, search vs cursors", Cursors},
+    {"batch", "--instances N --bones N --frames N --dir PATH   crowd poses, one at a time vs SIMD batches", Batch},
+    {"compress",
+     "--anim PATH --skin PATH --transforms PATH --out PATH --tolerance F --bones N --seconds N --fps N --clips N "
+     "--poses N --dir PATH   clip compression, generated rig unless --anim is given",
+     Compress},
+    {"posecache", "--bones N --frames N --offsets SECONDS --dir PATH   crowd in sync, without and with the pose cache",
+     PoseCacheBench},
+    {"lod", "--instances N --bones N --frames N --distance F --dir PATH   crowd posed every frame vs animation LOD",
+     LodBench},
+    {"skinning", "--vertices N --bones N --frames N   CPU skinning of positions, normals and tangents", SkinningBench},
+    {"update",
+     "--instances N --characters N --bones N --frames N --workers N --dir PATH   scene update, 0 to N job workers",
+     UpdateBench},
+    {"collider",
+     "--queries N --checked N --density N --dir PATH   floor and wall queries, linear scan vs hierarchy vs packets",
+     ColliderBench},
+    {"refresh", "--refreshes N --dir PATH   moving model, refresh vs rebuild against its triangle count",
+     RefreshBench},
+    {"crowd",
+     "--agents N --groups N --frames N --density N --workers N --dir PATH   batched floor and wall queries, 0 to N job "
+     "workers",
+     CrowdBench},
+    {"proxies", "--characters N --bones N --rays N --frames N   bone proxies of skinned characters vs their triangles",
+     ProxiesBench},
+};
+
+static void PrintHelp()
+{
+  printf(
+      "Command line syntax:\n"
+      "AssetsBench <command> [-j N] [options]\n"
+      "-j N   Use N worker threads (default: one per core, minus the main thread)\n\n");
+
+  for (const auto& command : g_Commands) {
+    printf("%s %s\n", command.name, command.help);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    PrintHelp();
+    return 1;
+  }
+
+  int first = 2;
+  int numWorkers = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+  if (argc > 3 && strcmp(argv[2], "-j") == 0) {
+    numWorkers = atoi(argv[3]);
+    first = 4;
+  }
+
+  Options options;
+  if (!options.Parse(argc, argv, first)) {
+    printf("ERROR: Invalid command line syntax.\n");
+    PrintHelp();
+    return -2;
+  }
+
+  for (const auto& command : g_Commands) {
+    if (strcmp(argv[1], command.name) != 0) continue;
+
+    Mesh3D::verbose = false;
+    Jobs::Init(numWorkers);
+
+    int result = command.run(options);
+
+    Jobs::Shutdown();
+
+    return result;
+  }
+
+  PrintHelp();
+  return 1;
+}
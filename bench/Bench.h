@@ -0,0 +1,60 @@
+#pragma once
+
+// Headless benchmarks of the Assets library, one command each, split by area.
+// What they time is checked by AssetsTests, see tests/Tests.h
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+// results of benchmarked calls are added here so they are not optimized away
+extern volatile float g_Sink;
+
+struct Options {
+  std::unordered_map<std::string, std::string> values;
+
+  bool Parse(int argc, char** argv, int first)
+  {
+    for (int i = first; i < argc; i += 2) {
+      if (strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc) return false;
+      values[argv[i] + 2] = argv[i + 1];
+    }
+    return true;
+  }
+
+  size_t Get(const std::string& key, size_t defaultValue) const
+  {
+    auto it = values.find(key);
+    return it == values.end() ? defaultValue : std::stoull(it->second);
+  }
+
+  std::string Get(const std::string& key, const std::string& defaultValue) const
+  {
+    auto it = values.find(key);
+    return it == values.end() ? defaultValue : it->second;
+  }
+
+  // --dir, or AssetsBench in the temporary directory. Created if needed
+  std::filesystem::path Dir() const;
+};
+
+// job worker counts from none to maxWorkers, doubling
+std::vector<size_t> WorkerCounts(size_t maxWorkers);
+
+// AnimationBench.cpp
+int Skeleton(const Options& options);
+int Tracks(const Options& options);
+int Cursors(const Options& options);
+int Batch(const Options& options);
+int Compress(const Options& options);
+int PoseCacheBench(const Options& options);
+int LodBench(const Options& options);
+int UpdateBench(const Options& options);
+
+// SkinningBench.cpp
+int SkinningBench(const Options& options);
+
+// ColliderBench.cpp
+int ColliderBench(const Options& options);
+int RefreshBench(const Options& options);
+int CrowdBench(const Options& options);
+int ProxiesBench(const Options& options);
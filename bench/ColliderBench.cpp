@@ -0,0 +1,428 @@
+#include "stdafx_assets.h"
+
+#include "Bench.h"
+
+#include "Collider.h"
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Mesh.h"
+#include "Skinning.h"
+
+using namespace DirectX;
+
+// ========== collider
+
+// Floor and wall queries at random points of growing scenes, linear scan vs hierarchy, then walls probed
+// in packets of 8 directions around each point.
+// --density is the number of buildings per 16 cells, 16 and more for dense interiors
+int ColliderBench(const Options& options)
+{
+  const size_t numQueries = options.Get("queries", 100000);
+  const size_t numChecked = options.Get("checked", 1000);
+  const size_t density = options.Get("density", 1);
+  const std::filesystem::path dir = options.Dir();
+
+  constexpr size_t PACKET_SIZE = 8;
+
+  printf("%10s %14s %14s %14s %14s %14s\n", "surfaces", "floor linear/s", "floor bvh/s", "wall linear/s",
+         "wall bvh/s", "wall packet/s");
+
+  for (uint32_t gridSize : {16, 64, 256, 512}) {
+    const uint32_t numBoxes = static_cast<uint32_t>(gridSize * gridSize * density / 16);
+    const auto file = dir / ("collider_" + std::to_string(gridSize) + ".mesh");
+    WriteColliderMesh(file, gridSize, numBoxes, gridSize);
+    std::filesystem::remove(std::filesystem::path(file).replace_extension(".meshcache"));
+
+    Model3D model;
+    model.AddMesh(file);
+
+    Collider collider;
+    collider.AppendModel(&model);
+
+    struct Query {
+      XMFLOAT3 point;
+      XMFLOAT3 direction;
+      std::array<XMFLOAT3, PACKET_SIZE> probes;  // direction first, then every 45 degrees
+    };
+    std::mt19937 rng(gridSize);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<Query> queries(numQueries);
+    for (auto& q : queries) {
+      float angle = unit(rng) * XM_2PI;
+      q.point = {unit(rng) * (gridSize - 1), unit(rng) * 12.f, unit(rng) * (gridSize - 1)};
+      q.direction = {std::cos(angle), 0.f, std::sin(angle)};
+      for (size_t k = 0; k < PACKET_SIZE; k++) {
+        float probe = angle + k * XM_2PI / PACKET_SIZE;
+        q.probes[k] = {std::cos(probe), 0.f, std::sin(probe)};
+      }
+    }
+
+    // queries per second over the first count queries
+    auto run = [&](size_t count, auto&& query) {
+      count = std::min(count, queries.size());
+      float sink = 0.f;
+
+      auto start = Clock::now();
+      for (size_t i = 0; i < count; i++) {
+        sink += query(queries[i]);
+      }
+      Milliseconds elapsed = Clock::now() - start;
+
+      g_Sink = sink;
+
+      return count / (elapsed.count() / 1000.0);
+    };
+
+    auto floorLinear = [&](const Query& q) {
+      float height;
+      return collider.FindFloorLinear(q.point, 0.f, height) ? height : 0.f;
+    };
+    auto floorBvh = [&](const Query& q) {
+      float height;
+      return collider.FindFloor(q.point, 0.f, height) ? height : 0.f;
+    };
+    auto wallLinear = [&](const Query& q) {
+      float distance;
+      return collider.FindWallLinear(XMLoadFloat3(&q.point), XMLoadFloat3(&q.direction), 0.f, distance) ? distance : 0.f;
+    };
+    auto wallBvh = [&](const Query& q) {
+      float distance;
+      return collider.FindWall(XMLoadFloat3(&q.point), XMLoadFloat3(&q.direction), 0.f, distance) ? distance : 0.f;
+    };
+
+    auto wallPacket = [&](const Query& q) {
+      std::array<Surface*, PACKET_SIZE> walls;
+      std::array<float, PACKET_SIZE> distances;
+      collider.FindWalls(XMLoadFloat3(&q.point), q.probes, 0.f, walls, distances);
+      return walls[0] ? distances[0] : 0.f;
+    };
+
+    // the linear scan is too slow for every query on the large scenes
+    double floorLinearRate = run(numChecked, floorLinear);
+    double floorBvhRate = run(numQueries, floorBvh);
+    double wallLinearRate = run(numChecked, wallLinear);
+    double wallBvhRate = run(numQueries, wallBvh);
+    double wallPacketRate = run(numQueries, wallPacket) * PACKET_SIZE;
+
+    printf("%10zu %14.0f %14.0f %14.0f %14.0f %14.0f\n", collider.NumSurfaces(), floorLinearRate, floorBvhRate,
+           wallLinearRate, wallBvhRate, wallPacketRate);
+  }
+
+  return 0;
+}
+
+// ========== refresh
+
+// A moving model of growing size: turning it and refreshing the collider, against appending it again to a new
+// collider, which is what the refresh did when surfaces were kept in world space
+int RefreshBench(const Options& options)
+{
+  const size_t numRefreshes = options.Get("refreshes", 10000);
+  const std::filesystem::path dir = options.Dir();
+
+  printf("%10s %14s %14s\n", "triangles", "refresh us", "rebuild ms");
+
+  for (uint32_t gridSize : {8, 32, 128, 512}) {
+    const uint32_t numBoxes = gridSize * gridSize / 16;
+    const auto file = dir / ("refresh_" + std::to_string(gridSize) + ".mesh");
+    size_t numTriangles = WriteColliderMesh(file, gridSize, numBoxes, gridSize);
+    std::filesystem::remove(std::filesystem::path(file).replace_extension(".meshcache"));
+
+    Model3D model;
+    model.AddMesh(file);
+
+    Collider collider;
+    collider.AppendModel(&model);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numRefreshes; i++) {
+      model.Rotate(0.f, i * 0.001f, 0.f);
+      collider.RefreshDynamicModels();
+    }
+    Milliseconds refresh = Clock::now() - start;
+
+    const size_t numRebuilds = std::max<size_t>(1, 1000000 / numTriangles);
+    start = Clock::now();
+    for (size_t i = 0; i < numRebuilds; i++) {
+      Collider rebuilt;
+      rebuilt.AppendModel(&model);
+    }
+    Milliseconds rebuild = Clock::now() - start;
+
+    printf("%10zu %14.3f %14.3f\n", numTriangles, refresh.count() * 1000.0 / numRefreshes,
+           rebuild.count() / numRebuilds);
+  }
+
+  return 0;
+}
+
+// ========== crowd
+
+// Floor and wall queries of a crowd each frame: agents in groups around the scene, in no particular order in
+// their array. One FindFloor and FindWall per agent in array order, then FindBatch for a growing number of job
+// workers
+int CrowdBench(const Options& options)
+{
+  const size_t numAgents = options.Get("agents", 4096);
+  const size_t numGroups = options.Get("groups", 64);
+  const size_t numFrames = options.Get("frames", 20);
+  const size_t density = options.Get("density", 4);
+  const size_t maxWorkers = options.Get("workers", std::max<size_t>(std::thread::hardware_concurrency(), 4) - 1);
+  const std::filesystem::path dir = options.Dir();
+
+  constexpr uint32_t GRID_SIZE = 256;
+  const auto file = dir / "crowd.mesh";
+  size_t numTriangles = WriteColliderMesh(file, GRID_SIZE, static_cast<uint32_t>(GRID_SIZE * GRID_SIZE * density / 16), 1);
+  std::filesystem::remove(std::filesystem::path(file).replace_extension(".meshcache"));
+
+  Model3D model;
+  model.AddMesh(file);
+
+  Collider collider;
+  collider.AppendModel(&model);
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  std::vector<XMFLOAT2> groups(numGroups);
+  for (auto& g : groups) {
+    g = {8.f + unit(rng) * (GRID_SIZE - 16), 8.f + unit(rng) * (GRID_SIZE - 16)};
+  }
+
+  std::vector<ColliderQuery> queries(numAgents);
+  for (auto& q : queries) {
+    const XMFLOAT2& g = groups[rng() % numGroups];
+    float angle = unit(rng) * XM_2PI;
+    q.point = {g.x + (unit(rng) - 0.5f) * 16.f, unit(rng) * 10.f, g.y + (unit(rng) - 0.5f) * 16.f};
+    q.direction = {std::cos(angle), 0.f, std::sin(angle)};
+    q.floorOffsetY = 1.f;
+    q.wallOffsetY = 0.5f;
+  }
+
+  std::vector<ColliderHit> expected(numAgents), hits(numAgents);
+
+  // ms per frame
+  auto run = [&](auto&& frame) {
+    frame();
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numFrames; i++) {
+      frame();
+    }
+    Milliseconds elapsed = Clock::now() - start;
+
+    return elapsed.count() / numFrames;
+  };
+
+  double serialTime = run([&] {
+    for (size_t i = 0; i < numAgents; i++) {
+      const ColliderQuery& q = queries[i];
+      expected[i].floor = collider.FindFloor(q.point, q.floorOffsetY, expected[i].floorHeight);
+      expected[i].wall = collider.FindWall(XMLoadFloat3(&q.point), XMLoadFloat3(&q.direction), q.wallOffsetY,
+                                           expected[i].wallDistance);
+    }
+  });
+
+  printf("%zu agents in %zu groups, %zu triangles, %u cores\n", numAgents, numGroups, numTriangles,
+         std::thread::hardware_concurrency());
+  printf("%10s %10s %14s %10s\n", "workers", "ms/frame", "queries/s", "speedup");
+  printf("%10s %10.3f %14.0f %9.2fx\n", "in order", serialTime, 2 * numAgents / (serialTime / 1000.0), 1.0);
+
+  const size_t defaultWorkers = Jobs::NumWorkers();
+
+  for (size_t numWorkers : WorkerCounts(maxWorkers)) {
+    Jobs::Shutdown();
+    Jobs::Init(numWorkers);
+
+    double msPerFrame = run([&] { collider.FindBatch(queries, hits); });
+
+    printf("%10zu %10.3f %14.0f %9.2fx\n", numWorkers, msPerFrame, 2 * numAgents / (msPerFrame / 1000.0),
+           serialTime / msPerFrame);
+  }
+
+  Jobs::Shutdown();
+  Jobs::Init(defaultWorkers);
+
+  return 0;
+}
+
+// ========== proxies
+
+// A crowd of generated characters, see TubeCharacter. Each character gets its own pose, every joint turned around
+// the start of its segment. Moving the bone proxies of the crowd, against skinning its vertices on the CPU, the
+// least that keeping triangles up to date would cost. Then rays across the crowd against the proxies, against
+// every skinned triangle
+int ProxiesBench(const Options& options)
+{
+  const size_t numCharacters = options.Get("characters", 64);
+  const size_t numBones = options.Get("bones", 40);
+  const size_t numRays = options.Get("rays", 2000);
+  const size_t numFrames = options.Get("frames", 20);
+
+  TubeCharacter character(numBones, 1);
+  const auto& [positions, bwis, indices, starts] = character;
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  auto randomDirection = [&]() {
+    return XMVector3Normalize(XMVectorSet(unit(rng) - .5f, unit(rng) - .5f, unit(rng) - .5f, 0.f));
+  };
+
+  const size_t numVertices = positions.size();
+  const size_t numTriangles = indices.size() / 3;
+
+  auto skin = std::make_shared<Skin>();
+  skin->header.numJoints = static_cast<UINT>(numBones);
+
+  auto mesh = std::make_shared<Mesh3D>();
+  mesh->positions = positions;
+  mesh->blendWeightsAndIndices = bwis;
+  mesh->skin = skin;
+  XMStoreFloat4x4(&mesh->localTransform, XMMatrixIdentity());
+
+  // characters on a grid 3 m apart, each with its pose
+  const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(numCharacters))));
+  std::vector<Model3D> models(numCharacters);
+  std::vector<XMFLOAT4X4> boneMatrices(numCharacters * numBones);
+  for (size_t c = 0; c < numCharacters; c++) {
+    models[c].meshes.push_back(mesh);
+    models[c].Translate(3.f * (c % side), 0.f, 3.f * (c / side));
+
+    for (size_t joint = 0; joint < numBones; joint++) {
+      XMVECTOR start = XMLoadFloat3(&starts[joint]);
+      XMMATRIX m = XMMatrixTranslationFromVector(-start) * XMMatrixRotationQuaternion(XMQuaternionRotationAxis(randomDirection(), unit(rng) * .6f)) *
+                   XMMatrixTranslationFromVector(start);
+      XMStoreFloat4x4(&boneMatrices[c * numBones + joint], XMMatrixTranspose(m));
+    }
+  }
+
+  auto fitStart = Clock::now();
+  BoneProxies proxies;
+  proxies.Fit(positions, bwis, numBones);
+  Milliseconds fitTime = Clock::now() - fitStart;
+
+  printf("%zu characters of %zu joints, %zu vertices and %zu triangles each, %zu capsules fitted in %.3f ms\n",
+         numCharacters, numBones, numVertices, numTriangles, proxies.NumCapsules(), fitTime.count());
+
+  Collider collider;
+  for (auto& model : models) {
+    collider.AppendModel(&model);
+  }
+
+  // ms per frame
+  auto run = [&](auto&& frame) {
+    frame();
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numFrames; i++) {
+      frame();
+    }
+    Milliseconds elapsed = Clock::now() - start;
+
+    return elapsed.count() / numFrames;
+  };
+
+  double updateTime = run([&] {
+    for (size_t c = 0; c < numCharacters; c++) {
+      collider.UpdatePose(&models[c], skin.get(), std::span(boneMatrices).subspan(c * numBones, numBones));
+    }
+  });
+
+  // the bind positions first, then the skinned ones of each character
+  std::vector<XMFLOAT3> skinned((1 + numCharacters) * numVertices);
+  std::copy(positions.begin(), positions.end(), skinned.begin());
+
+  double skinningTime = run([&] {
+    for (size_t c = 0; c < numCharacters; c++) {
+      SkinningPerDispatchConstants constants{
+          .firstPosition = 0,
+          .firstSkinnedPosition = static_cast<UINT>((1 + c) * numVertices),
+          .firstBWI = 0,
+          .firstBoneMatrix = static_cast<UINT>(c * numBones),
+          .numVertices = static_cast<UINT>(numVertices),
+      };
+      Skinning::Dispatch({skinned, {}, {}, bwis, boneMatrices}, constants);
+    }
+  });
+
+  printf("%16s %10s\n", "", "us/frame");
+  printf("%16s %10.1f\n", "proxy update", updateTime * 1000.0);
+  printf("%16s %10.1f\n", "cpu skinning", skinningTime * 1000.0);
+
+  // skinned vertices blend several joints, they may leave the capsules a little
+  size_t posedInside = 0;
+  for (size_t c = 0; c < numCharacters; c++) {
+    BoneProxies posed = proxies;
+    posed.Update(std::span(boneMatrices).subspan(c * numBones, numBones), XMMatrixIdentity());
+
+    for (size_t v = 0; v < numVertices; v++) {
+      const XMFLOAT3& p = skinned[(1 + c) * numVertices + v];
+      bool inside = false;
+      for (const auto& capsule : posed.WorldCapsules()) {
+        inside = inside || CapsuleDistance(capsule, p) <= 1e-5f * (1.f + capsule.radius);
+      }
+      posedInside += inside;
+    }
+  }
+  printf("posed vertices inside a capsule: %.2f%%\n", 100.0 * posedInside / (numCharacters * numVertices));
+
+  // horizontal rays across the crowd
+  struct Ray {
+    XMFLOAT3 origin;
+    XMFLOAT3 direction;
+  };
+  const float extent = 3.f * side;
+  std::vector<Ray> rays(numRays);
+  for (auto& ray : rays) {
+    float y = .2f + unit(rng) * 1.4f;
+    ray.origin = {unit(rng) * extent - 2.f, y, -3.f};
+    XMStoreFloat3(&ray.direction, XMVector3Normalize(XMVectorSet(unit(rng) * extent - 2.f - ray.origin.x, 0.f, extent + 3.f, 0.f)));
+  }
+
+  std::vector<float> proxyDistances(numRays);
+  auto start = Clock::now();
+  for (size_t i = 0; i < numRays; i++) {
+    ProxyHit hit;
+    proxyDistances[i] = collider.FindProxy(XMLoadFloat3(&rays[i].origin), XMLoadFloat3(&rays[i].direction), 0.f, hit)
+                            ? hit.distance
+                            : -1.f;
+  }
+  Milliseconds proxyTime = Clock::now() - start;
+
+  // every triangle of every character, they do not turn so the ray only needs moving
+  const size_t numChecked = std::min<size_t>(numRays, 200);
+  std::vector<float> triangleDistances(numChecked, -1.f);
+  start = Clock::now();
+  for (size_t i = 0; i < numChecked; i++) {
+    for (size_t c = 0; c < numCharacters; c++) {
+      XMVECTOR origin = XMLoadFloat3(&rays[i].origin) - XMLoadFloat3(&models[c].translate);
+      XMVECTOR direction = XMLoadFloat3(&rays[i].direction);
+      const XMFLOAT3* p = &skinned[(1 + c) * numVertices];
+
+      for (size_t t = 0; t < indices.size(); t += 3) {
+        float distance;
+        if (TriangleTests::Intersects(origin, direction, XMLoadFloat3(&p[indices[t]]), XMLoadFloat3(&p[indices[t + 1]]),
+                                      XMLoadFloat3(&p[indices[t + 2]]), distance) &&
+            (triangleDistances[i] < 0.f || distance < triangleDistances[i])) {
+          triangleDistances[i] = distance;
+        }
+      }
+    }
+  }
+  Milliseconds triangleTime = Clock::now() - start;
+
+  printf("%16s %10s\n", "", "rays/s");
+  printf("%16s %10.0f\n", "proxies", numRays / (proxyTime.count() / 1000.0));
+  printf("%16s %10.0f\n", "triangles", numChecked / (triangleTime.count() / 1000.0));
+
+  size_t triangleHits = 0, bothHits = 0, proxyOnly = 0;
+  for (size_t i = 0; i < numChecked; i++) {
+    triangleHits += triangleDistances[i] >= 0.f;
+    bothHits += triangleDistances[i] >= 0.f && proxyDistances[i] >= 0.f;
+    proxyOnly += triangleDistances[i] < 0.f && proxyDistances[i] >= 0.f;
+  }
+  printf("of %zu rays: %zu hit triangles, %zu of them proxies too, %zu hit proxies only\n", numChecked, triangleHits,
+         bothHits, proxyOnly);
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include "stdafx_assets.h"
+
+#include "Bench.h"
+
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Skinning.h"
+
+// ========== skinning
+
+// A large skinned mesh, see SkinningScene. One vertex at a time on one thread, then the SIMD path on one thread
+// and on every worker
+int SkinningBench(const Options& options)
+{
+  const size_t numVertices = options.Get("vertices", 1'000'000);
+  const size_t numBones = options.Get("bones", 67);
+  const size_t numFrames = options.Get("frames", 20);
+
+  SkinningScene scene(numVertices, numBones, 1);
+  Skinning::Buffers buffers = scene.Buffers();
+
+  auto run = [&](auto dispatch) {
+    dispatch(buffers, scene.constants);
+
+    auto start = Clock::now();
+    for (size_t frame = 0; frame < numFrames; frame++) {
+      dispatch(buffers, scene.constants);
+    }
+    Milliseconds elapsed = Clock::now() - start;
+
+    return elapsed.count() / numFrames;
+  };
+
+  printf("%zu vertices, %zu bones, %zu frames, %s (%zu lanes)\n", numVertices, numBones, numFrames,
+         Skinning::InstructionSet(), Skinning::Width());
+  printf("%16s %10s %14s\n", "", "ms/frame", "Mvertices/s");
+
+  auto print = [&](const char* name, double ms) { printf("%16s %10.3f %14.1f\n", name, ms, numVertices / ms / 1000.0); };
+
+  const size_t numWorkers = Jobs::NumWorkers();
+
+  double scalarTime = run(Skinning::DispatchScalar);
+  print("scalar", scalarTime);
+
+  Jobs::Shutdown();
+  Jobs::Init(0);
+  double simdTime = run(Skinning::Dispatch);
+  print(Skinning::InstructionSet(), simdTime);
+
+  Jobs::Shutdown();
+  Jobs::Init(numWorkers);
+  double parallelTime = run(Skinning::Dispatch);
+  char name[32];
+  snprintf(name, sizeof(name), "+ %zu workers", numWorkers);
+  print(name, parallelTime);
+
+  printf("speedup: %.2fx on one thread, %.2fx with workers\n", scalarTime / simdTime, scalarTime / parallelTime);
+
+  return 0;
+}
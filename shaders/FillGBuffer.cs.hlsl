@@ -1,5 +1,6 @@
 #include "MeshletCommon.hlsli"
 #include "VisibilityBufferCommon.hlsli"
+#include "VertexPacking.hlsli"
 
 cbuffer PushConstants : register(b0) {
   FillGBufferPerDispatchConstants g_PerDispatchConstants;
@@ -26,17 +27,31 @@ struct BarycentricDeriv {
 
 Vertex GetVertexAttributes(MeshInstanceData mi, uint vertexIndex)
 {
-  StructuredBuffer<float3> positions = ResourceDescriptorHeap[g_DescIds.vertexPositionsBufferId];
-  float3 position = positions[mi.firstPosition + vertexIndex];
-
-  StructuredBuffer<float3> normals = ResourceDescriptorHeap[g_DescIds.vertexNormalsBufferId];
-  float3 normal = normals[mi.firstNormal + vertexIndex];
-
-  StructuredBuffer<float4> tangents = ResourceDescriptorHeap[g_DescIds.vertexTangentsBufferId];
-  float4 tangent = tangents[mi.firstTangent + vertexIndex];
+  float3 position;
+  float3 normal;
+  float4 tangent;
+  float2 uv;
 
-  StructuredBuffer<float2> uvs = ResourceDescriptorHeap[g_DescIds.vertexUVsBufferId];
-  float2 uv = uvs[mi.firstUV + vertexIndex];
+  if (mi.firstPackedVertex != PACKED_VERTEX_NONE) {
+    StructuredBuffer<PackedVertex> packedVertices = ResourceDescriptorHeap[g_DescIds.vertexPackedBufferId];
+    PackedVertex pv = packedVertices[mi.firstPackedVertex + vertexIndex];
+    position = DecodePosition(pv.position, mi.packedPositionMin, mi.packedPositionExtent);
+    normal = DecodeNormal(pv.normal);
+    tangent = DecodeTangent(pv.tangent);
+    uv = DecodeUV(pv.uv);
+  } else {
+    StructuredBuffer<float3> positions = ResourceDescriptorHeap[g_DescIds.vertexPositionsBufferId];
+    position = positions[mi.firstPosition + vertexIndex];
+
+    StructuredBuffer<float3> normals = ResourceDescriptorHeap[g_DescIds.vertexNormalsBufferId];
+    normal = normals[mi.firstNormal + vertexIndex];
+
+    StructuredBuffer<float4> tangents = ResourceDescriptorHeap[g_DescIds.vertexTangentsBufferId];
+    tangent = tangents[mi.firstTangent + vertexIndex];
+
+    StructuredBuffer<float2> uvs = ResourceDescriptorHeap[g_DescIds.vertexUVsBufferId];
+    uv = uvs[mi.firstUV + vertexIndex];
+  }
 
   ConstantBuffer<FrameConstants> g_FrameConstants = ResourceDescriptorHeap[FrameConstantsIndex];
 
@@ -1,4 +1,5 @@
 #include "MeshletCommon.hlsli"
+#include "VertexPacking.hlsli"
 
 cbuffer PushConstants : register(b0) {
   BuffersDescriptorIndices g_DescIds;
@@ -11,11 +12,21 @@ cbuffer IndirectArgumentConstants : register(b1) {
 
 VertexOut GetVertexAttributes(MeshInstanceData mi, uint meshletIndex, uint vertexIndex, uint textureIndex)
 {
-  StructuredBuffer<float3> positions = ResourceDescriptorHeap[g_DescIds.vertexPositionsBufferId];
-  float3 position = positions[mi.firstPosition + vertexIndex];
-
-  StructuredBuffer<float2> uvs = ResourceDescriptorHeap[g_DescIds.vertexUVsBufferId];
-  float2 uv = uvs[mi.firstUV + vertexIndex];
+  float3 position;
+  float2 uv;
+
+  if (mi.firstPackedVertex != PACKED_VERTEX_NONE) {
+    StructuredBuffer<PackedVertex> packedVertices = ResourceDescriptorHeap[g_DescIds.vertexPackedBufferId];
+    PackedVertex pv = packedVertices[mi.firstPackedVertex + vertexIndex];
+    position = DecodePosition(pv.position, mi.packedPositionMin, mi.packedPositionExtent);
+    uv = DecodeUV(pv.uv);
+  } else {
+    StructuredBuffer<float3> positions = ResourceDescriptorHeap[g_DescIds.vertexPositionsBufferId];
+    position = positions[mi.firstPosition + vertexIndex];
+
+    StructuredBuffer<float2> uvs = ResourceDescriptorHeap[g_DescIds.vertexUVsBufferId];
+    uv = uvs[mi.firstUV + vertexIndex];
+  }
 
   ConstantBuffer<FrameConstants> g_FrameConstants = ResourceDescriptorHeap[FrameConstantsIndex];
 
@@ -7,6 +7,7 @@
 #define MESHLET_MAX_VERT 64
 #define FILL_GBUFFER_GROUP_SIZE_X 16
 #define FILL_GBUFFER_GROUP_SIZE_Y 16
+#define PACKED_VERTEX_NONE 0xffffffff
 
 #ifdef __cplusplus
 using hlsl_float3x3 = DirectX::XMFLOAT3X3;
@@ -15,6 +16,7 @@ using hlsl_float4 = DirectX::XMFLOAT4;
 using hlsl_float3 = DirectX::XMFLOAT3;
 using hlsl_float2 = DirectX::XMFLOAT2;
 using hlsl_uint = UINT;
+using hlsl_uint2 = DirectX::XMUINT2;
 using hlsl_bounding_sphere = DirectX::BoundingSphere;
 using hlsl_byte4 = DirectX::PackedVector::XMUBYTEN4;
 #define ASSERT_SIZE_M16(T) static_assert(sizeof(T) % 16 == 0, #T " size must be multiple of 16")
@@ -25,6 +27,7 @@ using hlsl_byte4 = DirectX::PackedVector::XMUBYTEN4;
 #define hlsl_float3 float3
 #define hlsl_float2 float2
 #define hlsl_uint uint
+#define hlsl_uint2 uint2
 #define hlsl_bounding_sphere float4
 #define hlsl_byte4 uint
 #define ASSERT_SIZE_M16(T)
@@ -45,6 +48,7 @@ struct BuffersDescriptorIndices {
   hlsl_uint vertexNormalsBufferId;
   hlsl_uint vertexTangentsBufferId;
   hlsl_uint vertexUVsBufferId;
+  hlsl_uint vertexPackedBufferId;
 
   hlsl_uint meshletsBufferId;
   hlsl_uint meshletVertIndicesBufferId;
@@ -113,6 +117,20 @@ struct MeshletData {
 };
 ASSERT_SIZE_M16(MeshletData);
 
+// Quantized vertex, 20 bytes instead of 48 for the float streams.
+// Encoded by VertexPacking.h, decoded by VertexPacking.hlsli
+//   position: unorm16 x | y << 16, unorm16 z (upper half unused), relative to the mesh bounds
+//             stored in MeshInstanceData::packedPositionMin/Extent
+//   normal:   octahedral, snorm16 x | y << 16
+//   tangent:  octahedral, unorm16 x | unorm15 y << 16 | bitangent sign << 31 (set = -1)
+//   uv:       half x | y << 16
+struct PackedVertex {
+  hlsl_uint2 position;
+  hlsl_uint normal;
+  hlsl_uint tangent;
+  hlsl_uint uv;
+};
+
 struct MeshInstanceData {
   // TODO: keep this separate to minimize data transfer?
   hlsl_float4x4 worldMatrix;
@@ -134,8 +152,13 @@ struct MeshInstanceData {
 
   hlsl_uint numMeshlets;
 
+  // PACKED_VERTEX_NONE when the geometry uses the float streams above
+  hlsl_uint firstPackedVertex;
+  hlsl_float3 packedPositionMin;
+  hlsl_float3 packedPositionExtent;
+
   // TODO: add skinned true/false?
-  hlsl_float2 _pad;
+  hlsl_float3 _pad;
 };
 ASSERT_SIZE_M16(MeshInstanceData);
 
@@ -35,21 +35,27 @@ void main(uint dtid : SV_DispatchThreadID)
   uint bwiIdx = dtid + g_Constants.firstBWI;
 
   RWStructuredBuffer<float3> positions = ResourceDescriptorHeap[g_DescIds.vertexPositionsBufferId];
+  RWStructuredBuffer<float3> normals = ResourceDescriptorHeap[g_DescIds.vertexNormalsBufferId];
+  RWStructuredBuffer<float4> tangents = ResourceDescriptorHeap[g_DescIds.vertexTangentsBufferId];
   StructuredBuffer<uint2> bwis = ResourceDescriptorHeap[g_DescIds.vertexBlendWeightsAndIndicesBufferId];
   StructuredBuffer<float4x4> BoneMatrices = ResourceDescriptorHeap[g_DescIds.boneMatricesBufferId];
 
-  float3 inPos = positions[basePositionIdx];
   uint2 bwi = bwis[bwiIdx];
   float4 boneWeights = UnpackBoneWeights(bwi.x);
   uint4 boneIndices = UnpackBoneIndices(bwi.y) + g_Constants.firstBoneMatrix;
 
-  float4 pos = float4(inPos, 1.0f);
-  float4 skinnedPos = mul(pos, BoneMatrices[boneIndices.x]) * boneWeights.x +
-                      mul(pos, BoneMatrices[boneIndices.y]) * boneWeights.y +
-                      mul(pos, BoneMatrices[boneIndices.z]) * boneWeights.z +
-                      mul(pos, BoneMatrices[boneIndices.w]) * boneWeights.w;
+  // blend the matrices once for the three streams. Skinning.cpp does the same on the CPU
+  float4x4 skinMatrix = BoneMatrices[boneIndices.x] * boneWeights.x +
+                        BoneMatrices[boneIndices.y] * boneWeights.y +
+                        BoneMatrices[boneIndices.z] * boneWeights.z +
+                        BoneMatrices[boneIndices.w] * boneWeights.w;
+
+  float3 inPos = positions[basePositionIdx];
+  positions[outPositionIdx] = mul(float4(inPos, 1.0f), skinMatrix).xyz;
 
-  // TODO: need to also transform normals
+  float3 inNormal = normals[dtid + g_Constants.firstNormal];
+  normals[dtid + g_Constants.firstSkinnedNormal] = normalize(mul(inNormal, (float3x3)skinMatrix));
 
-  positions[outPositionIdx] = skinnedPos.xyz;
+  float4 inTangent = tangents[dtid + g_Constants.firstTangent];
+  tangents[dtid + g_Constants.firstSkinnedTangent] = float4(normalize(mul(inTangent.xyz, (float3x3)skinMatrix)), inTangent.w);
 }
@@ -0,0 +1,39 @@
+#ifndef VERTEX_PACKING_HLSLI_INCLUDED
+#define VERTEX_PACKING_HLSLI_INCLUDED
+
+#include "Shared.h"
+
+// Decoders for PackedVertex, must match VertexPacking.h
+
+float3 OctDecode(float2 e)
+{
+  float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = saturate(-n.z);
+  n.xy += select(n.xy >= 0.0, -t, t);
+  return normalize(n);
+}
+
+float3 DecodePosition(uint2 q, float3 posMin, float3 posExtent)
+{
+  float3 unorm = float3(q.x & 0xffff, q.x >> 16, q.y & 0xffff) / 65535.0;
+  return posMin + posExtent * unorm;
+}
+
+float3 DecodeNormal(uint q)
+{
+  int2 s = int2(q << 16, q) >> 16;  // sign extend
+  return OctDecode(max(float2(s) / 32767.0, -1.0));
+}
+
+float4 DecodeTangent(uint q)
+{
+  float2 e = float2(q & 0xffff, (q >> 16) & 0x7fff) / float2(65535.0, 32767.0) * 2.0 - 1.0;
+  return float4(OctDecode(e), (q >> 31) ? -1.0 : 1.0);
+}
+
+float2 DecodeUV(uint q)
+{
+  return f16tof32(uint2(q, q >> 16));
+}
+
+#endif
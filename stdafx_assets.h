@@ -0,0 +1,81 @@
+// stdafx_assets.h : precompiled header of the Assets library.
+// Only portable headers here, the library must build without the renderer and outside of Windows.
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <DirectXMesh.h>
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+using UINT = uint32_t;  // the shared structs use the Windows name
+#endif
+static_assert(sizeof(UINT) == 4);
+
+#define STRINGIZE(x) STRINGIZE2(x)
+#define STRINGIZE2(x) #x
+#define LINE_STRING STRINGIZE(__LINE__)
+#define CHECK_HR(expr)                                                             \
+  do {                                                                             \
+    if (FAILED(expr)) {                                                            \
+      assert(0 && #expr);                                                          \
+      throw std::runtime_error(__FILE__ "(" LINE_STRING "): FAILED( " #expr " )"); \
+    }                                                                              \
+  } while (false)
+
+template <typename T, typename U>
+inline constexpr T DivRoundUp(T num, U denom)
+{
+  return (num + denom - 1) / denom;
+}
+
+template <typename T, typename U>
+inline constexpr T AlignUp(T val, U align)
+{
+  return DivRoundUp(val, align) * align;
+}
@@ -0,0 +1,364 @@
+#include "stdafx_assets.h"
+
+#include "Tests.h"
+
+#include "AnimationFormat.h"
+#include "AnimationLod.h"
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Legacy.h"
+#include "Mesh.h"
+#include "PoseBatch.h"
+#include "PoseCache.h"
+
+using namespace DirectX;
+
+// The flat skeleton and tracks give the poses of the hash map walk, on rigs the size of the sample models
+bool SkeletonVsLegacy()
+{
+  const auto dir = FixtureDirectory("AssetsTests_skeleton");
+
+  bool pass = true;
+  for (uint32_t numBones : {22, 67}) {
+    Rig rig = LoadRig(dir, numBones, 60, 30.f, numBones);
+
+    Legacy::Skeleton legacySkeleton(*rig.skin);
+    Legacy::Clip legacyClip(*rig.animation);
+    std::unordered_map<int, XMMATRIX> legacyGlobals;
+    std::vector<XMMATRIX> globals;
+
+    const float duration = rig.animation->maxTime - rig.animation->minTime;
+
+    float diff = 0.f;
+    for (size_t i = 0; i < 64; i++) {
+      float time = rig.animation->minTime + std::fmod(i / 60.f, duration);
+      auto expected = Legacy::BoneTransforms(legacyClip, time, legacySkeleton, *rig.skin, legacyGlobals);
+      diff = std::max(diff, MaxDifference(expected, rig.animation->BoneTransforms(time, rig.skin.get(), globals)));
+    }
+
+    char what[64];
+    snprintf(what, sizeof(what), "%u bones, max difference", numBones);
+    pass &= Expect(what, diff, 1e-5f);
+  }
+
+  return pass;
+}
+
+// Keys found by binary search in a long clip at random times, against the copy and linear scan
+bool TracksVsLegacy()
+{
+  Rig rig = LoadRig(FixtureDirectory("AssetsTests_tracks"), 40, 10 * 120 + 1, 120.f, 1);
+
+  Legacy::Skeleton legacySkeleton(*rig.skin);
+  Legacy::Clip legacyClip(*rig.animation);
+  std::unordered_map<int, XMMATRIX> legacyGlobals;
+  std::vector<XMMATRIX> globals;
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> randomTime(rig.animation->minTime, rig.animation->maxTime);
+
+  float diff = 0.f;
+  for (size_t i = 0; i < 20; i++) {
+    float time = randomTime(rng);
+    auto expected = Legacy::BoneTransforms(legacyClip, time, legacySkeleton, *rig.skin, legacyGlobals);
+    diff = std::max(diff, MaxDifference(expected, rig.animation->BoneTransforms(time, rig.skin.get(), globals)));
+  }
+
+  return Expect("max difference", diff, 1e-5f);
+}
+
+// Instances playing forward, each with its own phase and across the end of the clip: keys found from the cursors
+// of the last frame, against a search from scratch
+bool CursorsVsSearch()
+{
+  auto [skin, animation] = LoadRig(FixtureDirectory("AssetsTests_cursors"), 40, 2 * 120 + 1, 120.f, 1);
+
+  const size_t numInstances = 8;
+  std::vector<AnimationInfo> instances(numInstances);
+  for (auto& info : instances) {
+    info.animation = animation;
+  }
+
+  std::vector<XMMATRIX> globals;
+  float diff = 0.f;
+  for (size_t frame = 0; frame < 300; frame++) {
+    for (size_t i = 0; i < numInstances; i++) {
+      float time = i * 0.37f + frame / 60.f;
+      auto cursor = instances[i].BoneTransforms(time, skin.get());
+
+      float duration = animation->maxTime - animation->minTime;
+      float clipTime = animation->minTime + std::fmod(time, duration);
+      diff = std::max(diff, MaxDifference(cursor, animation->BoneTransforms(clipTime, skin.get(), globals)));
+    }
+  }
+
+  return Expect("max difference", diff, 1e-5f);
+}
+
+// A crowd at its own phases through PoseBatch, against one scalar pose per instance. The corrected nlerp stays
+// within about 1e-3 of the slerp, see PoseBatch.cpp
+bool BatchVsScalar()
+{
+  auto [skin, animation] = LoadRig(FixtureDirectory("AssetsTests_batch"), 67, 301, 30.f, 1);
+
+  const size_t numInstances = 2 * PoseBatch::Width() + 3;
+  std::vector<AnimationInfo> scalarInstances(numInstances), batchInstances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    scalarInstances[i].animation = animation;
+    batchInstances[i].animation = animation;
+  }
+
+  std::vector<PoseBatch::Instance> batch(numInstances);
+  float diff = 0.f;
+  float globalDiff = 0.f;
+  for (size_t frame = 0; frame < 60; frame++) {
+    for (size_t i = 0; i < numInstances; i++) {
+      batch[i] = PoseBatch::Prepare(batchInstances[i], i * 0.37f + frame / 20.f, skin.get());
+    }
+    PoseBatch::Evaluate(*skin, batch);
+
+    for (size_t i = 0; i < numInstances; i++) {
+      auto expected = scalarInstances[i].BoneTransforms(i * 0.37f + frame / 20.f, skin.get());
+      diff = std::max(diff, MaxDifference(expected, batchInstances[i].boneTransforms[skin.get()]));
+      globalDiff = std::max(globalDiff, MaxDifference(scalarInstances[i].globalTransforms[skin.get()],
+                                                      batchInstances[i].globalTransforms[skin.get()]));
+    }
+  }
+
+  printf("%s (%zu lanes)\n", PoseBatch::InstructionSet(), PoseBatch::Width());
+  bool pass = Expect("bone matrices, max difference", diff, 1e-3f);
+  pass &= Expect("global transforms, max difference", globalDiff, 1e-3f);
+
+  return pass;
+}
+
+// A clip compressed with the default settings poses the joints within tolerance, between its keys too, and reads
+// back from the file it is saved to as it was
+bool CompressedClip()
+{
+  const auto dir = FixtureDirectory("AssetsTests_compress");
+  Rig rig = LoadRig(dir, 40, 10 * 30 + 1, 30.f, 1);
+
+  AnimationFormat::Settings settings;
+  AnimationFormat::Report report;
+  Animation compressed = AnimationFormat::Compress(*rig.animation, *rig.skin, settings, &report);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> randomTime(rig.animation->minTime, rig.animation->maxTime);
+  std::vector<float> times(200);
+  for (auto& t : times) t = randomTime(rng);
+
+  printf("keys: %zu -> %zu\n", report.rawKeys, report.keptKeys);
+  bool pass = Expect("max joint error at the keys", report.maxJointError, settings.tolerance);
+  pass &= Expect("max joint error between the keys",
+                 AnimationFormat::MaxJointError(*rig.animation, compressed, *rig.skin, times), settings.tolerance);
+
+  if (!AnimationFormat::Save(dir / "compressed.anim", compressed)) {
+    printf("ERROR: cannot write %s\n", (dir / "compressed.anim").string().c_str());
+    return false;
+  }
+
+  Animation reloaded;
+  reloaded.Read(dir / "compressed.anim");
+  pass &= Expect("reload error", AnimationFormat::MaxJointError(compressed, reloaded, *rig.skin, times), 0.f);
+
+  return pass;
+}
+
+// Every group of a batch writes its own outputs, the poses do not depend on the number of job workers
+bool BatchWorkers()
+{
+  auto [skin, animation] = LoadRig(FixtureDirectory("AssetsTests_batch_workers"), 40, 301, 30.f, 1);
+
+  const size_t numInstances = 100;
+  const size_t numJoints = skin->header.numJoints;
+
+  auto evaluate = [&](size_t numWorkers) {
+    Jobs::Shutdown();
+    Jobs::Init(numWorkers);
+
+    std::vector<AnimationInfo> instances(numInstances);
+    std::vector<XMFLOAT4X4> boneMatrices(numInstances * numJoints);
+    std::vector<PoseBatch::Instance> batch(numInstances);
+    for (size_t i = 0; i < numInstances; i++) {
+      instances[i].animation = animation;
+      batch[i] = PoseBatch::Prepare(instances[i], i * 0.37f, skin.get(),
+                                    std::span(boneMatrices).subspan(i * numJoints, numJoints));
+    }
+    PoseBatch::Evaluate(*skin, batch);
+
+    return boneMatrices;
+  };
+
+  const size_t defaultWorkers = Jobs::NumWorkers();
+  auto expected = evaluate(0);
+  auto parallel = evaluate(3);
+  Jobs::Shutdown();
+  Jobs::Init(defaultWorkers);
+
+  bool same = memcmp(expected.data(), parallel.data(), expected.size() * sizeof(XMFLOAT4X4)) == 0;
+  if (!same) printf("ERROR: the poses differ with 3 job workers\n");
+
+  return same;
+}
+
+// A far crowd in sync, its offsets within a bucket of the pose cache: one LOD pose per update interval between
+// them, evaluated at the clip time of the bucketed offset
+bool LodSharing()
+{
+  auto [skin, animation] = LoadRig(FixtureDirectory("AssetsTests_lod_sharing"), 40, 301, 30.f, 1);
+
+  const size_t numInstances = 64;
+  const size_t numJoints = skin->header.numJoints;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  // past the first LOD distance, on intervals of 2, 4 and 8 frames
+  std::vector<AnimationInfo> instances(numInstances);
+  std::vector<float> distances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    instances[i].animation = animation;
+    instances[i].timeOffset = unit(rng) * 0.01f;
+    distances[i] = 30.f + unit(rng) * 90.f;
+  }
+
+  PoseCache cache(1.f / 30.f);
+  AnimationLod lod({.interpolate = false});
+
+  std::vector<PoseBatch::Instance> batch;
+  std::vector<AnimationLod::Pose*> lodPoses;  // per LOD pose
+  std::vector<size_t> instancePoses(numInstances);
+  std::vector<XMFLOAT4X4> resolved(numJoints);
+
+  size_t maxPoses = 0;
+  float diff = 0.f;
+  for (size_t frame = 0; frame < 32; frame++) {
+    float time = frame / 60.f;
+    cache.Clear();
+    lod.BeginFrame(time);
+    batch.clear();
+    lodPoses.clear();
+
+    for (size_t i = 0; i < numInstances; i++) {
+      auto lodPose = lod.Find(instances[i], skin.get(), distances[i], cache);
+      if (lodPose.first) {
+        if (lodPose.pose->NeedsEvaluation()) {
+          batch.push_back(PoseBatch::Prepare(instances[i], time, skin.get(), {lodPose.pose->Target(), numJoints}));
+          batch.back().time = lodPose.pose->Time();
+        }
+        lodPoses.push_back(lodPose.pose);
+      }
+      instancePoses[i] = lodPose.index;
+    }
+
+    PoseBatch::Evaluate(*skin, batch);
+    maxPoses = std::max(maxPoses, lodPoses.size());
+
+    // held poses show the pose of their last evaluation, the frames evaluating show the one of the frame
+    for (size_t i = 0; i < numInstances; i++) {
+      const AnimationLod::Pose* pose = lodPoses[instancePoses[i]];
+      if (!pose->NeedsEvaluation()) continue;
+
+      AnimationInfo reference;
+      reference.animation = animation;
+      reference.timeOffset = cache.Offset(instances[i]);
+
+      pose->Resolve(resolved.data());
+      diff = std::max(diff, MaxDifference(reference.BoneTransforms(time, skin.get()), resolved));
+    }
+  }
+
+  bool pass = Expect("LOD poses in a frame, most", static_cast<float>(maxPoses), 3.f);
+  pass &= Expect("max difference", diff, 1e-3f);
+
+  return pass;
+}
+
+// The animation path of Renderer::Update on a crowd: pose cache, animation LOD, batched poses evaluated on the
+// job workers straight into the staged bone matrices, and single poses into a caller range. After a few frames
+// to size everything, frames must not allocate
+bool AnimationAllocations()
+{
+  auto [skin, animation] = LoadRig(FixtureDirectory("AssetsTests_allocations"), 40, 301, 30.f, 1);
+
+  const size_t numInstances = 256;
+  const size_t numJoints = skin->header.numJoints;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  // a quarter in sync, the others spread over the clip and up to 120 away
+  std::vector<AnimationInfo> instances(numInstances);
+  std::vector<float> distances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    instances[i].animation = animation;
+    instances[i].timeOffset = i % 4 == 0 ? 0.f : unit(rng) * 10.f;
+    distances[i] = unit(rng) * 120.f;
+  }
+
+  PoseCache cache(1.f / 30.f);
+  AnimationLod lod;
+
+  std::vector<XMFLOAT4X4> boneMatrices(numInstances * numJoints);
+  std::vector<XMFLOAT4X4> single(numJoints);
+  std::vector<PoseBatch::Instance> batch;
+  std::vector<std::pair<AnimationLod::Pose*, size_t>> lodPoses;  // per LOD pose
+  batch.reserve(numInstances);
+  lodPoses.reserve(numInstances);
+
+  auto frame = [&](float time) {
+    cache.Clear();
+    lod.BeginFrame(time);
+    batch.clear();
+    lodPoses.clear();
+    size_t numUsed = 0;
+
+    for (size_t i = 0; i < numInstances; i++) {
+      if (auto lodPose = lod.Find(instances[i], skin.get(), distances[i], cache); lodPose.pose) {
+        if (lodPose.first) {
+          if (lodPose.pose->NeedsEvaluation()) {
+            batch.push_back(PoseBatch::Prepare(instances[i], time, skin.get(), {lodPose.pose->Target(), numJoints}));
+            batch.back().time = lodPose.pose->Time();
+          }
+          lodPoses.push_back({lodPose.pose, numUsed});
+          numUsed += numJoints;
+        }
+        continue;
+      }
+
+      auto pose = cache.Find(instances[i], time, skin.get());
+      if (!pose.first) continue;
+
+      batch.push_back(PoseBatch::Prepare(instances[i], time, skin.get(), {boneMatrices.data() + numUsed, numJoints}));
+      batch.back().time = pose.clipTime;
+      numUsed += numJoints;
+    }
+
+    PoseBatch::Evaluate(*skin, batch);
+
+    Jobs::ParallelForChunks(lodPoses.size(), 64, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        lodPoses[i].first->Resolve(boneMatrices.data() + lodPoses[i].second);
+      }
+    });
+
+    instances[0].BoneTransforms(time, skin.get(), single);
+  };
+
+  // the first evaluation of each instance sizes its cursors and global transforms, the LOD grows its poses
+  for (size_t i = 0; i < 8; i++) {
+    frame(i / 60.f);
+  }
+
+  const size_t numFrames = 60;
+  size_t before = g_NumAllocations;
+  for (size_t i = 0; i < numFrames; i++) {
+    frame((i + 8) / 60.f);
+  }
+  size_t numAllocations = g_NumAllocations - before;
+
+  printf("%zu instances, %zu frames, %zu job workers\n", numInstances, numFrames, Jobs::NumWorkers());
+
+  return Expect("allocations", static_cast<float>(numAllocations), 0.f);
+}
@@ -0,0 +1,296 @@
+#include "stdafx_assets.h"
+
+#include "Tests.h"
+
+#include "Collider.h"
+#include "Fixtures.h"
+#include "Jobs.h"
+
+using namespace DirectX;
+
+// the hierarchy finds what the linear scan finds, up to rounding. On the same surface the distances may differ
+// by more than that when the ray grazes it
+static bool SameFloor(Collider& collider, const XMFLOAT3& point)
+{
+  float a, b;
+  Surface* floorA = collider.FindFloorLinear(point, 0.f, a);
+  Surface* floorB = collider.FindFloor(point, 0.f, b);
+
+  return !floorA == !floorB && (floorA == floorB || std::abs(a - b) <= 1e-4f * (1.f + std::abs(a)));
+}
+
+static bool SameWall(Collider& collider, const XMFLOAT3& point, const XMFLOAT3& direction)
+{
+  float a, b;
+  Surface* wallA = collider.FindWallLinear(XMLoadFloat3(&point), XMLoadFloat3(&direction), 0.f, a);
+  Surface* wallB = collider.FindWall(XMLoadFloat3(&point), XMLoadFloat3(&direction), 0.f, b);
+
+  return !wallA == !wallB && (wallA == wallB || std::abs(a - b) <= 1e-4f * (1.f + a));
+}
+
+// WriteColliderMesh, then read back into model without a stale .meshcache
+static void LoadColliderModel(Model3D& model, const std::filesystem::path& file, uint32_t gridSize, uint32_t numBoxes)
+{
+  WriteColliderMesh(file, gridSize, numBoxes, gridSize);
+  std::filesystem::remove(std::filesystem::path(file).replace_extension(".meshcache"));
+  model.AddMesh(file);
+}
+
+// Floors and walls at random points, through the hierarchy against the linear scan, on open ground and on dense
+// interiors. The hierarchy casts rays in model space and may pick the other triangle of a quad hit on its diagonal,
+// hence SameFloor and SameWall
+bool ColliderVsLinear()
+{
+  const auto dir = FixtureDirectory("AssetsTests_collider");
+
+  size_t mismatches = 0;
+  size_t numSurfaces = 0;
+  for (uint32_t gridSize : {16, 64}) {
+    for (uint32_t density : {1, 16}) {
+      Model3D model;
+      LoadColliderModel(model, dir / ("collider_" + std::to_string(gridSize) + "_" + std::to_string(density) + ".mesh"),
+                        gridSize, gridSize * gridSize * density / 16);
+
+      Collider collider;
+      collider.AppendModel(&model);
+      numSurfaces += collider.NumSurfaces();
+
+      std::mt19937 rng(gridSize);
+      std::uniform_real_distribution<float> unit(0.f, 1.f);
+      for (size_t i = 0; i < 500; i++) {
+        float angle = unit(rng) * XM_2PI;
+        XMFLOAT3 point = {unit(rng) * (gridSize - 1), unit(rng) * 12.f, unit(rng) * (gridSize - 1)};
+        XMFLOAT3 direction = {std::cos(angle), 0.f, std::sin(angle)};
+
+        if (!SameFloor(collider, point)) mismatches++;
+        if (!SameWall(collider, point, direction)) mismatches++;
+      }
+    }
+  }
+
+  printf("%zu surfaces in 4 scenes\n", numSurfaces);
+  return Expect("mismatches", static_cast<float>(mismatches), 0.f);
+}
+
+// Walls probed in packets of 8 directions around random points, against one FindWall per direction: the same
+// kernel on the same model space rays, so the same hits to the bit
+bool WallPackets()
+{
+  constexpr size_t PACKET_SIZE = 8;
+  constexpr uint32_t GRID_SIZE = 64;
+
+  Model3D model;
+  LoadColliderModel(model, FixtureDirectory("AssetsTests_wall_packets") / "packets.mesh", GRID_SIZE,
+                    GRID_SIZE * GRID_SIZE * 4 / 16);
+
+  Collider collider;
+  collider.AppendModel(&model);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < 500; i++) {
+    XMFLOAT3 point = {unit(rng) * (GRID_SIZE - 1), unit(rng) * 12.f, unit(rng) * (GRID_SIZE - 1)};
+    float angle = unit(rng) * XM_2PI;
+
+    std::array<XMFLOAT3, PACKET_SIZE> probes;
+    for (size_t k = 0; k < PACKET_SIZE; k++) {
+      float probe = angle + k * XM_2PI / PACKET_SIZE;
+      probes[k] = {std::cos(probe), 0.f, std::sin(probe)};
+    }
+
+    std::array<Surface*, PACKET_SIZE> walls;
+    std::array<float, PACKET_SIZE> distances;
+    collider.FindWalls(XMLoadFloat3(&point), probes, 0.f, walls, distances);
+
+    for (size_t k = 0; k < PACKET_SIZE; k++) {
+      float distance;
+      Surface* wall = collider.FindWall(XMLoadFloat3(&point), XMLoadFloat3(&probes[k]), 0.f, distance);
+      if (wall != walls[k] || (wall && distances[k] != distance)) mismatches++;
+    }
+  }
+
+  return Expect("mismatches", static_cast<float>(mismatches), 0.f);
+}
+
+// A model moved after it was appended: scaled, turned, tilted until its slopes change from floors to walls, and
+// refreshed. Queries around it must find what the linear scan finds where the model now is
+bool RefreshedModel()
+{
+  constexpr uint32_t GRID_SIZE = 32;
+
+  Model3D model;
+  LoadColliderModel(model, FixtureDirectory("AssetsTests_refresh") / "refresh.mesh", GRID_SIZE,
+                    GRID_SIZE * GRID_SIZE / 16);
+
+  Collider collider;
+  collider.AppendModel(&model);
+
+  // not the seed of the mesh, whose boxes would start right at the query points
+  std::mt19937 rng(GRID_SIZE + 1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  size_t mismatches = 0;
+  for (float tilt : {0.f, 0.5f, 1.4f}) {
+    model.Scale(0.5f + unit(rng)).Rotate(tilt, unit(rng) * XM_2PI, 0.f).Translate(unit(rng) * 100.f, 0.f, 0.f);
+    collider.RefreshDynamicModels();
+
+    const XMMATRIX world = model.WorldMatrix();
+    for (size_t i = 0; i < 300; i++) {
+      XMVECTOR local = XMVectorSet(unit(rng) * (GRID_SIZE - 1), unit(rng) * 12.f - 2.f, unit(rng) * (GRID_SIZE - 1), 1.f);
+      float angle = unit(rng) * XM_2PI;
+
+      XMFLOAT3 point, direction = {std::cos(angle), 0.f, std::sin(angle)};
+      XMStoreFloat3(&point, XMVector3Transform(local, world));
+
+      if (!SameFloor(collider, point)) mismatches++;
+      if (!SameWall(collider, point, direction)) mismatches++;
+    }
+  }
+
+  return Expect("mismatches", static_cast<float>(mismatches), 0.f);
+}
+
+// Models of a few triangles, scanned block by block rather than through their hierarchy, flat and tilted so the
+// floor kernel shears its rays. Floors and walls must match the linear scan
+bool SmallModels()
+{
+  const auto dir = FixtureDirectory("AssetsTests_small_models");
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  size_t mismatches = 0;
+  for (uint32_t gridSize : {2, 3, 4}) {
+    for (float tilt : {0.f, 0.4f, 1.2f}) {
+      Model3D model;
+      // up to 30 triangles, a building on the larger ones
+      LoadColliderModel(model, dir / ("small_" + std::to_string(gridSize) + ".mesh"), gridSize, gridSize > 2);
+      model.Scale(0.5f + unit(rng)).Rotate(tilt, unit(rng) * XM_2PI, 0.f).Translate(unit(rng) * 10.f, 0.f, 0.f);
+
+      Collider collider;
+      collider.AppendModel(&model);
+
+      const XMMATRIX world = model.WorldMatrix();
+      for (size_t i = 0; i < 200; i++) {
+        XMVECTOR local = XMVectorSet(unit(rng) * (gridSize - 1), unit(rng) * 4.f - 2.f, unit(rng) * (gridSize - 1), 1.f);
+        float angle = unit(rng) * XM_2PI;
+
+        XMFLOAT3 point, direction = {std::cos(angle), 0.f, std::sin(angle)};
+        XMStoreFloat3(&point, XMVector3Transform(local, world));
+
+        if (!SameFloor(collider, point)) mismatches++;
+        if (!SameWall(collider, point, direction)) mismatches++;
+      }
+    }
+  }
+
+  return Expect("mismatches", static_cast<float>(mismatches), 0.f);
+}
+
+// The queries of a crowd in groups around the scene, in no particular order in their array: FindBatch with and
+// without job workers, against one FindFloor and FindWall per agent
+bool CrowdBatch()
+{
+  constexpr uint32_t GRID_SIZE = 64;
+  constexpr size_t NUM_AGENTS = 1000;
+  constexpr size_t NUM_GROUPS = 16;
+
+  Model3D model;
+  LoadColliderModel(model, FixtureDirectory("AssetsTests_crowd") / "crowd.mesh", GRID_SIZE,
+                    GRID_SIZE * GRID_SIZE * 4 / 16);
+
+  Collider collider;
+  collider.AppendModel(&model);
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  std::vector<XMFLOAT2> groups(NUM_GROUPS);
+  for (auto& g : groups) {
+    g = {8.f + unit(rng) * (GRID_SIZE - 16), 8.f + unit(rng) * (GRID_SIZE - 16)};
+  }
+
+  std::vector<ColliderQuery> queries(NUM_AGENTS);
+  std::vector<ColliderHit> expected(NUM_AGENTS);
+  for (size_t i = 0; i < NUM_AGENTS; i++) {
+    ColliderQuery& q = queries[i];
+    const XMFLOAT2& g = groups[rng() % NUM_GROUPS];
+    float angle = unit(rng) * XM_2PI;
+    q.point = {g.x + (unit(rng) - 0.5f) * 16.f, unit(rng) * 10.f, g.y + (unit(rng) - 0.5f) * 16.f};
+    q.direction = {std::cos(angle), 0.f, std::sin(angle)};
+    q.floorOffsetY = 1.f;
+    q.wallOffsetY = 0.5f;
+
+    expected[i].floor = collider.FindFloor(q.point, q.floorOffsetY, expected[i].floorHeight);
+    expected[i].wall = collider.FindWall(XMLoadFloat3(&q.point), XMLoadFloat3(&q.direction), q.wallOffsetY,
+                                         expected[i].wallDistance);
+  }
+
+  size_t numFloors = 0, numWalls = 0;
+  for (const auto& hit : expected) {
+    numFloors += hit.floor != nullptr;
+    numWalls += hit.wall != nullptr;
+  }
+  printf("%zu agents, %zu floor hits, %zu wall hits\n", NUM_AGENTS, numFloors, numWalls);
+
+  const size_t defaultWorkers = Jobs::NumWorkers();
+
+  bool pass = true;
+  for (size_t numWorkers : {0, 3}) {
+    Jobs::Shutdown();
+    Jobs::Init(numWorkers);
+
+    std::vector<ColliderHit> hits(NUM_AGENTS);
+    collider.FindBatch(queries, hits);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < NUM_AGENTS; i++) {
+      bool same = hits[i].floor == expected[i].floor && hits[i].wall == expected[i].wall &&
+                  (!hits[i].floor || hits[i].floorHeight == expected[i].floorHeight) &&
+                  (!hits[i].wall || hits[i].wallDistance == expected[i].wallDistance);
+      mismatches += !same;
+    }
+
+    char what[64];
+    snprintf(what, sizeof(what), "%zu job workers, mismatches", numWorkers);
+    pass &= Expect(what, static_cast<float>(mismatches), 0.f);
+  }
+
+  Jobs::Shutdown();
+  Jobs::Init(defaultWorkers);
+
+  return pass;
+}
+
+// Capsules fitted on generated characters: one per joint, each around every bind pose vertex weighing the most on
+// its joint
+bool ProxiesFit()
+{
+  bool pass = true;
+  for (uint32_t numBones : {2, 40}) {
+    TubeCharacter character(numBones, numBones);
+
+    BoneProxies proxies;
+    proxies.Fit(character.positions, character.bwis, numBones);
+    if (proxies.NumCapsules() != numBones) {
+      printf("ERROR: %zu capsules for %u joints\n", proxies.NumCapsules(), numBones);
+      pass = false;
+      continue;
+    }
+
+    // every joint has vertices here, capsule i is joint i
+    size_t numOutside = 0;
+    for (size_t v = 0; v < character.positions.size(); v++) {
+      const auto& capsule = proxies.BindCapsules()[character.bwis[v].y & 0xff];
+      numOutside += CapsuleDistance(capsule, character.positions[v]) > 1e-5f * (1.f + capsule.radius);
+    }
+
+    char what[64];
+    snprintf(what, sizeof(what), "%u joints, vertices outside their capsule", numBones);
+    pass &= Expect(what, static_cast<float>(numOutside), 0.f);
+  }
+
+  return pass;
+}
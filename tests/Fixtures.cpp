@@ -0,0 +1,391 @@
+#include "stdafx_assets.h"
+
+#include "Fixtures.h"
+
+#include "MeshFormat.h"
+
+using namespace DirectX;
+
+std::filesystem::path FixtureDirectory(const std::string& name)
+{
+  auto dir = std::filesystem::temp_directory_path() / name;
+  std::filesystem::create_directories(dir);
+
+  return dir;
+}
+
+size_t WriteGridMesh(const std::filesystem::path& filename, uint32_t gridSize, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> height(-0.5f, 0.5f);
+
+  const uint32_t numVerts = gridSize * gridSize;
+
+  std::vector<XMFLOAT3> positions(numVerts);
+  std::vector<XMFLOAT3> normals(numVerts, {0.f, 1.f, 0.f});
+  std::vector<XMFLOAT2> uvs(numVerts);
+
+  for (uint32_t y = 0; y < gridSize; y++) {
+    for (uint32_t x = 0; x < gridSize; x++) {
+      positions[y * gridSize + x] = {static_cast<float>(x), height(rng), static_cast<float>(y)};
+      uvs[y * gridSize + x] = {x / static_cast<float>(gridSize - 1), y / static_cast<float>(gridSize - 1)};
+    }
+  }
+
+  std::vector<uint32_t> indices;
+  indices.reserve((gridSize - 1) * (gridSize - 1) * 6);
+  for (uint32_t y = 0; y + 1 < gridSize; y++) {
+    for (uint32_t x = 0; x + 1 < gridSize; x++) {
+      uint32_t i = y * gridSize + x;
+      indices.insert(indices.end(), {i, i + gridSize, i + 1, i + 1, i + gridSize, i + gridSize + 1});
+    }
+  }
+
+  const char strings[] = "ground.mat\0rock.mat";
+  uint32_t half = static_cast<uint32_t>(indices.size() / 6 * 3);
+  std::vector<MeshFormat::Subset> subsets = {
+      {0, half, 0, 10},
+      {half, static_cast<uint32_t>(indices.size()) - half, 11, 8},
+  };
+
+  MeshFormat::Transform transform{
+      .parentBone = -1,
+      .scale = {1.f, 1.f, 1.f},
+      .translation = {0.f, 0.f, 0.f},
+      .rotation = {0.f, 0.f, 0.f, 1.f},
+  };
+
+  using MeshFormat::SectionType;
+
+  MeshFormat::Writer writer;
+  writer.Add(SectionType::Indices, indices);
+  writer.Add(SectionType::Positions, positions);
+  writer.Add(SectionType::Normals, normals);
+  writer.Add(SectionType::UVs, uvs);
+  writer.Add(SectionType::Subsets, subsets);
+  writer.Add(SectionType::Strings, strings, sizeof(strings));
+  writer.Add(SectionType::Transform, &transform, 1);
+
+  if (!writer.Save(filename, numVerts, static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(subsets.size()), 0)) {
+    throw std::runtime_error("Failed to write " + filename.string());
+  }
+
+  return std::filesystem::file_size(filename);
+}
+
+size_t WriteColliderMesh(const std::filesystem::path& filename, uint32_t gridSize, uint32_t numBoxes, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  std::vector<XMFLOAT3> positions;
+  std::vector<uint32_t> indices;
+
+  for (uint32_t z = 0; z < gridSize; z++) {
+    for (uint32_t x = 0; x < gridSize; x++) {
+      positions.push_back({static_cast<float>(x), unit(rng) - 0.5f, static_cast<float>(z)});
+    }
+  }
+  for (uint32_t z = 0; z + 1 < gridSize; z++) {
+    for (uint32_t x = 0; x + 1 < gridSize; x++) {
+      uint32_t i = z * gridSize + x;
+      indices.insert(indices.end(), {i, i + gridSize, i + 1, i + 1, i + gridSize, i + gridSize + 1});
+    }
+  }
+
+  const float size = static_cast<float>(gridSize - 1);
+  for (uint32_t b = 0; b < numBoxes; b++) {
+    float x0 = unit(rng) * size, z0 = unit(rng) * size;
+    float x1 = x0 + 1.f + unit(rng) * 4.f, z1 = z0 + 1.f + unit(rng) * 4.f;
+    float y0 = unit(rng) * 2.f, y1 = y0 + 1.f + unit(rng) * 8.f;
+
+    uint32_t first = static_cast<uint32_t>(positions.size());
+    for (float y : {y0, y1}) {
+      positions.insert(positions.end(), {{x0, y, z0}, {x0, y, z1}, {x1, y, z0}, {x1, y, z1}});
+    }
+
+    // bottom 0 1 2 3, top 4 5 6 7, same corner order
+    const uint32_t quads[6][4] = {
+        {4, 5, 6, 7},  // roof, wound like the terrain
+        {0, 2, 1, 3},  // ceiling
+        {0, 1, 4, 5}, {3, 2, 7, 6}, {2, 0, 6, 4}, {1, 3, 5, 7},
+    };
+    for (const auto& q : quads) {
+      indices.insert(indices.end(), {first + q[0], first + q[1], first + q[2], first + q[2], first + q[1], first + q[3]});
+    }
+  }
+
+  const uint32_t numVerts = static_cast<uint32_t>(positions.size());
+  std::vector<XMFLOAT3> normals(numVerts, {0.f, 1.f, 0.f});
+  std::vector<XMFLOAT2> uvs(numVerts, {0.f, 0.f});
+
+  const char strings[] = "ground.mat";
+  std::vector<MeshFormat::Subset> subsets = {{0, static_cast<uint32_t>(indices.size()), 0, 10}};
+
+  MeshFormat::Transform transform{
+      .parentBone = -1,
+      .scale = {1.f, 1.f, 1.f},
+      .translation = {0.f, 0.f, 0.f},
+      .rotation = {0.f, 0.f, 0.f, 1.f},
+  };
+
+  using MeshFormat::SectionType;
+
+  MeshFormat::Writer writer;
+  writer.Add(SectionType::Indices, indices);
+  writer.Add(SectionType::Positions, positions);
+  writer.Add(SectionType::Normals, normals);
+  writer.Add(SectionType::UVs, uvs);
+  writer.Add(SectionType::Subsets, subsets);
+  writer.Add(SectionType::Strings, strings, sizeof(strings));
+  writer.Add(SectionType::Transform, &transform, 1);
+
+  if (!writer.Save(filename, numVerts, static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(subsets.size()), 0)) {
+    throw std::runtime_error("Failed to write " + filename.string());
+  }
+
+  return indices.size() / 3;
+}
+
+template <typename T>
+static void WriteRaw(std::ofstream& out, const T* data, size_t count)
+{
+  out.write(reinterpret_cast<const char*>(data), sizeof(T) * count);
+}
+
+void WriteRig(const std::filesystem::path& dir, uint32_t numBones, uint32_t numKeyframes, float fps, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+  std::vector<int> ids(numBones * 3);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+  ids.resize(numBones);
+
+  // bone k hangs off one of the few bones created just before, which gives long chains like limbs and spines
+  std::vector<int> parents(numBones, -1);
+  for (uint32_t k = 1; k < numBones; k++) {
+    std::uniform_int_distribution<uint32_t> pick(k > 4 ? k - 4 : 0, k - 1);
+    parents[k] = ids[pick(rng)];
+  }
+
+  std::vector<uint32_t> order(numBones);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  auto randomRotation = [&] {
+    XMFLOAT4 q;
+    XMStoreFloat4(&q, XMQuaternionNormalize(XMVectorSet(unit(rng), unit(rng), unit(rng), unit(rng))));
+    return q;
+  };
+
+  // the root is not a joint, like most exported rigs
+  {
+    std::ofstream out(dir / "rig.skin", std::ios::binary);
+
+    struct {
+      int rootBone;
+      UINT numBones;
+      UINT numJoints;
+    } header = {ids[0], numBones, numBones - 1};
+    WriteRaw(out, &header, 1);
+
+    for (uint32_t k : order) WriteRaw(out, &ids[k], 1);
+    for (uint32_t k : order) WriteRaw(out, &parents[k], 1);
+    WriteRaw(out, ids.data() + 1, numBones - 1);
+
+    for (uint32_t k = 1; k < numBones; k++) {
+      XMFLOAT4X4 inverseBind;
+      XMStoreFloat4x4(&inverseBind, XMMatrixTranslation(unit(rng), unit(rng), unit(rng)));
+      WriteRaw(out, &inverseBind, 1);
+    }
+  }
+
+  struct Transform {
+    XMFLOAT3 scale;
+    XMFLOAT3 translation;
+    XMFLOAT4 rotation;
+  };
+
+  {
+    std::ofstream out(dir / "rig.transforms", std::ios::binary);
+
+    WriteRaw(out, &numBones, 1);
+    WriteRaw(out, ids.data(), numBones);
+    for (uint32_t k = 0; k < numBones; k++) {
+      Transform t = {{1.f, 1.f, 1.f}, {unit(rng), unit(rng), unit(rng)}, randomRotation()};
+      WriteRaw(out, &t, 1);
+    }
+  }
+
+  // one bone in five has no keyframes and keeps its rest transform
+  {
+    std::ofstream out(dir / "rig.anim", std::ios::binary);
+
+    std::vector<int> animated;
+    for (uint32_t k = 0; k < numBones; k++) {
+      if (k % 5 != 4) animated.push_back(ids[k]);
+    }
+
+    uint32_t numAnimatedBones = static_cast<uint32_t>(animated.size());
+    WriteRaw(out, &numAnimatedBones, 1);
+
+    for (int id : animated) {
+      int info[2] = {id, static_cast<int>(numKeyframes)};
+      WriteRaw(out, info, 2);
+
+      // like sampled motion, in metres: bones keep their length and only the root moves,
+      // rotations turn a few degrees per key and slowly change direction
+      XMFLOAT3 offset = {unit(rng) * .1f, unit(rng) * .1f, unit(rng) * .1f};
+      XMFLOAT4 rotation = randomRotation();
+      XMVECTOR step = XMQuaternionNormalize(XMVectorSet(unit(rng) * .02f, unit(rng) * .02f, unit(rng) * .02f, 1.f));
+
+      for (uint32_t i = 0; i < numKeyframes; i++) {
+        XMFLOAT3 translation = offset;
+        if (id == ids[0]) {
+          translation.x += std::sin(i * .05f);
+          translation.z += i * .01f;
+        }
+
+        Animation::Keyframe keyframe = {
+            .time = i / fps,
+            .scale = {1.f, 1.f, 1.f},
+            .translation = translation,
+            .rotation = rotation,
+        };
+        WriteRaw(out, &keyframe, 1);
+
+        XMVECTOR wobble = XMQuaternionNormalize(XMVectorSet(unit(rng) * .001f, unit(rng) * .001f, unit(rng) * .001f, 1.f));
+        step = XMQuaternionNormalize(XMQuaternionMultiply(step, wobble));
+        XMStoreFloat4(&rotation, XMQuaternionNormalize(XMQuaternionMultiply(XMLoadFloat4(&rotation), step)));
+      }
+    }
+  }
+}
+
+Rig LoadRig(const std::filesystem::path& dir, uint32_t numBones, uint32_t numKeyframes, float fps, uint32_t seed)
+{
+  WriteRig(dir, numBones, numKeyframes, fps, seed);
+
+  Rig rig{std::make_shared<Skin>(), std::make_shared<Animation>()};
+  rig.skin->Read(dir / "rig.skin");
+  rig.skin->ReadStaticTransforms(dir / "rig.transforms");
+  rig.animation->Read(dir / "rig.anim");
+
+  return rig;
+}
+
+SkinningScene::SkinningScene(size_t numVertices, size_t numBones, uint32_t seed)
+    : positions(2 * numVertices), normals(2 * numVertices), tangents(2 * numVertices), bwis(numVertices),
+      boneMatrices(numBones)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  auto randomDirection = [&]() {
+    return XMVector3Normalize(XMVectorSet(unit(rng) - .5f, unit(rng) - .5f, unit(rng) - .5f, 0.f));
+  };
+
+  for (auto& bone : boneMatrices) {
+    XMMATRIX m = XMMatrixAffineTransformation(XMVectorReplicate(1.f), XMVectorZero(),
+                                              XMQuaternionRotationAxis(randomDirection(), unit(rng) * XM_PI),
+                                              XMVectorSet(unit(rng), unit(rng), unit(rng), 1.f));
+    XMStoreFloat4x4(&bone, XMMatrixTranspose(m));
+  }
+
+  for (size_t v = 0; v < numVertices; v++) {
+    positions[v] = {unit(rng), unit(rng), unit(rng)};
+    XMStoreFloat3(&normals[v], randomDirection());
+    XMStoreFloat4(&tangents[v], XMVectorSetW(randomDirection(), unit(rng) < .5f ? -1.f : 1.f));
+
+    uint32_t w0 = static_cast<uint32_t>(unit(rng) * 128), w1 = static_cast<uint32_t>(unit(rng) * 64),
+             w2 = static_cast<uint32_t>(unit(rng) * 32), w3 = 255 - w0 - w1 - w2;
+    bwis[v].x = w0 | w1 << 8 | w2 << 16 | w3 << 24;
+    for (size_t k = 0; k < 4; k++) {
+      bwis[v].y |= static_cast<uint32_t>(rng() % numBones) << (8 * k);
+    }
+  }
+
+  constants = {
+      .firstPosition = 0,
+      .firstSkinnedPosition = static_cast<UINT>(numVertices),
+      .firstNormal = 0,
+      .firstSkinnedNormal = static_cast<UINT>(numVertices),
+      .firstTangent = 0,
+      .firstSkinnedTangent = static_cast<UINT>(numVertices),
+      .firstBWI = 0,
+      .firstBoneMatrix = 0,
+      .numVertices = static_cast<UINT>(numVertices),
+  };
+}
+
+TubeCharacter::TubeCharacter(size_t numBones, uint32_t seed) : starts(numBones)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+  for (uint32_t joint = 0; joint < numBones; joint++) {
+    XMVECTOR start = XMVectorSet(unit(rng) - .5f, unit(rng) * 1.8f, unit(rng) - .5f, 1.f);
+    XMVECTOR axis = XMVector3Normalize(XMVectorSet(unit(rng) - .5f, unit(rng) - .5f, unit(rng) - .5f, 0.f));
+    XMVECTOR other = std::abs(XMVectorGetY(axis)) < .9f ? XMVectorSet(0.f, 1.f, 0.f, 0.f) : XMVectorSet(1.f, 0.f, 0.f, 0.f);
+    XMVECTOR side = XMVector3Normalize(XMVector3Cross(axis, other));
+    XMVECTOR up = XMVector3Cross(axis, side);
+    float length = .2f + unit(rng) * .3f, radius = .04f + unit(rng) * .08f;
+    XMStoreFloat3(&starts[joint], start);
+
+    uint32_t first = static_cast<uint32_t>(positions.size());
+    for (uint32_t r = 0; r < RINGS; r++) {
+      for (uint32_t s = 0; s < SEGMENTS; s++) {
+        float angle = s * XM_2PI / SEGMENTS;
+        XMVECTOR p = start + axis * (length * r / (RINGS - 1)) + (side * std::cos(angle) + up * std::sin(angle)) * radius;
+        positions.emplace_back();
+        XMStoreFloat3(&positions.back(), p);
+
+        uint32_t w0 = 220 + static_cast<uint32_t>(unit(rng) * 35);
+        bwis.push_back({w0 | (255 - w0) << 8, joint | ((joint + 1) % static_cast<uint32_t>(numBones)) << 8});
+      }
+    }
+    for (uint32_t r = 0; r + 1 < RINGS; r++) {
+      for (uint32_t s = 0; s < SEGMENTS; s++) {
+        uint32_t i = first + r * SEGMENTS + s, j = first + r * SEGMENTS + (s + 1) % SEGMENTS;
+        indices.insert(indices.end(), {i, j, i + SEGMENTS, j, j + SEGMENTS, i + SEGMENTS});
+      }
+    }
+  }
+}
+
+float CapsuleDistance(const BoneProxies::Capsule& capsule, const XMFLOAT3& point)
+{
+  XMVECTOR a = XMLoadFloat3(&capsule.a), ab = XMLoadFloat3(&capsule.b) - a, ap = XMLoadFloat3(&point) - a;
+  float abab = XMVectorGetX(XMVector3Dot(ab, ab));
+  float t = abab > 0.f ? std::clamp(XMVectorGetX(XMVector3Dot(ap, ab)) / abab, 0.f, 1.f) : 0.f;
+
+  return XMVectorGetX(XMVector3Length(ap - ab * t)) - capsule.radius;
+}
+
+float MaxDifference(std::span<const XMFLOAT4X4> a, std::span<const XMFLOAT4X4> b)
+{
+  float diff = 0.f;
+  for (size_t i = 0; i < a.size(); i++) {
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 4; c++) {
+        diff = std::max(diff, std::abs(a[i].m[r][c] - b[i].m[r][c]));
+      }
+    }
+  }
+
+  return diff;
+}
+
+float MaxDifference(std::span<const XMMATRIX> a, std::span<const XMMATRIX> b)
+{
+  float diff = 0.f;
+  for (size_t i = 0; i < a.size(); i++) {
+    XMFLOAT4X4 fa, fb;
+    XMStoreFloat4x4(&fa, a[i]);
+    XMStoreFloat4x4(&fb, b[i]);
+    diff = std::max(diff, MaxDifference({&fa, 1}, {&fb, 1}));
+  }
+
+  return diff;
+}
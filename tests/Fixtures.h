@@ -0,0 +1,65 @@
+#pragma once
+
+#include "BoneProxies.h"
+#include "Mesh.h"
+#include "Skinning.h"
+
+// Generated assets shared by AssetsBench and AssetsTests, written the way the exporter writes them.
+// Everything is deterministic for a given seed
+
+// directory for the files of one bench command or test, created if needed. ctest may run tests at once,
+// so each one gets its own
+std::filesystem::path FixtureDirectory(const std::string& name);
+
+// gridSize x gridSize vertex terrain patch, two subsets. Returns the file size
+size_t WriteGridMesh(const std::filesystem::path& filename, uint32_t gridSize, uint32_t seed);
+
+// A gridSize x gridSize terrain of unit cells with numBoxes buildings on it: box walls, a roof above and a
+// ceiling below. Returns the number of triangles
+size_t WriteColliderMesh(const std::filesystem::path& filename, uint32_t gridSize, uint32_t numBoxes, uint32_t seed);
+
+// Random rig with the .skin, .anim and static transforms files the exporter would write, as rig.* in dir.
+// Bones are listed in shuffled order with sparse ids, like glTF node indices
+void WriteRig(const std::filesystem::path& dir, uint32_t numBones, uint32_t numKeyframes, float fps, uint32_t seed);
+
+struct Rig {
+  std::shared_ptr<Skin> skin;
+  std::shared_ptr<Animation> animation;
+};
+
+// WriteRig, read back
+Rig LoadRig(const std::filesystem::path& dir, uint32_t numBones, uint32_t numKeyframes, float fps, uint32_t seed);
+
+// A skinned mesh laid out like in the MeshStore, base streams then skinned ones, with random rigid bones.
+// Every vertex has four influences, the weights add up to 255 like the exporter makes them
+struct SkinningScene {
+  std::vector<DirectX::XMFLOAT3> positions, normals;
+  std::vector<DirectX::XMFLOAT4> tangents;
+  std::vector<DirectX::XMUINT2> bwis;
+  std::vector<DirectX::XMFLOAT4X4> boneMatrices;
+  SkinningPerDispatchConstants constants;
+
+  SkinningScene(size_t numVertices, size_t numBones, uint32_t seed);
+
+  Skinning::Buffers Buffers() { return {positions, normals, tangents, bwis, boneMatrices}; }
+};
+
+// A generated character: one tube of rings around a random segment per joint, its vertices weighing at least 86%
+// on that joint and the rest on the next
+struct TubeCharacter {
+  static constexpr uint32_t RINGS = 6, SEGMENTS = 8;
+
+  std::vector<DirectX::XMFLOAT3> positions;
+  std::vector<DirectX::XMUINT2> bwis;
+  std::vector<uint32_t> indices;
+  std::vector<DirectX::XMFLOAT3> starts;  // of the segment of each joint
+
+  TubeCharacter(size_t numBones, uint32_t seed);
+};
+
+// how far a point is out of a capsule, negative inside
+float CapsuleDistance(const BoneProxies::Capsule& capsule, const DirectX::XMFLOAT3& point);
+
+// largest difference between elements of the same index
+float MaxDifference(std::span<const DirectX::XMFLOAT4X4> a, std::span<const DirectX::XMFLOAT4X4> b);
+float MaxDifference(std::span<const DirectX::XMMATRIX> a, std::span<const DirectX::XMMATRIX> b);
@@ -0,0 +1,80 @@
+#include "stdafx_assets.h"
+
+#include "Legacy.h"
+
+using namespace DirectX;
+
+namespace Legacy
+{
+static XMMATRIX Interpolate(const Clip& animation, float curTime, int boneId, Skeleton& skeleton)
+{
+  static const XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+
+  auto it = animation.bonesKeyframes.find(boneId);
+  if (it == std::end(animation.bonesKeyframes)) {
+    return XMLoadFloat4x4(&skeleton.staticTransforms[boneId]);
+  }
+
+  auto keyframes = it->second;
+
+  if (curTime <= keyframes.front().time) {
+    return XMMatrixAffineTransformation(XMLoadFloat3(&keyframes.front().scale), zero,
+                                        XMLoadFloat4(&keyframes.front().rotation),
+                                        XMLoadFloat3(&keyframes.front().translation));
+  } else if (curTime >= keyframes.back().time) {
+    return XMMatrixAffineTransformation(XMLoadFloat3(&keyframes.back().scale), zero,
+                                        XMLoadFloat4(&keyframes.back().rotation),
+                                        XMLoadFloat3(&keyframes.back().translation));
+  }
+
+  for (size_t i = 0; i < keyframes.size(); i++) {
+    if (curTime >= keyframes[i].time && curTime <= keyframes[i + 1].time) {
+      float lerp = (curTime - keyframes[i].time) / (keyframes[i + 1].time - keyframes[i].time);
+
+      XMVECTOR scale = XMVectorLerp(XMLoadFloat3(&keyframes[i].scale), XMLoadFloat3(&keyframes[i + 1].scale), lerp);
+      XMVECTOR trans =
+          XMVectorLerp(XMLoadFloat3(&keyframes[i].translation), XMLoadFloat3(&keyframes[i + 1].translation), lerp);
+      XMVECTOR rot =
+          XMQuaternionSlerp(XMLoadFloat4(&keyframes[i].rotation), XMLoadFloat4(&keyframes[i + 1].rotation), lerp);
+
+      return XMMatrixAffineTransformation(scale, zero, rot, trans);
+    }
+  }
+
+  return XMMatrixIdentity();
+}
+
+std::vector<XMFLOAT4X4> BoneTransforms(const Clip& animation,
+                                       float curTime,
+                                       Skeleton& skeleton,
+                                       const Skin& skin,
+                                       std::unordered_map<int, XMMATRIX>& globalTransforms)
+{
+  globalTransforms[skeleton.rootBone] = Interpolate(animation, curTime, skeleton.rootBone, skeleton);
+
+  std::stack<int> stack;
+  stack.push(skeleton.rootBone);
+
+  while (!stack.empty()) {
+    int bone = stack.top();
+    stack.pop();
+
+    auto parentGlobalTransform = globalTransforms[bone];
+
+    auto children = skeleton.boneHierarchy[bone];
+    for (auto child : children) {
+      globalTransforms[child] = Interpolate(animation, curTime, child, skeleton) * parentGlobalTransform;
+      stack.push(child);
+    }
+  }
+
+  std::vector<XMFLOAT4X4> boneTransforms(skeleton.jointIndices.size());
+  for (size_t i = 0; i < boneTransforms.size(); i++) {
+    XMMATRIX inverseBindMatrix = XMLoadFloat4x4(&skin.inverseBindMatrices[i]);
+    XMStoreFloat4x4(&boneTransforms[i],
+                    XMMatrixTranspose(inverseBindMatrix * globalTransforms[skeleton.jointIndices[i]]));
+  }
+
+  return boneTransforms;
+}
+}  // namespace Legacy
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Pose evaluation as it was before Skin was flattened and clips were split in tracks, kept as the baseline
+// the benches time and the tests compare against: hierarchy walked with a stack, transforms and keyframes looked up
+// by bone id in hash maps, keyframes copied and scanned linearly.
+namespace Legacy
+{
+using DirectX::XMFLOAT4X4;
+using DirectX::XMMATRIX;
+
+struct Clip {
+  std::unordered_map<int, std::vector<Animation::Keyframe>> bonesKeyframes;
+
+  explicit Clip(const Animation& animation)
+  {
+    for (size_t i = 0; i < animation.tracks.size(); i++) {
+      auto& keyframes = bonesKeyframes[animation.trackBones[i]];
+
+      const auto& track = animation.tracks[i];
+      for (uint32_t key = track.firstKey; key < track.firstKey + track.numKeys; key++) {
+        keyframes.push_back({animation.times[key], animation.scales[key], animation.translations[key],
+                             animation.rotations[key]});
+      }
+    }
+  }
+};
+
+struct Skeleton {
+  int rootBone;
+  std::unordered_map<int, std::vector<int>> boneHierarchy;  // parent -> children
+  std::vector<int> jointIndices;
+  std::unordered_map<int, XMFLOAT4X4> staticTransforms;
+
+  explicit Skeleton(const Skin& skin) : rootBone(skin.header.rootBone)
+  {
+    for (size_t i = 0; i < skin.NumBones(); i++) {
+      if (skin.parentIndices[i] >= 0) boneHierarchy[skin.boneIds[skin.parentIndices[i]]].push_back(skin.boneIds[i]);
+      staticTransforms[skin.boneIds[i]] = skin.restTransforms[i];
+    }
+    for (int bone : skin.jointBones) {
+      jointIndices.push_back(skin.boneIds[bone]);
+    }
+  }
+};
+
+std::vector<XMFLOAT4X4> BoneTransforms(const Clip& animation,
+                                       float curTime,
+                                       Skeleton& skeleton,
+                                       const Skin& skin,
+                                       std::unordered_map<int, XMMATRIX>& globalTransforms);
+}  // namespace Legacy
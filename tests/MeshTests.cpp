@@ -0,0 +1,87 @@
+#include "stdafx_assets.h"
+
+#include "Tests.h"
+
+#include "Fixtures.h"
+#include "Mesh.h"
+#include "Streaming.h"
+
+template <typename T>
+static bool SameBytes(const char* what, std::span<const T> a, std::span<const T> b)
+{
+  bool same = a.size() == b.size() && memcmp(a.data(), b.data(), a.size_bytes()) == 0;
+  if (!same) printf("ERROR: %s differ, %zu and %zu elements\n", what, a.size(), b.size());
+
+  return same;
+}
+
+// The streams computed at the first read are written to the .meshcache, the next read maps them back.
+// Both must give the same mesh
+bool MeshCache()
+{
+  const auto file = FixtureDirectory("AssetsTests_mesh_cache") / "grid.mesh";
+  const auto cache = std::filesystem::path(file).replace_extension(".meshcache");
+  WriteGridMesh(file, 33, 1);
+  std::filesystem::remove(cache);
+
+  Mesh3D cold;
+  cold.Read(file);
+  if (!std::filesystem::exists(cache)) {
+    printf("ERROR: the first read did not write %s\n", cache.string().c_str());
+    return false;
+  }
+
+  Mesh3D warm;
+  warm.Read(file);
+
+  bool pass = SameBytes<uint32_t>("indices", cold.indices, warm.indices);
+  pass &= SameBytes<DirectX::XMFLOAT3>("positions", cold.positions, warm.positions);
+  pass &= SameBytes<DirectX::XMFLOAT3>("normals", cold.normals, warm.normals);
+  pass &= SameBytes<DirectX::XMFLOAT4>("tangents", cold.tangents, warm.tangents);
+  pass &= SameBytes<MeshletData>("meshlets", cold.meshlets, warm.meshlets);
+  pass &= SameBytes<uint8_t>("meshlet vertex indices", cold.uniqueVertexIndices, warm.uniqueVertexIndices);
+  pass &= SameBytes<DirectX::MeshletTriangle>("meshlet primitives", cold.primitiveIndices, warm.primitiveIndices);
+  printf("%zu vertices, %zu meshlets\n", cold.positions.size(), cold.meshlets.size());
+
+  return pass;
+}
+
+// Requests waiting for a streaming thread are picked by the priorities of the last update, not the submitted ones
+bool StreamingPriorities()
+{
+  Streaming::Init(1);
+
+  // holds the streaming thread until every request is queued and updated
+  std::promise<void> started, release;
+  std::shared_future<void> released = release.get_future().share();
+  Streaming::Submit({.load = [&started, released]() {
+    started.set_value();
+    released.wait();
+  }});
+  started.get_future().wait();
+
+  const int numRequests = 8;
+  std::vector<int> order;
+  for (int i = 0; i < numRequests; i++) {
+    Streaming::Submit({
+        .priority = static_cast<float>(i),
+        .complete = [&order, i]() { order.push_back(i); },
+        .update = [i]() { return static_cast<float>(numRequests - i); },
+    });
+  }
+  Streaming::UpdatePriorities();
+  release.set_value();
+
+  while (Streaming::NumPending() > 0) {
+    if (Streaming::Poll(std::chrono::milliseconds(1)) == 0) std::this_thread::yield();
+  }
+  Streaming::Shutdown();
+
+  bool pass = order.size() == numRequests;
+  for (int i = 0; pass && i < numRequests; i++) {
+    pass = order[i] == numRequests - 1 - i;
+  }
+  if (!pass) printf("ERROR: the requests did not load from the highest submitted priority down\n");
+
+  return pass;
+}
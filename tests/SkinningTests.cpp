@@ -0,0 +1,37 @@
+#include "stdafx_assets.h"
+
+#include "Tests.h"
+
+#include "Fixtures.h"
+#include "Jobs.h"
+#include "Skinning.h"
+
+using namespace DirectX;
+
+// The SIMD path on the job workers, against one vertex at a time. The vertex count is not a multiple of the
+// lane count, so the last vertices go through the tail
+bool SkinningVsScalar()
+{
+  const size_t numVertices = 4099;
+
+  SkinningScene expected(numVertices, 67, 1);
+  Skinning::DispatchScalar(expected.Buffers(), expected.constants);
+
+  SkinningScene scene(numVertices, 67, 1);
+  Skinning::Dispatch(scene.Buffers(), scene.constants);
+
+  float positionDiff = 0.f, normalDiff = 0.f, tangentDiff = 0.f;
+  auto diff = [](auto a, auto b) { return XMVectorGetX(XMVector4Length(XMVectorSubtract(a, b))); };
+  for (size_t v = numVertices; v < 2 * numVertices; v++) {
+    positionDiff = std::max(positionDiff, diff(XMLoadFloat3(&expected.positions[v]), XMLoadFloat3(&scene.positions[v])));
+    normalDiff = std::max(normalDiff, diff(XMLoadFloat3(&expected.normals[v]), XMLoadFloat3(&scene.normals[v])));
+    tangentDiff = std::max(tangentDiff, diff(XMLoadFloat4(&expected.tangents[v]), XMLoadFloat4(&scene.tangents[v])));
+  }
+
+  printf("%s (%zu lanes), %zu job workers\n", Skinning::InstructionSet(), Skinning::Width(), Jobs::NumWorkers());
+  bool pass = Expect("positions, max difference", positionDiff, 1e-5f);
+  pass &= Expect("normals, max difference", normalDiff, 1e-5f);
+  pass &= Expect("tangents, max difference", tangentDiff, 1e-5f);
+
+  return pass;
+}
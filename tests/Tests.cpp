@@ -0,0 +1,119 @@
+#include "stdafx_assets.h"
+
+#include "Tests.h"
+
+#include "Jobs.h"
+#include "Mesh.h"
+
+std::atomic<size_t> g_NumAllocations;
+
+struct Test {
+  const char* name;
+  bool (*run)();
+};
+
+static const Test g_Tests[] = {
+    {"mesh_cache", MeshCache},
+    {"streaming", StreamingPriorities},
+    {"skeleton", SkeletonVsLegacy},
+    {"tracks", TracksVsLegacy},
+    {"cursors", CursorsVsSearch},
+    {"batch", BatchVsScalar},
+    {"compress", CompressedClip},
+    {"batch_workers", BatchWorkers},
+    {"lod_sharing", LodSharing},
+    {"allocations", AnimationAllocations},
+    {"skinning", SkinningVsScalar},
+    {"collider", ColliderVsLinear},
+    {"wall_packets", WallPackets},
+    {"refresh", RefreshedModel},
+    {"small_models", SmallModels},
+    {"crowd", CrowdBatch},
+    {"proxies", ProxiesFit},
+};
+
+bool Expect(const char* what, float value, float tolerance)
+{
+  bool pass = value <= tolerance;
+  printf("%s%s: %g (tolerance %g)\n", pass ? "" : "ERROR: ", what, value, tolerance);
+
+  return pass;
+}
+
+int main(int argc, char** argv)
+{
+  int first = 1;
+  int numWorkers = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+  if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+    numWorkers = atoi(argv[2]);
+    first = 3;
+  }
+
+  Mesh3D::verbose = false;
+  Jobs::Init(numWorkers);
+
+  int failed = 0;
+  int found = 0;
+  for (const auto& test : g_Tests) {
+    bool selected = argc == first;
+    for (int i = first; i < argc; i++) {
+      selected = selected || strcmp(argv[i], test.name) == 0;
+    }
+    if (!selected) continue;
+
+    found++;
+    printf("[%s]\n", test.name);
+    if (!test.run()) {
+      printf("[%s] FAILED\n", test.name);
+      failed++;
+    }
+  }
+
+  Jobs::Shutdown();
+
+  if (found < argc - first) {
+    printf("ERROR: unknown test, the tests are:\n");
+    for (const auto& test : g_Tests) {
+      printf("%s\n", test.name);
+    }
+    return 1;
+  }
+
+  printf("%d of %d tests failed\n", failed, found);
+
+  return failed > 0 ? 1 : 0;
+}
+
+// Counted for the allocations test. The array, sized and nothrow forms end up in these two
+void* operator new(size_t size)
+{
+  g_NumAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+  g_NumAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  const size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+  if (void* p = _aligned_malloc(size ? size : 1, align)) return p;
+#else
+  // aligned_alloc wants a multiple of the alignment
+  if (void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) return p;
+#endif
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Equivalence checks of the Assets library: every fast path against the plain one it replaces, on small generated
+// assets. A test returns false when it fails, after printing what differs.
+//   AssetsTests [-j N] [test]...   all of them when none is named, -j N as for AssetsBench
+
+// heap allocations of the whole program, see operator new in Tests.cpp
+extern std::atomic<size_t> g_NumAllocations;
+
+// prints what was measured, true when value is within tolerance
+bool Expect(const char* what, float value, float tolerance);
+
+// MeshTests.cpp
+bool MeshCache();
+bool StreamingPriorities();
+
+// AnimationTests.cpp
+bool SkeletonVsLegacy();
+bool TracksVsLegacy();
+bool CursorsVsSearch();
+bool BatchVsScalar();
+bool CompressedClip();
+bool BatchWorkers();
+bool LodSharing();
+bool AnimationAllocations();
+
+// ColliderTests.cpp
+bool ColliderVsLinear();
+bool WallPackets();
+bool RefreshedModel();
+bool SmallModels();
+bool CrowdBatch();
+bool ProxiesFit();
+
+// SkinningTests.cpp
+bool SkinningVsScalar();